@@ -294,6 +294,39 @@ init(int argc, char* argv[])
     std::cout << std::endl;
 }
 
+void*
+create_shared_context()
+{
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    SDL_GLContext context = SDL_GL_CreateContext(m_sdl_window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+    if (!context)
+    {
+        std::cerr << "Failed to create shared OpenGL context:" << std::endl;
+        std::cerr << "Error: " << SDL_GetError() << std::endl;
+        return nullptr;
+    }
+
+    // Creating a context makes it current, give the window its own back.
+    SDL_GL_MakeCurrent(m_sdl_window, m_gl_context);
+
+    return context;
+}
+
+void
+make_context_current(void* context)
+{
+    SDL_GL_MakeCurrent(context ? m_sdl_window : nullptr,
+        static_cast<SDL_GLContext>(context));
+}
+
+void
+delete_shared_context(void* context)
+{
+    SDL_GL_DeleteContext(static_cast<SDL_GLContext>(context));
+}
+
 int
 exec(Scene_Camera& camera)
 {
@@ -45,6 +45,15 @@ void     cout_opengl_version();
 void     cout_glew_version();
 
 void     init(int argc, char* argv[]);
+
+// Contexts sharing objects with the context of the window, for uploads on
+// other threads. Must be created and deleted on the thread calling exec().
+// make_context_current(nullptr) releases the context current on the
+// calling thread.
+void*    create_shared_context();
+void     make_context_current(void* context);
+void     delete_shared_context(void* context);
+
 int      exec(Camera& camera);
 
 }
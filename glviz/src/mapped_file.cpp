@@ -0,0 +1,190 @@
+// This file is part of GLviz.
+//
+// Copyright(c) 2014, 2015 Sebastian Lipponer
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GLVIZ_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace GLviz
+{
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_mapped(false)
+{
+}
+
+MappedFile::MappedFile(std::string const& filename)
+    : m_data(nullptr), m_size(0), m_mapped(false)
+{
+    open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+    : m_data(other.m_data), m_size(other.m_size), m_mapped(other.m_mapped),
+      m_buffer(std::move(other.m_buffer))
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_mapped = false;
+}
+
+MappedFile&
+MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other)
+    {
+        close();
+
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_mapped = other.m_mapped;
+        m_buffer = std::move(other.m_buffer);
+
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_mapped = false;
+    }
+
+    return *this;
+}
+
+void
+MappedFile::open(std::string const& filename)
+{
+    close();
+
+#ifdef GLVIZ_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat status;
+
+    if (fd >= 0 && fstat(fd, &status) == 0)
+    {
+        m_size = static_cast<std::size_t>(status.st_size);
+
+        void* ptr = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE,
+            fd, 0) : MAP_FAILED;
+        ::close(fd);
+
+        if (ptr != MAP_FAILED)
+        {
+            madvise(ptr, m_size, MADV_WILLNEED);
+
+            m_data = static_cast<char const*>(ptr);
+            m_mapped = true;
+            return;
+        }
+
+        if (m_size == 0)
+        {
+            return;
+        }
+
+        m_size = 0;
+    }
+    else if (fd >= 0)
+    {
+        ::close(fd);
+    }
+#endif
+
+    std::ifstream input(filename, std::ios::in | std::ios::binary
+        | std::ios::ate);
+
+    if (input.fail())
+    {
+        std::ostringstream error_message;
+        error_message << "Error: Can not open "
+            << filename << "." << std::endl;
+
+        throw std::runtime_error(error_message.str().c_str());
+    }
+
+    m_buffer.resize(static_cast<std::size_t>(input.tellg()));
+    input.seekg(0);
+    input.read(m_buffer.data(), static_cast<std::streamsize>(
+        m_buffer.size()));
+
+    if (input.fail())
+    {
+        std::ostringstream error_message;
+        error_message << "Error: Can not read "
+            << filename << "." << std::endl;
+
+        throw std::runtime_error(error_message.str().c_str());
+    }
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+void
+MappedFile::close()
+{
+#ifdef GLVIZ_MMAP
+    if (m_mapped)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+}
+
+char const*
+MappedFile::data() const
+{
+    return m_data;
+}
+
+std::size_t
+MappedFile::size() const
+{
+    return m_size;
+}
+
+bool
+MappedFile::mapped() const
+{
+    return m_mapped;
+}
+
+}
@@ -0,0 +1,69 @@
+// This file is part of GLviz.
+//
+// Copyright(c) 2014, 2015 Sebastian Lipponer
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace GLviz
+{
+
+// Read-only view of a whole file. On POSIX systems the file is mapped into
+// memory and pages are loaded on first access, elsewhere it is read into a
+// buffer with a single call.
+class MappedFile
+{
+
+public:
+    MappedFile();
+    explicit MappedFile(std::string const& filename);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+
+    void open(std::string const& filename);
+    void close();
+
+    char const* data() const;
+    std::size_t size() const;
+
+    // Whether data() points into a mapping rather than a copy.
+    bool mapped() const;
+
+private:
+    MappedFile(MappedFile const&);
+    MappedFile& operator=(MappedFile const&);
+
+private:
+    char const* m_data;
+    std::size_t m_size;
+    bool m_mapped;
+    std::vector<char> m_buffer;
+};
+
+}
+
+#endif // MAPPED_FILE_HPP
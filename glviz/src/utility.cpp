@@ -28,12 +28,189 @@
 #include <fstream>
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
 namespace GLviz
 {
 
+namespace
+{
+
+// Number of blocks for_each_block splits [0, n) into, one per core.
+std::size_t
+num_blocks(std::size_t n)
+{
+    const std::size_t min_block_size = 16384;
+
+    std::size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<std::size_t>(1, std::min(num_threads,
+        n / min_block_size));
+}
+
+// Splits [0, n) into num_blocks contiguous blocks of equal size, but for
+// the last, and calls f(block, begin, end) for each on its own thread.
+template <typename Function>
+void
+for_each_indexed_block(std::size_t n, std::size_t num_blocks,
+    Function const& f)
+{
+    std::size_t block_size = (n + num_blocks - 1) / num_blocks;
+
+    std::vector<std::thread> threads;
+    for (std::size_t i(1); i < num_blocks; ++i)
+    {
+        threads.push_back(std::thread([&f, i, block_size, n]()
+        {
+            f(i, std::min(n, i * block_size),
+                std::min(n, (i + 1) * block_size));
+        }));
+    }
+
+    f(0, 0, std::min(n, block_size));
+
+    for (std::size_t i(0); i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+}
+
+// Calls f(begin, end) for one contiguous block of [0, n) per core.
+template <typename Function>
+void
+for_each_block(std::size_t n, Function const& f)
+{
+    for_each_indexed_block(n, num_blocks(n), [&f](std::size_t,
+        std::size_t begin, std::size_t end)
+    {
+        f(begin, end);
+    });
+}
+
+}
+
+RawMeshView::RawMeshView()
+    : m_num_vertices(0), m_num_faces(0), m_vertices(nullptr),
+      m_faces(nullptr)
+{
+}
+
+RawMeshView::RawMeshView(std::string const& filename)
+    : m_num_vertices(0), m_num_faces(0), m_vertices(nullptr),
+      m_faces(nullptr)
+{
+    open(filename);
+}
+
+void
+RawMeshView::open(std::string const& filename)
+{
+    static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float)
+        && sizeof(std::array<unsigned int, 3>) == 3 * sizeof(unsigned int),
+        "vertices and faces must be tightly packed");
+
+    // Forget the previous mesh first, its pointers die with the mapping
+    // even if this file fails to open or validate.
+    m_num_vertices = 0;
+    m_num_faces = 0;
+    m_vertices = nullptr;
+    m_faces = nullptr;
+
+    m_file.open(filename);
+
+    char const* data = m_file.data();
+    std::size_t size = m_file.size();
+
+    // Layout: vertex count, vertices, face count, faces.
+    std::size_t vertex_offset = sizeof(unsigned int);
+    std::size_t face_offset(0), end(0);
+    unsigned int nv(0), nf(0);
+
+    bool valid = size >= vertex_offset;
+    if (valid)
+    {
+        std::memcpy(&nv, data, sizeof(unsigned int));
+
+        face_offset = vertex_offset + 3 * sizeof(float)
+            * static_cast<std::size_t>(nv) + sizeof(unsigned int);
+        valid = size >= face_offset;
+    }
+
+    if (valid)
+    {
+        std::memcpy(&nf, data + face_offset - sizeof(unsigned int),
+            sizeof(unsigned int));
+
+        end = face_offset + 3 * sizeof(unsigned int)
+            * static_cast<std::size_t>(nf);
+        valid = size == end;
+    }
+
+    if (!valid)
+    {
+        std::ostringstream error_message;
+        error_message << "Error: " << filename << " has " << size
+            << " bytes, which does not match its header." << std::endl;
+
+        m_file.close();
+        throw std::runtime_error(error_message.str().c_str());
+    }
+
+    m_num_vertices = nv;
+    m_num_faces = nf;
+    m_vertices = reinterpret_cast<Eigen::Vector3f const*>(
+        data + vertex_offset);
+    m_faces = reinterpret_cast<std::array<unsigned int, 3> const*>(
+        data + face_offset);
+}
+
+std::size_t
+RawMeshView::num_vertices() const
+{
+    return m_num_vertices;
+}
+
+Eigen::Vector3f const*
+RawMeshView::vertices() const
+{
+    return m_vertices;
+}
+
+std::size_t
+RawMeshView::num_faces() const
+{
+    return m_num_faces;
+}
+
+std::array<unsigned int, 3> const*
+RawMeshView::faces() const
+{
+    return m_faces;
+}
+
+MappedFile const&
+RawMeshView::file() const
+{
+    return m_file;
+}
+
 void
 load_raw(std::string const& filename, std::vector<Eigen::Vector3f>& vertices,
     std::vector<std::array<unsigned int, 3> >& faces)
+{
+    RawMeshView mesh(filename);
+
+    vertices.assign(mesh.vertices(), mesh.vertices() + mesh.num_vertices());
+    faces.assign(mesh.faces(), mesh.faces() + mesh.num_faces());
+}
+
+void
+load_raw_stream(std::string const& filename,
+    std::vector<Eigen::Vector3f>& vertices,
+    std::vector<std::array<unsigned int, 3> >& faces)
 {
     std::ifstream input(filename, std::ios::in | std::ios::binary);
 
@@ -140,6 +317,164 @@ set_vertex_normals_from_triangle_mesh(std::vector<Eigen::Vector3f>
     }
 }
 
+void
+build_vertex_face_adjacency(std::size_t num_vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    VertexFaceAdjacency& adjacency)
+{
+    std::size_t nf(faces.size());
+
+    std::vector<unsigned int>& offsets = adjacency.offsets;
+    offsets.assign(num_vertices + 1, 0);
+
+    // Counting sort of the face corners by vertex in two levels, without
+    // atomics and with transient memory of the size of the result. The
+    // corners are first bucketed by the range of vertices each thread owns
+    // later, every block of faces counting and then writing its corners
+    // into its own part of every bucket. Each thread then sorts the
+    // corners of its bucket into the lists of its vertices. Buckets keep
+    // the face order, so the lists come out sorted.
+    std::size_t nb = num_blocks(nf);
+    std::size_t range_size = std::max<std::size_t>(1,
+        (num_vertices + nb - 1) / nb);
+
+    std::vector<std::size_t> bucket(nb * nb, 0);
+
+    for_each_indexed_block(nf, nb, [&](std::size_t block,
+        std::size_t begin, std::size_t end)
+    {
+        std::size_t* count = &bucket[block * nb];
+
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            for (unsigned int j(0); j < 3; ++j)
+            {
+                unsigned int v = faces[i][j];
+                if (v < num_vertices)
+                {
+                    ++count[v / range_size];
+                }
+            }
+        }
+    });
+
+    // Buckets in the order of the vertex ranges, the blocks of faces in
+    // order within them.
+    std::vector<std::size_t> range_begin(nb + 1, 0);
+    for (std::size_t r(0); r < nb; ++r)
+    {
+        std::size_t next = range_begin[r];
+        for (std::size_t block(0); block < nb; ++block)
+        {
+            std::size_t count = bucket[block * nb + r];
+            bucket[block * nb + r] = next;
+            next += count;
+        }
+
+        range_begin[r + 1] = next;
+    }
+
+    std::vector<unsigned int> corners(range_begin[nb]);
+
+    for_each_indexed_block(nf, nb, [&](std::size_t block,
+        std::size_t begin, std::size_t end)
+    {
+        std::size_t* next = &bucket[block * nb];
+
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            for (unsigned int j(0); j < 3; ++j)
+            {
+                unsigned int v = faces[i][j];
+                if (v < num_vertices)
+                {
+                    corners[next[v / range_size]++] =
+                        static_cast<unsigned int>(3 * i + j);
+                }
+            }
+        }
+    });
+
+    adjacency.faces.resize(corners.size());
+
+    for_each_indexed_block(num_vertices, nb, [&](std::size_t r,
+        std::size_t begin, std::size_t end)
+    {
+        std::vector<unsigned int> next(end - begin, 0);
+
+        for (std::size_t k(range_begin[r]); k < range_begin[r + 1]; ++k)
+        {
+            ++next[faces[corners[k] / 3][corners[k] % 3] - begin];
+        }
+
+        std::size_t first = range_begin[r];
+        for (std::size_t v(begin); v < end; ++v)
+        {
+            std::size_t count = next[v - begin];
+            next[v - begin] = static_cast<unsigned int>(first);
+            first += count;
+            offsets[v + 1] = static_cast<unsigned int>(first);
+        }
+
+        for (std::size_t k(range_begin[r]); k < range_begin[r + 1]; ++k)
+        {
+            unsigned int v = faces[corners[k] / 3][corners[k] % 3];
+            adjacency.faces[next[v - begin]++] = corners[k] / 3;
+        }
+    });
+}
+
+void
+set_vertex_normals_from_triangle_mesh_parallel(
+    std::vector<Eigen::Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    std::vector<Eigen::Vector3f>& normals, VertexFaceAdjacency* adjacency)
+{
+    VertexFaceAdjacency local;
+    VertexFaceAdjacency& a = adjacency ? *adjacency : local;
+
+    build_vertex_face_adjacency(vertices.size(), faces, a);
+
+    // Face normals in one streaming pass, gathered below.
+    std::vector<Eigen::Vector3f> face_normals(faces.size());
+
+    for_each_block(faces.size(), [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            std::array<unsigned int, 3> const& f_i = faces[i];
+
+            Eigen::Vector3f const& p0(vertices[f_i[0]]);
+            Eigen::Vector3f const& p1(vertices[f_i[1]]);
+            Eigen::Vector3f const& p2(vertices[f_i[2]]);
+
+            face_normals[i] = (p0 - p1).cross(p0 - p2);
+        }
+    });
+
+    normals.resize(vertices.size());
+
+    for_each_block(vertices.size(), [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            Eigen::Vector3f n = Eigen::Vector3f::Zero();
+
+            for (unsigned int j(a.offsets[i]); j < a.offsets[i + 1]; ++j)
+            {
+                n += face_normals[a.faces[j]];
+            }
+
+            if (!n.isZero())
+            {
+                n.normalize();
+            }
+
+            normals[i] = n;
+        }
+    });
+}
+
 std::string
 get_gl_error_string(GLenum gl_error)
 {
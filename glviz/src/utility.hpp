@@ -23,9 +23,12 @@
 #ifndef UTILITY_HPP
 #define UTILITY_HPP
 
+#include "mapped_file.hpp"
+
 #include <glad/glad.h>
 #include <Eigen/Core>
 
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <array>
@@ -33,9 +36,41 @@
 namespace GLviz
 {
 
+// Vertices and faces of a raw mesh file viewed in place, without copying.
+// The counts in the file are checked against its size on opening.
+class RawMeshView
+{
+
+public:
+    RawMeshView();
+    explicit RawMeshView(std::string const& filename);
+
+    void open(std::string const& filename);
+
+    std::size_t num_vertices() const;
+    Eigen::Vector3f const* vertices() const;
+
+    std::size_t num_faces() const;
+    std::array<unsigned int, 3> const* faces() const;
+
+    MappedFile const& file() const;
+
+private:
+    MappedFile m_file;
+    std::size_t m_num_vertices, m_num_faces;
+    Eigen::Vector3f const* m_vertices;
+    std::array<unsigned int, 3> const* m_faces;
+};
+
 void load_raw(std::string const& filename, std::vector<Eigen::Vector3f>
     &vertices, std::vector<std::array<unsigned int, 3> >& faces);
 
+// Reads the raw mesh with one stream read per element, as load_raw did
+// before the mapping. Kept to benchmark load_raw against.
+void load_raw_stream(std::string const& filename,
+    std::vector<Eigen::Vector3f>& vertices,
+    std::vector<std::array<unsigned int, 3> >& faces);
+
 void save_raw(std::string const& filename, std::vector<Eigen::Vector3f>
     const& vertices, std::vector<std::array<unsigned int, 3> >& faces);
 
@@ -43,6 +78,30 @@ void set_vertex_normals_from_triangle_mesh(std::vector<Eigen::Vector3f>
     const& vertices, std::vector<std::array<unsigned int, 3> > const& faces,
     std::vector<Eigen::Vector3f>& normals);
 
+// Faces around each vertex in compressed sparse row form, the faces of
+// vertex i are faces[offsets[i]] to faces[offsets[i + 1] - 1] in
+// increasing order.
+struct VertexFaceAdjacency
+{
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> faces;
+};
+
+void build_vertex_face_adjacency(std::size_t num_vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    VertexFaceAdjacency& adjacency);
+
+// Same result as set_vertex_normals_from_triangle_mesh on all cores. Each
+// vertex gathers the area weighted normals of its faces instead of the
+// faces scattering into the vertices. The adjacency is always built
+// from faces, if adjacency is given it is stored there so it can be
+// shared with later passes.
+void set_vertex_normals_from_triangle_mesh_parallel(
+    std::vector<Eigen::Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    std::vector<Eigen::Vector3f>& normals,
+    VertexFaceAdjacency* adjacency = nullptr);
+
 std::string get_gl_error_string(GLenum gl_error);
 std::string get_gl_framebuffer_status_string(GLenum framebuffer_status);
 
@@ -0,0 +1,262 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "async_uploader.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+// Uploading in chunks lets a newer upload cancel an outdated one early.
+const std::size_t chunk_size = 64 << 20;
+
+}
+
+AsyncUploader::Result::Result()
+    : vbo(0), plane_vbo(0), count(0), packed(false), clipped(false),
+      fence(nullptr)
+{
+}
+
+AsyncUploader::AsyncUploader(std::function<void (bool)> const& make_current)
+    : m_make_current(make_current), m_job_pending(false), m_pending(false),
+      m_has_result(false), m_stop(false)
+{
+    m_thread = std::thread(&AsyncUploader::run, this);
+}
+
+AsyncUploader::~AsyncUploader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_job_pending = true;
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void
+AsyncUploader::upload(Surfel const* surfels, std::size_t n, bool packed)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_job.surfels = surfels;
+        m_job.count = n;
+        m_job.packed = packed;
+        m_job.cancelled = false;
+        m_job_pending = true;
+        m_pending = true;
+    }
+
+    m_condition.notify_one();
+}
+
+void
+AsyncUploader::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_pending)
+        {
+            return;
+        }
+
+        // The buffers are shared with the render context.
+        if (m_has_result)
+        {
+            discard(m_result);
+            m_has_result = false;
+        }
+
+        // Replaces a queued job, and makes one in progress stop at its
+        // next chunk and drop its result.
+        m_job = Job();
+        m_job.cancelled = true;
+        m_job_pending = true;
+        m_pending = false;
+    }
+
+    m_condition.notify_one();
+}
+
+bool
+AsyncUploader::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+bool
+AsyncUploader::poll(Result& result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_has_result)
+    {
+        return false;
+    }
+
+    GLenum status = glClientWaitSync(m_result.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+
+    glDeleteSync(m_result.fence);
+    m_result.fence = nullptr;
+
+    result = std::move(m_result);
+    m_result = Result();
+    m_has_result = false;
+    m_pending = m_job_pending;
+
+    return true;
+}
+
+void
+AsyncUploader::run()
+{
+    m_make_current(true);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_condition.wait(lock, [this] { return m_job_pending.load(); });
+
+        if (m_stop)
+        {
+            break;
+        }
+
+        Job job = m_job;
+        m_job_pending = false;
+
+        if (job.cancelled)
+        {
+            continue;
+        }
+
+        lock.unlock();
+
+        Result result;
+        bool complete = process(job, result);
+
+        lock.lock();
+
+        // Only the most recent upload is handed over.
+        if (complete && !m_job_pending)
+        {
+            if (m_has_result)
+            {
+                discard(m_result);
+            }
+
+            m_result = std::move(result);
+            m_has_result = true;
+        }
+        else
+        {
+            discard(result);
+        }
+    }
+
+    if (m_has_result)
+    {
+        discard(m_result);
+        m_has_result = false;
+    }
+
+    lock.unlock();
+
+    m_make_current(false);
+}
+
+bool
+AsyncUploader::process(Job const& job, Result& result)
+{
+    result.count = job.count;
+    result.packed = job.packed;
+
+    char const* data = reinterpret_cast<char const*>(job.surfels);
+    std::size_t size = sizeof(Surfel) * job.count;
+
+    if (job.packed)
+    {
+        result.packed_surfels.resize(job.count);
+        pack_surfels(job.surfels, job.count, result.packed_surfels.data());
+
+        result.clip_planes.resize(job.count);
+        result.clipped = pack_clip_planes(job.surfels, job.count,
+            result.clip_planes.data());
+
+        data = reinterpret_cast<char const*>(result.packed_surfels.data());
+        size = sizeof(PackedSurfel) * job.count;
+    }
+
+    glGenBuffers(1, &result.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+    for (std::size_t offset(0); offset < size; offset += chunk_size)
+    {
+        if (m_job_pending)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return false;
+        }
+
+        glBufferSubData(GL_ARRAY_BUFFER, offset,
+            std::min(chunk_size, size - offset), data + offset);
+    }
+
+    if (result.clipped)
+    {
+        glGenBuffers(1, &result.plane_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, result.plane_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * job.count,
+            result.clip_planes.data(), GL_DYNAMIC_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The flush makes the fence visible to the render context.
+    result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    return true;
+}
+
+void
+AsyncUploader::discard(Result& result)
+{
+    if (result.fence)
+    {
+        glDeleteSync(result.fence);
+    }
+
+    glDeleteBuffers(1, &result.vbo);
+    glDeleteBuffers(1, &result.plane_vbo);
+
+    result = Result();
+}
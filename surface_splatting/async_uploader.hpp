@@ -0,0 +1,103 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ASYNC_UPLOADER_HPP
+#define ASYNC_UPLOADER_HPP
+
+#include "surfel.hpp"
+#include "packed_surfel.hpp"
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Uploads surfels into new vertex buffers on a worker thread. The worker
+// owns an OpenGL context sharing objects with the render context, it is
+// made current and released through the callback passed on construction.
+// Completion is signalled by a fence the render thread polls, so the
+// render thread never blocks on an upload.
+class AsyncUploader
+{
+
+public:
+    struct Result
+    {
+        Result();
+
+        GLuint vbo, plane_vbo;
+        std::size_t count;
+        bool packed, clipped;
+
+        // CPU copies of the packed format, needed for later partial
+        // updates.
+        std::vector<PackedSurfel> packed_surfels;
+        std::vector<GLuint> clip_planes;
+
+        GLsync fence;
+    };
+
+    AsyncUploader(std::function<void (bool)> const& make_current);
+    ~AsyncUploader();
+
+    // Starts uploading n surfels, encoded as PackedSurfel if packed is set.
+    // An earlier upload that has not been handed over yet is abandoned. The
+    // surfels must stay unchanged while pending() is true.
+    void upload(Surfel const* surfels, std::size_t n, bool packed);
+
+    // Abandons the upload in progress and deletes a finished one that has
+    // not been handed over, poll() returns nothing until the next upload.
+    void cancel();
+
+    bool pending() const;
+
+    // Hands over the buffers of the last upload once the GPU has finished
+    // it. The caller owns them afterwards.
+    bool poll(Result& result);
+
+private:
+    struct Job
+    {
+        Surfel const* surfels;
+        std::size_t count;
+        bool packed, cancelled;
+    };
+
+    void run();
+    bool process(Job const& job, Result& result);
+    void discard(Result& result);
+
+private:
+    std::function<void (bool)> m_make_current;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    Job m_job;
+    std::atomic<bool> m_job_pending;
+    bool m_pending, m_has_result, m_stop;
+    Result m_result;
+
+    std::thread m_thread;
+};
+
+#endif // ASYNC_UPLOADER_HPP
@@ -0,0 +1,354 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "circumellipse.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+    #define CIRCUMELLIPSE_X86
+    #include <immintrin.h>
+#endif
+
+#if defined(CIRCUMELLIPSE_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define CIRCUMELLIPSE_AVX2
+    #define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace Eigen;
+
+namespace
+{
+
+// Kernels read and write structure-of-arrays blocks of width lanes. The
+// input holds v0, v1 and v2, the output c, u and v, each as x, y and z
+// rows of width floats.
+const unsigned int num_rows = 9;
+
+typedef void (*Kernel)(float const* in, float* out);
+
+void
+circumellipse_scalar(float const* in, float* out)
+{
+    Vector3f v0(in[0], in[1], in[2]);
+    Vector3f v1(in[3], in[4], in[5]);
+    Vector3f v2(in[6], in[7], in[8]);
+
+    // Orthonormal basis d0, d1 of the triangle plane, e1 = (l, 0) and
+    // e2 = (s, h) in it.
+    Vector3f e1 = v1 - v0, e2 = v2 - v0;
+    float l = e1.norm();
+    Vector3f d0 = (1.0f / std::max(l, 1e-30f)) * e1;
+
+    float s = d0.dot(e2);
+    Vector3f w = e2 - s * d0;
+    float h = w.norm();
+    Vector3f d1 = (1.0f / std::max(h, 1e-30f)) * w;
+
+    // Sum of the outer products relative to the centroid.
+    float sx = l + s;
+    float a = l * l + s * s - sx * sx / 3.0f;
+    float b = s * h - sx * h / 3.0f;
+    float c = 2.0f / 3.0f * h * h;
+
+    // Eigen decomposition of [a b; b c].
+    float m = 0.5f * (a + c), d = 0.5f * (a - c);
+    float r = std::sqrt(d * d + b * b);
+
+    float ex = d >= 0.0f ? d + r : b;
+    float ey = d >= 0.0f ? b : r - d;
+    float n2 = ex * ex + ey * ey;
+    if (n2 == 0.0f)
+    {
+        ex = 1.0f;
+        n2 = 1.0f;
+    }
+
+    float en = 1.0f / std::sqrt(n2);
+    ex *= en;
+    ey *= en;
+
+    float lu = std::sqrt((m + r) / 1.5f);
+    float lv = std::sqrt(std::max(m - r, 0.0f) / 1.5f);
+
+    Vector3f center = (1.0f / 3.0f) * (v0 + v1 + v2);
+    Vector3f u = lu * (ex * d0 + ey * d1);
+    Vector3f v = lv * (ex * d1 - ey * d0);
+
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        out[k] = center(k);
+        out[3 + k] = u(k);
+        out[6 + k] = v(k);
+    }
+}
+
+#ifdef CIRCUMELLIPSE_X86
+void
+circumellipse_sse2(float const* in, float* out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+    const __m128 tiny = _mm_set1_ps(1e-30f);
+
+    __m128 v[9];
+    for (unsigned int k(0); k < num_rows; ++k)
+    {
+        v[k] = _mm_load_ps(in + 4 * k);
+    }
+
+    __m128 e1[3], e2[3], d0[3], d1[3], w[3];
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        e1[k] = _mm_sub_ps(v[3 + k], v[k]);
+        e2[k] = _mm_sub_ps(v[6 + k], v[k]);
+    }
+
+    __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], e1[0]),
+        _mm_mul_ps(e1[1], e1[1])), _mm_mul_ps(e1[2], e1[2])));
+    __m128 il = _mm_div_ps(one, _mm_max_ps(l, tiny));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        d0[k] = _mm_mul_ps(e1[k], il);
+    }
+
+    __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0[0], e2[0]),
+        _mm_mul_ps(d0[1], e2[1])), _mm_mul_ps(d0[2], e2[2]));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        w[k] = _mm_sub_ps(e2[k], _mm_mul_ps(s, d0[k]));
+    }
+
+    __m128 h = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], w[0]),
+        _mm_mul_ps(w[1], w[1])), _mm_mul_ps(w[2], w[2])));
+    __m128 ih = _mm_div_ps(one, _mm_max_ps(h, tiny));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        d1[k] = _mm_mul_ps(w[k], ih);
+    }
+
+    __m128 sx = _mm_add_ps(l, s);
+    __m128 a = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(l, l), _mm_mul_ps(s, s)),
+        _mm_mul_ps(_mm_mul_ps(sx, sx), third));
+    __m128 b = _mm_sub_ps(_mm_mul_ps(s, h),
+        _mm_mul_ps(_mm_mul_ps(sx, h), third));
+    __m128 c = _mm_mul_ps(_mm_set1_ps(2.0f / 3.0f), _mm_mul_ps(h, h));
+
+    __m128 m = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(a, c));
+    __m128 d = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(a, c));
+    __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d, d), _mm_mul_ps(b, b)));
+
+    __m128 positive = _mm_cmpge_ps(d, zero);
+    __m128 ex = _mm_or_ps(_mm_and_ps(positive, _mm_add_ps(d, r)),
+        _mm_andnot_ps(positive, b));
+    __m128 ey = _mm_or_ps(_mm_and_ps(positive, b),
+        _mm_andnot_ps(positive, _mm_sub_ps(r, d)));
+
+    __m128 n2 = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+    __m128 circle = _mm_and_ps(_mm_cmpeq_ps(n2, zero), one);
+    ex = _mm_add_ps(ex, circle);
+    n2 = _mm_add_ps(n2, circle);
+
+    __m128 en = _mm_div_ps(one, _mm_sqrt_ps(n2));
+    ex = _mm_mul_ps(ex, en);
+    ey = _mm_mul_ps(ey, en);
+
+    __m128 lu = _mm_sqrt_ps(_mm_mul_ps(_mm_add_ps(m, r),
+        _mm_set1_ps(1.0f / 1.5f)));
+    __m128 lv = _mm_sqrt_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(m, r), zero),
+        _mm_set1_ps(1.0f / 1.5f)));
+
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        _mm_store_ps(out + 4 * k, _mm_mul_ps(third,
+            _mm_add_ps(_mm_add_ps(v[k], v[3 + k]), v[6 + k])));
+        _mm_store_ps(out + 4 * (3 + k), _mm_mul_ps(lu,
+            _mm_add_ps(_mm_mul_ps(ex, d0[k]), _mm_mul_ps(ey, d1[k]))));
+        _mm_store_ps(out + 4 * (6 + k), _mm_mul_ps(lv,
+            _mm_sub_ps(_mm_mul_ps(ex, d1[k]), _mm_mul_ps(ey, d0[k]))));
+    }
+}
+#endif
+
+#ifdef CIRCUMELLIPSE_AVX2
+TARGET_AVX2 void
+circumellipse_avx2(float const* in, float* out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+    const __m256 tiny = _mm256_set1_ps(1e-30f);
+
+    __m256 v[9];
+    for (unsigned int k(0); k < num_rows; ++k)
+    {
+        v[k] = _mm256_load_ps(in + 8 * k);
+    }
+
+    __m256 e1[3], e2[3], d0[3], d1[3], w[3];
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        e1[k] = _mm256_sub_ps(v[3 + k], v[k]);
+        e2[k] = _mm256_sub_ps(v[6 + k], v[k]);
+    }
+
+    __m256 l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(e1[0], e1[0]), _mm256_mul_ps(e1[1], e1[1])),
+        _mm256_mul_ps(e1[2], e1[2])));
+    __m256 il = _mm256_div_ps(one, _mm256_max_ps(l, tiny));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        d0[k] = _mm256_mul_ps(e1[k], il);
+    }
+
+    __m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0[0], e2[0]),
+        _mm256_mul_ps(d0[1], e2[1])), _mm256_mul_ps(d0[2], e2[2]));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        w[k] = _mm256_sub_ps(e2[k], _mm256_mul_ps(s, d0[k]));
+    }
+
+    __m256 h = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(w[0], w[0]), _mm256_mul_ps(w[1], w[1])),
+        _mm256_mul_ps(w[2], w[2])));
+    __m256 ih = _mm256_div_ps(one, _mm256_max_ps(h, tiny));
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        d1[k] = _mm256_mul_ps(w[k], ih);
+    }
+
+    __m256 sx = _mm256_add_ps(l, s);
+    __m256 a = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(l, l),
+        _mm256_mul_ps(s, s)), _mm256_mul_ps(_mm256_mul_ps(sx, sx), third));
+    __m256 b = _mm256_sub_ps(_mm256_mul_ps(s, h),
+        _mm256_mul_ps(_mm256_mul_ps(sx, h), third));
+    __m256 c = _mm256_mul_ps(_mm256_set1_ps(2.0f / 3.0f),
+        _mm256_mul_ps(h, h));
+
+    __m256 m = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_add_ps(a, c));
+    __m256 d = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(a, c));
+    __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(d, d),
+        _mm256_mul_ps(b, b)));
+
+    __m256 positive = _mm256_cmp_ps(d, zero, _CMP_GE_OQ);
+    __m256 ex = _mm256_blendv_ps(b, _mm256_add_ps(d, r), positive);
+    __m256 ey = _mm256_blendv_ps(_mm256_sub_ps(r, d), b, positive);
+
+    __m256 n2 = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+    __m256 circle = _mm256_and_ps(_mm256_cmp_ps(n2, zero, _CMP_EQ_OQ), one);
+    ex = _mm256_add_ps(ex, circle);
+    n2 = _mm256_add_ps(n2, circle);
+
+    __m256 en = _mm256_div_ps(one, _mm256_sqrt_ps(n2));
+    ex = _mm256_mul_ps(ex, en);
+    ey = _mm256_mul_ps(ey, en);
+
+    __m256 lu = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_add_ps(m, r),
+        _mm256_set1_ps(1.0f / 1.5f)));
+    __m256 lv = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_max_ps(
+        _mm256_sub_ps(m, r), zero), _mm256_set1_ps(1.0f / 1.5f)));
+
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        _mm256_store_ps(out + 8 * k, _mm256_mul_ps(third, _mm256_add_ps(
+            _mm256_add_ps(v[k], v[3 + k]), v[6 + k])));
+        _mm256_store_ps(out + 8 * (3 + k), _mm256_mul_ps(lu, _mm256_add_ps(
+            _mm256_mul_ps(ex, d0[k]), _mm256_mul_ps(ey, d1[k]))));
+        _mm256_store_ps(out + 8 * (6 + k), _mm256_mul_ps(lv, _mm256_sub_ps(
+            _mm256_mul_ps(ex, d1[k]), _mm256_mul_ps(ey, d0[k]))));
+    }
+}
+#endif
+
+// Gathers width triangles into a block, runs the kernel and scatters the
+// result. The last block is padded by repeating its last triangle.
+void
+circumellipse_range(Vector3f const* vertices, unsigned int const* faces,
+    std::size_t begin, std::size_t end, Surfel* surfels, Kernel kernel,
+    unsigned int width)
+{
+    // Large enough for the widest kernel, aligned for its loads.
+    alignas(32) float in[num_rows * 8];
+    alignas(32) float out[num_rows * 8];
+
+    for (std::size_t first(begin); first < end; first += width)
+    {
+        for (unsigned int lane(0); lane < width; ++lane)
+        {
+            std::size_t i = std::min(first + lane, end - 1);
+
+            for (unsigned int j(0); j < 3; ++j)
+            {
+                Vector3f const& p = vertices[faces[3 * i + j]];
+
+                in[(3 * j + 0) * width + lane] = p.x();
+                in[(3 * j + 1) * width + lane] = p.y();
+                in[(3 * j + 2) * width + lane] = p.z();
+            }
+        }
+
+        kernel(in, out);
+
+        for (unsigned int lane(0); lane < width && first + lane < end;
+            ++lane)
+        {
+            Surfel& surfel = surfels[first + lane];
+
+            for (unsigned int k(0); k < 3; ++k)
+            {
+                surfel.c(k) = out[k * width + lane];
+                surfel.u(k) = out[(3 + k) * width + lane];
+                surfel.v(k) = out[(6 + k) * width + lane];
+            }
+
+            surfel.p = Vector3f::Zero();
+            surfel.rgba = 0xffffffff;
+        }
+    }
+}
+
+}
+
+void
+steiner_circumellipses(Vector3f const* vertices, unsigned int const* faces,
+    std::size_t num_faces, Surfel* surfels)
+{
+    Kernel kernel = circumellipse_scalar;
+    unsigned int width = 1;
+
+#ifdef CIRCUMELLIPSE_X86
+    kernel = circumellipse_sse2;
+    width = 4;
+#endif
+
+#ifdef CIRCUMELLIPSE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = circumellipse_avx2;
+        width = 8;
+    }
+#endif
+
+    parallel_for(0, num_faces, [&](std::size_t begin, std::size_t end)
+    {
+        circumellipse_range(vertices, faces, begin, end, surfels, kernel,
+            width);
+    });
+}
@@ -0,0 +1,40 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CIRCUMELLIPSE_HPP
+#define CIRCUMELLIPSE_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+#include <cstddef>
+
+// Computes the Steiner circumellipse of every triangle as a surfel. faces
+// holds three vertex indices per triangle. u is the major and v the minor
+// axis, u x v points along the triangle normal (v1 - v0) x (v2 - v0). The
+// clipping plane is zero and the color white.
+//
+// The ellipse has the closed form x^T Q x = 1 with Q = 3/2 M^-1, where M
+// is the sum of the outer products of the vertices relative to the
+// centroid in the triangle plane, so its axes are the eigenvectors of the
+// symmetric 2x2 matrix M. Triangles are processed 8 (AVX2) or 4 (SSE2) at
+// a time, the instruction set is chosen at run time, and the faces are
+// split across all cores.
+void steiner_circumellipses(Eigen::Vector3f const* vertices,
+    unsigned int const* faces, std::size_t num_faces, Surfel* surfels);
+
+#endif // CIRCUMELLIPSE_HPP
@@ -0,0 +1,157 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "depth_pyramid.hpp"
+
+#include <algorithm>
+
+using namespace Eigen;
+
+DepthPyramid::DepthPyramid()
+    : m_shift(0), m_viewport_width(0), m_viewport_height(0),
+      m_clip(Matrix4f::Identity())
+{
+}
+
+void
+DepthPyramid::assign(float const* depth, std::size_t width,
+    std::size_t height, unsigned int shift, int viewport_width,
+    int viewport_height, Matrix4f const& clip)
+{
+    m_levels.resize(1);
+    m_levels[0].width = width;
+    m_levels[0].height = height;
+    m_levels[0].depth.assign(depth, depth + width * height);
+
+    m_shift = shift;
+    m_viewport_width = viewport_width;
+    m_viewport_height = viewport_height;
+    m_clip = clip;
+
+    while (m_levels.back().width > 1 || m_levels.back().height > 1)
+    {
+        Level const& fine = m_levels.back();
+
+        Level coarse;
+        coarse.width = std::max<std::size_t>(1, fine.width / 2);
+        coarse.height = std::max<std::size_t>(1, fine.height / 2);
+        coarse.depth.assign(coarse.width * coarse.height, 0.0f);
+
+        for (std::size_t y(0); y < fine.height; ++y)
+        {
+            std::size_t cy = std::min(y / 2, coarse.height - 1);
+
+            for (std::size_t x(0); x < fine.width; ++x)
+            {
+                std::size_t cx = std::min(x / 2, coarse.width - 1);
+                float& d = coarse.depth[cy * coarse.width + cx];
+
+                d = std::max(d, fine.depth[y * fine.width + x]);
+            }
+        }
+
+        m_levels.push_back(coarse);
+    }
+}
+
+void
+DepthPyramid::clear()
+{
+    m_levels.clear();
+}
+
+bool
+DepthPyramid::empty() const
+{
+    return m_levels.empty();
+}
+
+bool
+DepthPyramid::occluded(Vector3f const& min, Vector3f const& max) const
+{
+    if (m_levels.empty())
+    {
+        return false;
+    }
+
+    Vector2f lo = Vector2f::Constant(1.0f), hi = Vector2f::Constant(-1.0f);
+    float nearest = 1.0f;
+
+    for (unsigned int i(0); i < 8; ++i)
+    {
+        Vector4f corner(i & 1 ? max.x() : min.x(), i & 2 ? max.y() : min.y(),
+            i & 4 ? max.z() : min.z(), 1.0f);
+        Vector4f p = m_clip * corner;
+
+        if (p.w() <= 0.0f || p.z() < -p.w())
+        {
+            return false;
+        }
+
+        Vector2f ndc = p.head<2>() / p.w();
+        lo = lo.cwiseMin(ndc);
+        hi = hi.cwiseMax(ndc);
+        nearest = std::min(nearest, 0.5f * p.z() / p.w() + 0.5f);
+    }
+
+    if (lo.x() < -1.0f || lo.y() < -1.0f || hi.x() > 1.0f || hi.y() > 1.0f)
+    {
+        return false;
+    }
+
+    // Pixels covered in the viewport, then texels of the base level.
+    int x0 = static_cast<int>((0.5f * lo.x() + 0.5f) * m_viewport_width);
+    int y0 = static_cast<int>((0.5f * lo.y() + 0.5f) * m_viewport_height);
+    int x1 = static_cast<int>((0.5f * hi.x() + 0.5f) * m_viewport_width);
+    int y1 = static_cast<int>((0.5f * hi.y() + 0.5f) * m_viewport_height);
+
+    Level const& base = m_levels.front();
+    std::size_t tx0 = std::min<std::size_t>(std::max(x0, 0) >> m_shift,
+        base.width - 1);
+    std::size_t ty0 = std::min<std::size_t>(std::max(y0, 0) >> m_shift,
+        base.height - 1);
+    std::size_t tx1 = std::min<std::size_t>(std::max(x1, 0) >> m_shift,
+        base.width - 1);
+    std::size_t ty1 = std::min<std::size_t>(std::max(y1, 0) >> m_shift,
+        base.height - 1);
+
+    std::size_t level(0);
+    while (level + 1 < m_levels.size()
+        && ((tx1 >> level) - (tx0 >> level) > 1
+        || (ty1 >> level) - (ty0 >> level) > 1))
+    {
+        ++level;
+    }
+
+    Level const& l = m_levels[level];
+    std::size_t lx0 = std::min(tx0 >> level, l.width - 1);
+    std::size_t ly0 = std::min(ty0 >> level, l.height - 1);
+    std::size_t lx1 = std::min(tx1 >> level, l.width - 1);
+    std::size_t ly1 = std::min(ty1 >> level, l.height - 1);
+
+    for (std::size_t y(ly0); y <= ly1; ++y)
+    {
+        for (std::size_t x(lx0); x <= lx1; ++x)
+        {
+            if (nearest <= l.depth[y * l.width + x])
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,68 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef DEPTH_PYRAMID_HPP
+#define DEPTH_PYRAMID_HPP
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+// Hierarchical depth buffer on the CPU. Every level holds the farthest
+// window depth of 2 x 2 texels of the level below, the last row and column
+// of an odd sized level fold into their neighbors. A box is tested against
+// the texels of the coarsest level that bounds its projection with at
+// most 2 x 2 of them.
+class DepthPyramid
+{
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    DepthPyramid();
+
+    // Takes the depths of a viewport of viewport_width x viewport_height
+    // pixels rendered with clip, the projection times the modelview
+    // matrix, after shift levels of reduction down to width x height
+    // texels, and builds the coarser levels.
+    void assign(float const* depth, std::size_t width, std::size_t height,
+        unsigned int shift, int viewport_width, int viewport_height,
+        Eigen::Matrix4f const& clip);
+    void clear();
+
+    bool empty() const;
+
+    // True if the box lies behind the depths everywhere it projects to.
+    // Boxes reaching behind the near plane or out of the viewport are never
+    // occluded, there is no depth to test them against.
+    bool occluded(Eigen::Vector3f const& min,
+        Eigen::Vector3f const& max) const;
+
+private:
+    struct Level
+    {
+        std::size_t width, height;
+        std::vector<float> depth;
+    };
+
+    std::vector<Level> m_levels;
+    unsigned int m_shift;
+    int m_viewport_width, m_viewport_height;
+    Eigen::Matrix4f m_clip;
+};
+
+#endif // DEPTH_PYRAMID_HPP
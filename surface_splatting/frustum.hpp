@@ -0,0 +1,82 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <Eigen/Core>
+
+enum FrustumOverlap
+{
+    FrustumOutside,
+    FrustumCrossing,
+    FrustumInside
+};
+
+// Planes of the frustum from the rows of the clip matrix, see Gribb and
+// Hartmann, Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix. Positive inside.
+inline void
+frustum_planes(Eigen::Matrix4f const& clip, Eigen::Vector4f* planes)
+{
+    for (unsigned int i(0); i < 6; ++i)
+    {
+        planes[i] = (clip.row(3) + (-1.0f + 2.0f * static_cast<float>(
+            i % 2)) * clip.row(i / 2)).transpose();
+    }
+}
+
+// Tests the corners of the box nearest and farthest along each plane
+// normal.
+inline FrustumOverlap
+box_frustum_overlap(Eigen::Vector4f const* planes, float const* min,
+    float const* max)
+{
+    FrustumOverlap overlap = FrustumInside;
+
+    for (unsigned int i(0); i < 6; ++i)
+    {
+        Eigen::Vector4f const& plane = planes[i];
+        float outer = plane(3), inner = plane(3);
+
+        for (unsigned int k(0); k < 3; ++k)
+        {
+            outer += plane(k) * (plane(k) >= 0.0f ? max[k] : min[k]);
+            inner += plane(k) * (plane(k) >= 0.0f ? min[k] : max[k]);
+        }
+
+        if (outer < 0.0f)
+        {
+            return FrustumOutside;
+        }
+
+        if (inner < 0.0f)
+        {
+            overlap = FrustumCrossing;
+        }
+    }
+
+    return overlap;
+}
+
+inline bool
+box_in_frustum(Eigen::Vector4f const* planes, float const* min,
+    float const* max)
+{
+    return box_frustum_overlap(planes, min, max) != FrustumOutside;
+}
+
+#endif // FRUSTUM_HPP
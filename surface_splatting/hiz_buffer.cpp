@@ -0,0 +1,232 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "hiz_buffer.hpp"
+
+#include <algorithm>
+
+using namespace Eigen;
+
+HiZBuffer::HiZBuffer(GLsizei readback_size)
+    : m_readback_size(std::max<GLsizei>(1, readback_size)),
+      m_first_level(true), m_next_level(false),
+      m_texture(0), m_fbo(0), m_vao(0), m_pbo(0),
+      m_width(0), m_height(0), m_num_levels(0),
+      m_fence(nullptr), m_pending_width(0), m_pending_height(0),
+      m_pending_clip(Matrix4f::Identity())
+{
+    std::fill(m_pending_viewport, m_pending_viewport + 4, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_pbo);
+}
+
+HiZBuffer::~HiZBuffer()
+{
+    clear();
+
+    glDeleteTextures(1, &m_texture);
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_pbo);
+}
+
+void
+HiZBuffer::update(GLuint depth_texture, bool multisample,
+    GLint const* viewport, Matrix4f const& clip)
+{
+    if (m_fence || viewport[2] <= 0 || viewport[3] <= 0)
+    {
+        return;
+    }
+
+    reserve(viewport[2], viewport[3]);
+
+    GLint framebuffer, saved_viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, saved_viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glBindVertexArray(m_vao);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The first level reads the viewport from the depth attachment.
+    GLenum target = multisample ? GL_TEXTURE_2D_MULTISAMPLE
+        : GL_TEXTURE_2D;
+
+    m_first_level.set_multisampling(multisample);
+    m_first_level.use();
+    m_first_level.set_uniform_1i("source", 0);
+    m_first_level.set_source(0, viewport, viewport + 2);
+
+    glBindTexture(target, depth_texture);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, m_texture, 0);
+    glViewport(0, 0, m_width, m_height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindTexture(target, 0);
+
+    // Every further level reads the one before, which is the only level
+    // the texture exposes meanwhile. texelFetch counts levels from the
+    // base level, so the source is level 0 of that view.
+    m_next_level.use();
+    m_next_level.set_uniform_1i("source", 0);
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+
+    GLint offset[2] = { 0, 0 };
+    GLint size[2] = { m_width, m_height };
+
+    for (GLint level(1); level < m_num_levels; ++level)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        m_next_level.set_source(0, offset, size);
+
+        size[0] = std::max(1, size[0] / 2);
+        size[1] = std::max(1, size[1] / 2);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, m_texture, level);
+        glViewport(0, 0, size[0], size[1]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_num_levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_next_level.unuse();
+
+    // The coarsest level goes back through the pixel buffer.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glReadPixels(0, 0, size[0], size[1], GL_RED, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_pending_width = size[0];
+    m_pending_height = size[1];
+    std::copy(viewport, viewport + 4, m_pending_viewport);
+    m_pending_clip = clip;
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(saved_viewport[0], saved_viewport[1], saved_viewport[2],
+        saved_viewport[3]);
+}
+
+bool
+HiZBuffer::fetch()
+{
+    if (!m_fence)
+    {
+        return false;
+    }
+
+    GLenum status = glClientWaitSync(m_fence, 0, 0);
+
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+
+    GLsizeiptr size = static_cast<GLsizeiptr>(m_pending_width)
+        * m_pending_height * sizeof(float);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    float const* depth = static_cast<float const*>(glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+
+    if (depth)
+    {
+        m_pyramid.assign(depth, m_pending_width, m_pending_height,
+            static_cast<unsigned int>(m_num_levels), m_pending_viewport[2],
+            m_pending_viewport[3], m_pending_clip);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return depth != nullptr;
+}
+
+void
+HiZBuffer::clear()
+{
+    if (m_fence)
+    {
+        glDeleteSync(m_fence);
+        m_fence = nullptr;
+    }
+
+    m_pyramid.clear();
+}
+
+DepthPyramid const&
+HiZBuffer::pyramid() const
+{
+    return m_pyramid;
+}
+
+void
+HiZBuffer::reserve(GLsizei width, GLsizei height)
+{
+    GLsizei level_width = std::max<GLsizei>(1, width / 2);
+    GLsizei level_height = std::max<GLsizei>(1, height / 2);
+
+    if (m_texture && level_width == m_width && level_height == m_height)
+    {
+        return;
+    }
+
+    m_width = level_width;
+    m_height = level_height;
+
+    glDeleteTextures(1, &m_texture);
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    // Halves the level until it fits into the readback size.
+    m_num_levels = 0;
+
+    for (;;)
+    {
+        glTexImage2D(GL_TEXTURE_2D, m_num_levels++, GL_R32F, level_width,
+            level_height, 0, GL_RED, GL_FLOAT, nullptr);
+
+        if (level_width <= m_readback_size && level_height <= m_readback_size)
+        {
+            break;
+        }
+
+        level_width = std::max<GLsizei>(1, level_width / 2);
+        level_height = std::max<GLsizei>(1, level_height / 2);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_num_levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(level_width)
+        * level_height * sizeof(float), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
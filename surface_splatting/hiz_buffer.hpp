@@ -0,0 +1,76 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef HIZ_BUFFER_HPP
+#define HIZ_BUFFER_HPP
+
+#include "depth_pyramid.hpp"
+#include "program_hiz.hpp"
+
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+// Hierarchical depth buffer of the last frame for occlusion culling on the
+// CPU. The finest levels are reduced on the GPU until they fit into
+// readback_size x readback_size texels, which are read back
+// asynchronously through a pixel buffer and turned into a DepthPyramid
+// once the GPU is done with them, usually one frame later.
+class HiZBuffer
+{
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit HiZBuffer(GLsizei readback_size = 256);
+    ~HiZBuffer();
+
+    // Reduces the depth texture of a frame rendered with clip, the
+    // projection times the modelview matrix, into the given viewport.
+    // Skipped while the previous reduction has not been fetched.
+    void update(GLuint depth_texture, bool multisample,
+        GLint const* viewport, Eigen::Matrix4f const& clip);
+
+    // Takes over the last reduction if it has arrived and returns whether
+    // it did.
+    bool fetch();
+
+    void clear();
+
+    DepthPyramid const& pyramid() const;
+
+private:
+    void reserve(GLsizei width, GLsizei height);
+
+private:
+    GLsizei m_readback_size;
+
+    ProgramHiZ m_first_level, m_next_level;
+
+    GLuint m_texture, m_fbo, m_vao, m_pbo;
+    GLsizei m_width, m_height;
+    GLint m_num_levels;
+
+    // Reduction on its way back from the GPU.
+    GLsync m_fence;
+    GLsizei m_pending_width, m_pending_height;
+    GLint m_pending_viewport[4];
+    Eigen::Matrix4f m_pending_clip;
+
+    DepthPyramid m_pyramid;
+};
+
+#endif // HIZ_BUFFER_HPP
@@ -0,0 +1,224 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "kd_tree.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <utility>
+
+using namespace Eigen;
+
+KdTree::KdTree()
+    : m_depth(0)
+{
+}
+
+KdTree::KdTree(std::vector<Vector3f> const& points, unsigned int leaf_size)
+    : m_depth(0)
+{
+    build(points.data(), points.size(), leaf_size);
+}
+
+void
+KdTree::build(Vector3f const* points, std::size_t n, unsigned int leaf_size)
+{
+    m_index.resize(n);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        m_index[i] = static_cast<unsigned int>(i);
+    }
+
+    m_points.assign(points, points + n);
+
+    // Splits until no leaf holds more than leaf_size points.
+    m_depth = 0;
+    while ((n >> m_depth) > std::max(leaf_size, 1u))
+    {
+        ++m_depth;
+    }
+
+    m_nodes.resize((std::size_t(1) << m_depth) - 1);
+
+    unsigned int parallel_depth(0);
+    while ((1u << parallel_depth) < num_worker_threads())
+    {
+        ++parallel_depth;
+    }
+
+    build_node(0, 0, n, 0, parallel_depth);
+
+    // Moves the points into tree order.
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            m_points[i] = points[m_index[i]];
+        }
+    });
+}
+
+std::size_t
+KdTree::size() const
+{
+    return m_points.size();
+}
+
+void
+KdTree::build_node(std::size_t node, std::size_t begin, std::size_t end,
+    unsigned int depth, unsigned int parallel_depth)
+{
+    if (depth == m_depth)
+    {
+        return;
+    }
+
+    Vector3f lo = Vector3f::Constant(std::numeric_limits<float>::max());
+    Vector3f hi = -lo;
+
+    for (std::size_t i(begin); i < end; ++i)
+    {
+        lo = lo.cwiseMin(m_points[m_index[i]]);
+        hi = hi.cwiseMax(m_points[m_index[i]]);
+    }
+
+    unsigned int axis;
+    (hi - lo).maxCoeff(&axis);
+
+    std::size_t mid = begin + (end - begin) / 2;
+    std::nth_element(m_index.begin() + begin, m_index.begin() + mid,
+        m_index.begin() + end, [&](unsigned int a, unsigned int b)
+    {
+        return m_points[a](axis) < m_points[b](axis);
+    });
+
+    m_nodes[node].split = m_points[m_index[mid]](axis);
+    m_nodes[node].axis = axis;
+
+    // The subtrees write to disjoint ranges of nodes and indices.
+    if (depth < parallel_depth)
+    {
+        std::thread left(&KdTree::build_node, this, 2 * node + 1, begin, mid,
+            depth + 1, parallel_depth);
+        build_node(2 * node + 2, mid, end, depth + 1, parallel_depth);
+        left.join();
+    }
+    else
+    {
+        build_node(2 * node + 1, begin, mid, depth + 1, parallel_depth);
+        build_node(2 * node + 2, mid, end, depth + 1, parallel_depth);
+    }
+}
+
+unsigned int
+KdTree::knn(Vector3f const& q, unsigned int k,
+    std::vector<unsigned int>& indices,
+    std::vector<float>& squared_distances) const
+{
+    typedef std::pair<float, unsigned int> Candidate;
+
+    // Max-heap of the best candidates so far, worst on top.
+    std::vector<Candidate> heap;
+    heap.reserve(k + 1);
+
+    struct Entry
+    {
+        std::size_t node, begin, end;
+        unsigned int depth;
+        float distance;
+    };
+
+    Entry stack[64];
+    unsigned int top(0);
+
+    if (k > 0 && !m_points.empty())
+    {
+        Entry root = { 0, 0, m_points.size(), 0, 0.0f };
+        stack[top++] = root;
+    }
+
+    while (top > 0)
+    {
+        Entry e = stack[--top];
+
+        if (heap.size() == k && e.distance >= heap.front().first)
+        {
+            continue;
+        }
+
+        if (e.depth == m_depth)
+        {
+            for (std::size_t i(e.begin); i < e.end; ++i)
+            {
+                float d = (m_points[i] - q).squaredNorm();
+
+                if (heap.size() < k)
+                {
+                    heap.push_back(Candidate(d, m_index[i]));
+                    std::push_heap(heap.begin(), heap.end());
+                }
+                else if (d < heap.front().first)
+                {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = Candidate(d, m_index[i]);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+
+            continue;
+        }
+
+        Node const& node = m_nodes[e.node];
+        std::size_t mid = e.begin + (e.end - e.begin) / 2;
+        float offset = q(node.axis) - node.split;
+
+        Entry left = { 2 * e.node + 1, e.begin, mid, e.depth + 1,
+            e.distance };
+        Entry right = { 2 * e.node + 2, mid, e.end, e.depth + 1,
+            e.distance };
+
+        // The far side is at least as far as the splitting plane. It is
+        // pushed first so that the near side is visited first.
+        if (offset < 0.0f)
+        {
+            right.distance = std::max(e.distance, offset * offset);
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+        else
+        {
+            left.distance = std::max(e.distance, offset * offset);
+            stack[top++] = left;
+            stack[top++] = right;
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end());
+
+    indices.resize(heap.size());
+    squared_distances.resize(heap.size());
+
+    for (std::size_t i(0); i < heap.size(); ++i)
+    {
+        squared_distances[i] = heap[i].first;
+        indices[i] = heap[i].second;
+    }
+
+    return static_cast<unsigned int>(heap.size());
+}
@@ -0,0 +1,70 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KD_TREE_HPP
+#define KD_TREE_HPP
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+// Balanced kd-tree over a point set for nearest neighbour queries. Every
+// node splits its range at the median of its widest axis, so the shape of
+// the tree only depends on the number of points and the nodes are stored
+// implicitly, the children of node i are 2 i + 1 and 2 i + 2. The points
+// are kept in tree order for cache friendly leaf scans. Building uses all
+// cores, queries are read-only and may run concurrently.
+class KdTree
+{
+
+public:
+    KdTree();
+    explicit KdTree(std::vector<Eigen::Vector3f> const& points,
+        unsigned int leaf_size = 16);
+
+    void build(Eigen::Vector3f const* points, std::size_t n,
+        unsigned int leaf_size = 16);
+
+    std::size_t size() const;
+
+    // Finds the k points closest to q, including q itself if it is part of
+    // the set, sorted by increasing distance. indices refer to the points
+    // passed to build(). Returns the number of neighbours found, which is
+    // less than k only for small point sets.
+    unsigned int knn(Eigen::Vector3f const& q, unsigned int k,
+        std::vector<unsigned int>& indices,
+        std::vector<float>& squared_distances) const;
+
+private:
+    void build_node(std::size_t node, std::size_t begin, std::size_t end,
+        unsigned int depth, unsigned int parallel_depth);
+
+private:
+    struct Node
+    {
+        float split;
+        unsigned int axis;
+    };
+
+    std::vector<Eigen::Vector3f> m_points;
+    std::vector<unsigned int> m_index;
+    std::vector<Node> m_nodes;
+    unsigned int m_depth;
+};
+
+#endif // KD_TREE_HPP
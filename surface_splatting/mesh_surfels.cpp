@@ -0,0 +1,185 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "mesh_surfels.hpp"
+#include "circumellipse.hpp"
+#include "parallel.hpp"
+
+#include <GLviz>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace
+{
+
+void
+vertex_surfel(std::vector<Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    unsigned int const* first, unsigned int const* last, unsigned int i,
+    Vector3f const& normal, Surfel& surfel)
+{
+    Vector3f const& c = vertices[i];
+
+    surfel.c = c;
+    surfel.u = Vector3f::Zero();
+    surfel.v = Vector3f::Zero();
+    surfel.p = Vector3f::Zero();
+    surfel.rgba = 0xffffffff;
+
+    if (first == last || normal.isZero())
+    {
+        return;
+    }
+
+    Vector3f t0 = normal.unitOrthogonal();
+    Vector3f t1 = normal.cross(t0);
+
+    // Second moments of the one-ring in the tangent plane. Interior edges
+    // are visited twice, which does not change the shape of the ellipse.
+    Matrix2f m = Matrix2f::Zero();
+    unsigned int n(0);
+
+    for (unsigned int const* f(first); f != last; ++f)
+    {
+        for (unsigned int j(0); j < 3; ++j)
+        {
+            if (faces[*f][j] != i)
+            {
+                Vector3f d = vertices[faces[*f][j]] - c;
+                Vector2f x(d.dot(t0), d.dot(t1));
+
+                m += x * x.transpose();
+                ++n;
+            }
+        }
+    }
+
+    m /= static_cast<float>(n);
+
+    float trace = m.trace();
+    if (!(trace > 0.0f))
+    {
+        return;
+    }
+
+    // Bounds the aspect ratio for slivers and collinear neighbours.
+    m += 1e-4f * trace * Matrix2f::Identity();
+
+    SelfAdjointEigenSolver<Matrix2f> eigen;
+    eigen.computeDirect(m);
+
+    Vector2f lambda = eigen.eigenvalues();
+    Matrix2f inverse = eigen.eigenvectors()
+        * lambda.cwiseInverse().asDiagonal()
+        * eigen.eigenvectors().transpose();
+
+    // Scales the ellipse until it reaches the farthest neighbour.
+    float k(0.0f);
+
+    for (unsigned int const* f(first); f != last; ++f)
+    {
+        for (unsigned int j(0); j < 3; ++j)
+        {
+            if (faces[*f][j] != i)
+            {
+                Vector3f d = vertices[faces[*f][j]] - c;
+                Vector2f x(d.dot(t0), d.dot(t1));
+
+                k = std::max(k, x.dot(inverse * x));
+            }
+        }
+    }
+
+    // The eigenvalues are in increasing order.
+    Vector2f major = eigen.eigenvectors().col(1);
+    Vector3f u = major.x() * t0 + major.y() * t1;
+
+    surfel.u = std::sqrt(k * lambda(1)) * u;
+    surfel.v = std::sqrt(k * lambda(0)) * normal.cross(u);
+}
+
+}
+
+void
+mesh_to_surfels(std::vector<Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    std::vector<Vector3f> const& normals, std::vector<Surfel>& surfels,
+    MeshSurfels mode, SurfelColorizer const& colorizer)
+{
+    if (mode == PerFaceSurfels)
+    {
+        surfels.resize(faces.size());
+
+        if (!faces.empty())
+        {
+            steiner_circumellipses(vertices.data(), faces.front().data(),
+                faces.size(), surfels.data());
+        }
+    }
+    else
+    {
+        GLviz::VertexFaceAdjacency adjacency;
+
+        std::vector<Vector3f> computed_normals;
+        if (normals.size() != vertices.size())
+        {
+            GLviz::set_vertex_normals_from_triangle_mesh_parallel(vertices,
+                faces, computed_normals, &adjacency);
+        }
+        else
+        {
+            GLviz::build_vertex_face_adjacency(vertices.size(), faces,
+                adjacency);
+        }
+
+        std::vector<Vector3f> const& n = computed_normals.empty() ? normals
+            : computed_normals;
+        std::vector<unsigned int> const& offsets = adjacency.offsets;
+        std::vector<unsigned int> const& face_list = adjacency.faces;
+
+        surfels.resize(vertices.size());
+
+        parallel_for(0, vertices.size(),
+            [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                vertex_surfel(vertices, faces,
+                    face_list.data() + offsets[i],
+                    face_list.data() + offsets[i + 1],
+                    static_cast<unsigned int>(i), n[i], surfels[i]);
+            }
+        });
+    }
+
+    if (colorizer)
+    {
+        parallel_for(0, surfels.size(),
+            [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                surfels[i].rgba = colorizer(surfels[i]);
+            }
+        });
+    }
+}
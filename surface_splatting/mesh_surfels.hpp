@@ -0,0 +1,56 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MESH_SURFELS_HPP
+#define MESH_SURFELS_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+enum MeshSurfels
+{
+    // One Steiner circumellipse per face, the ellipse runs through the
+    // three corners of its triangle.
+    PerFaceSurfels,
+
+    // One surfel per vertex in the plane of its normal. The ellipse is
+    // fitted to the one-ring neighbours and reaches the farthest of them,
+    // which gives about half as many splats as PerFaceSurfels.
+    PerVertexSurfels
+};
+
+// Returns the color of a finished surfel as 0xAABBGGRR. It is called from
+// several threads at once.
+typedef std::function<unsigned int(Surfel const&)> SurfelColorizer;
+
+// Converts a triangle mesh into surfels on all cores. In PerVertexSurfels
+// mode surfels[i] belongs to vertices[i], normals holds unit vertex normals
+// as computed by GLviz::set_vertex_normals_from_triangle_mesh and is
+// computed here if empty. Vertices without faces get zero axes. Without a
+// colorizer all surfels are white.
+void mesh_to_surfels(std::vector<Eigen::Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    std::vector<Eigen::Vector3f> const& normals, std::vector<Surfel>& surfels,
+    MeshSurfels mode = PerFaceSurfels,
+    SurfelColorizer const& colorizer = SurfelColorizer());
+
+#endif // MESH_SURFELS_HPP
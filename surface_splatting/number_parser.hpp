@@ -0,0 +1,283 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef NUMBER_PARSER_HPP
+#define NUMBER_PARSER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace number_parser_detail
+{
+
+inline bool
+digit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+// Reads the run of up to eight digits at p, which must have eight readable
+// bytes, into value and returns its length. Little endian: the first
+// character is the lowest byte.
+inline std::size_t
+read_eight_digits(char const* p, std::uint64_t& value)
+{
+    const std::uint64_t ones = 0x0101010101010101ull;
+
+    std::uint64_t x;
+    std::memcpy(&x, p, 8);
+
+    // High bit of every byte that is not a digit, the lowest one ends the
+    // run. Carries only spill into bytes after it.
+    std::uint64_t non_digits = ((x + 0x46 * ones) | ~(x + 0x50 * ones) | x)
+        & 0x80 * ones;
+    std::uint64_t first = non_digits & (~non_digits + 1);
+    std::size_t length = static_cast<std::size_t>(
+        ((((first >> 7) - 1) & ones) * ones) >> 56);
+
+    if (length == 0)
+    {
+        value = 0;
+        return 0;
+    }
+
+    // Moves the run to the top so that the bytes below read as leading
+    // zeros, then combines pairs, quads and octets of digits.
+    x = (x - 0x30 * ones) << (8 * (8 - length));
+    x = (x * 10 + (x >> 8)) & 0x00ff00ff00ff00ffull;
+    x = ((x * 6553601) >> 16) & 0x0000ffff0000ffffull;
+    value = (x * 42949672960001ull) >> 32;
+
+    return length;
+}
+
+// Appends the digits at p to mantissa and returns the position after them.
+inline char const*
+parse_digits(char const* p, char const* end, std::uint64_t& mantissa)
+{
+    static const std::uint64_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+    while (end - p >= 8)
+    {
+        std::uint64_t value;
+        std::size_t length = read_eight_digits(p, value);
+
+        mantissa = mantissa * powers[length] + value;
+        p += length;
+
+        if (length < 8)
+        {
+            return p;
+        }
+    }
+
+    for (; p != end && digit(*p); ++p)
+    {
+        mantissa = 10 * mantissa + (*p - '0');
+    }
+
+    return p;
+}
+
+// Scales mantissa * 10^exponent and applies the sign.
+inline double
+scale(std::uint64_t mantissa, int exponent, bool negative)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    double value = static_cast<double>(mantissa);
+
+    if (exponent >= 0 && exponent <= 22)
+    {
+        value *= powers[exponent];
+    }
+    else if (exponent < 0 && exponent >= -22)
+    {
+        value /= powers[-exponent];
+    }
+    else if (mantissa != 0)
+    {
+        value *= std::pow(10.0, exponent);
+    }
+
+    return negative ? -value : value;
+}
+
+// Parses the exponent part, if any, and adds it to exponent.
+inline char const*
+parse_exponent(char const* p, char const* end, int& exponent)
+{
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+
+        bool negative_exponent(false);
+        if (p != end && (*p == '-' || *p == '+'))
+        {
+            negative_exponent = *p == '-';
+            ++p;
+        }
+
+        int e(0);
+        for (; p != end && digit(*p); ++p)
+        {
+            e = std::min(10 * e + (*p - '0'), 100000);
+        }
+
+        exponent += negative_exponent ? -e : e;
+    }
+
+    return p;
+}
+
+// Handles numbers with more than 19 significant digits and rare spellings
+// like inf and nan. p points past any sign.
+inline char const*
+parse_number_slow(char const* start, char const* p, char const* end,
+    bool negative, double& value)
+{
+    std::uint64_t mantissa(0);
+    int exponent(0), digits(0);
+    bool any(false);
+
+    for (; p != end && digit(*p); ++p)
+    {
+        if (digits < 19)
+        {
+            mantissa = 10 * mantissa + (*p - '0');
+            digits += mantissa > 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+
+        any = true;
+    }
+
+    if (p != end && *p == '.')
+    {
+        for (++p; p != end && digit(*p); ++p)
+        {
+            if (digits < 19)
+            {
+                mantissa = 10 * mantissa + (*p - '0');
+                digits += mantissa > 0;
+                --exponent;
+            }
+
+            any = true;
+        }
+    }
+
+    if (!any)
+    {
+        char token[64];
+        std::size_t n(0);
+
+        for (p = start; p != end && n + 1 < sizeof(token) && *p != ' '
+            && *p != '\t' && *p != '\r' && *p != '\n' && *p != ','
+            && *p != ';'; ++p)
+        {
+            token[n++] = *p;
+        }
+        token[n] = 0;
+
+        char* token_end;
+        value = std::strtod(token, &token_end);
+
+        if (n == 0 || token_end != token + n)
+        {
+            throw std::runtime_error("Error: malformed number.");
+        }
+
+        return p;
+    }
+
+    p = parse_exponent(p, end, exponent);
+    value = scale(mantissa, exponent, negative);
+
+    return p;
+}
+
+}
+
+// Parses a decimal number like strtod but on an unterminated range and
+// without locale. Up to 19 significant digits are kept, which is exact for
+// all integer types and more than enough for float. The common case of at
+// most 19 digits is read eight digits at a time without branching on each
+// character.
+inline char const*
+parse_number(char const* p, char const* end, double& value)
+{
+    using namespace number_parser_detail;
+
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        ++p;
+    }
+
+    char const* start = p;
+    bool negative(false);
+
+    if (p != end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    char const* digits_begin = p;
+    std::uint64_t mantissa(0);
+
+    p = parse_digits(p, end, mantissa);
+
+    // Leading zeros count as digits here, which only sends a few more
+    // numbers down the slow path.
+    std::ptrdiff_t digits = p - digits_begin;
+    int exponent(0);
+
+    if (p != end && *p == '.')
+    {
+        char const* fraction = ++p;
+
+        p = parse_digits(p, end, mantissa);
+
+        digits += p - fraction;
+        exponent = -static_cast<int>(p - fraction);
+    }
+
+    bool any = digits > 0;
+
+    if (!any || digits > 19)
+    {
+        return parse_number_slow(start, digits_begin, end, negative, value);
+    }
+
+    p = parse_exponent(p, end, exponent);
+    value = scale(mantissa, exponent, negative);
+
+    return p;
+}
+
+#endif // NUMBER_PARSER_HPP
@@ -0,0 +1,252 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "packed_surfel.hpp"
+#include "parallel.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace
+{
+
+const std::size_t block_size = 256;
+const float two_pi = 6.28318530718f;
+
+// Orthonormal basis of the plane orthogonal to n, see Duff et al.,
+// Building an Orthonormal Basis, Revisited. The vertex shader reconstructs
+// the tangent frame with the same construction.
+void
+tangent_basis(ArrayXf const& nx, ArrayXf const& ny, ArrayXf const& nz,
+    ArrayXf& b1x, ArrayXf& b1y, ArrayXf& b1z,
+    ArrayXf& b2x, ArrayXf& b2y, ArrayXf& b2z)
+{
+    ArrayXf s = (nz >= 0.0f).select(ArrayXf::Ones(nz.size()),
+        -ArrayXf::Ones(nz.size()));
+    ArrayXf a = -1.0f / (s + nz);
+    ArrayXf b = nx * ny * a;
+
+    b1x = 1.0f + s * nx * nx * a;
+    b1y = s * b;
+    b1z = -s * nx;
+
+    b2x = b;
+    b2y = s + ny * ny * a;
+    b2z = -ny;
+}
+
+void
+tangent_basis(Vector3f const& n, Vector3f& b1, Vector3f& b2)
+{
+    float s = n.z() >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (s + n.z());
+    float b = n.x() * n.y() * a;
+
+    b1 = Vector3f(1.0f + s * n.x() * n.x() * a, s * b, -s * n.x());
+    b2 = Vector3f(b, s + n.y() * n.y() * a, -n.y());
+}
+
+inline float
+snorm10_to_float(unsigned int bits)
+{
+    int q = static_cast<int>((bits & 0x3ffu) << 22) >> 22;
+    return std::max(-1.0f, static_cast<float>(q) / 511.0f);
+}
+
+inline float
+half_to_float(unsigned short h)
+{
+    half x;
+    x.x = h;
+    return static_cast<float>(x);
+}
+
+Vector3f
+oct_decode(float x, float y)
+{
+    Vector3f n(x, y, 1.0f - std::abs(x) - std::abs(y));
+
+    if (n.z() < 0.0f)
+    {
+        n.x() = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.y() = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    return n.normalized();
+}
+
+void
+pack_block(Surfel const* surfels, std::size_t n, PackedSurfel* packed)
+{
+    ArrayXf ux(n), uy(n), uz(n), vx(n), vy(n), vz(n);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        ux(i) = surfels[i].u.x(); uy(i) = surfels[i].u.y();
+        uz(i) = surfels[i].u.z();
+        vx(i) = surfels[i].v.x(); vy(i) = surfels[i].v.y();
+        vz(i) = surfels[i].v.z();
+    }
+
+    // Octahedral encoding of the normal n = u x v.
+    ArrayXf nx = uy * vz - uz * vy;
+    ArrayXf ny = uz * vx - ux * vz;
+    ArrayXf nz = ux * vy - uy * vx;
+
+    ArrayXf l1 = nx.abs() + ny.abs() + nz.abs();
+    ArrayXf inv_l1 = (l1 > 0.0f).select(l1.inverse(), 0.0f);
+
+    ArrayXf ox = nx * inv_l1;
+    ArrayXf oy = ny * inv_l1;
+    ArrayXf sx = (ox >= 0.0f).select(ArrayXf::Ones(n), -ArrayXf::Ones(n));
+    ArrayXf sy = (oy >= 0.0f).select(ArrayXf::Ones(n), -ArrayXf::Ones(n));
+
+    ArrayXf fx = (nz < 0.0f).select((1.0f - oy.abs()) * sx, ox);
+    ArrayXf fy = (nz < 0.0f).select((1.0f - ox.abs()) * sy, oy);
+
+    ArrayXf qx = (fx.max(-1.0f).min(1.0f) * 511.0f).round();
+    ArrayXf qy = (fy.max(-1.0f).min(1.0f) * 511.0f).round();
+
+    // Decode the quantized normal again so that the angle of u is measured
+    // in exactly the basis the vertex shader reconstructs.
+    ArrayXf dx = qx / 511.0f;
+    ArrayXf dy = qy / 511.0f;
+    ArrayXf dz = 1.0f - dx.abs() - dy.abs();
+    ArrayXf tx = (dx >= 0.0f).select(ArrayXf::Ones(n), -ArrayXf::Ones(n));
+    ArrayXf ty = (dy >= 0.0f).select(ArrayXf::Ones(n), -ArrayXf::Ones(n));
+    ArrayXf ex = (dz < 0.0f).select((1.0f - dy.abs()) * tx, dx);
+    ArrayXf ey = (dz < 0.0f).select((1.0f - dx.abs()) * ty, dy);
+    ArrayXf inv_len = (ex * ex + ey * ey + dz * dz).rsqrt();
+    ex *= inv_len;
+    ey *= inv_len;
+    ArrayXf ez = dz * inv_len;
+
+    ArrayXf b1x(n), b1y(n), b1z(n), b2x(n), b2y(n), b2z(n);
+    tangent_basis(ex, ey, ez, b1x, b1y, b1z, b2x, b2y, b2z);
+
+    ArrayXf ru = (ux * ux + uy * uy + uz * uz).sqrt();
+    ArrayXf rv = (vx * vx + vy * vy + vz * vz).sqrt();
+
+    ArrayXf cos_a = ux * b1x + uy * b1y + uz * b1z;
+    ArrayXf sin_a = ux * b2x + uy * b2y + uz * b2z;
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        float t = std::atan2(sin_a(i), cos_a(i)) / two_pi;
+        if (t < 0.0f)
+        {
+            t += 1.0f;
+        }
+
+        unsigned int qa = static_cast<unsigned int>(
+            t * 4096.0f + 0.5f) & 0xfffu;
+
+        PackedSurfel& p = packed[i];
+        p.c[0] = surfels[i].c.x();
+        p.c[1] = surfels[i].c.y();
+        p.c[2] = surfels[i].c.z();
+        p.frame = (static_cast<unsigned int>(static_cast<int>(qx(i)))
+            & 0x3ffu)
+            | ((static_cast<unsigned int>(static_cast<int>(qy(i)))
+            & 0x3ffu) << 10)
+            | (qa << 20);
+        p.radii[0] = half(ru(i)).x;
+        p.radii[1] = half(rv(i)).x;
+        p.rgba = surfels[i].rgba;
+    }
+}
+
+}
+
+void
+pack_surfels(Surfel const* surfels, std::size_t n, PackedSurfel* packed)
+{
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; i += block_size)
+        {
+            std::size_t m = std::min(block_size, end - i);
+            pack_block(surfels + i, m, packed + i);
+        }
+    }, 16 * block_size);
+}
+
+void
+unpack_surfels(PackedSurfel const* packed, std::size_t n, Surfel* surfels)
+{
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            unpack_surfel(packed[i], surfels[i]);
+        }
+    });
+}
+
+void
+unpack_surfel(PackedSurfel const& packed, Surfel& surfel)
+{
+    Vector3f normal = oct_decode(snorm10_to_float(packed.frame),
+        snorm10_to_float(packed.frame >> 10));
+
+    Vector3f b1, b2;
+    tangent_basis(normal, b1, b2);
+
+    float a = static_cast<float>(packed.frame >> 20) * two_pi / 4096.0f;
+    Vector3f u = std::cos(a) * b1 + std::sin(a) * b2;
+
+    surfel.c = Vector3f(packed.c[0], packed.c[1], packed.c[2]);
+    surfel.u = half_to_float(packed.radii[0]) * u;
+    surfel.v = half_to_float(packed.radii[1]) * normal.cross(u);
+    surfel.p = Vector3f::Zero();
+    surfel.rgba = packed.rgba;
+}
+
+bool
+pack_clip_planes(Surfel const* surfels, std::size_t n, unsigned int* planes)
+{
+    bool clipped(false);
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        Vector3f const& p = surfels[i].p;
+        float m = p.cwiseAbs().maxCoeff();
+
+        if (m == 0.0f)
+        {
+            planes[i] = 0u;
+            continue;
+        }
+
+        // Only the sign of the plane equation matters, it is normalized to
+        // make use of the full snorm range.
+        unsigned int q[3];
+        for (unsigned int j(0); j < 3; ++j)
+        {
+            q[j] = static_cast<unsigned int>(static_cast<int>(
+                std::floor(p(j) / m * 511.0f + 0.5f))) & 0x3ffu;
+        }
+
+        planes[i] = q[0] | (q[1] << 10) | (q[2] << 20);
+        clipped = true;
+    }
+
+    return clipped;
+}
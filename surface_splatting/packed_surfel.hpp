@@ -0,0 +1,52 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PACKED_SURFEL_HPP
+#define PACKED_SURFEL_HPP
+
+#include "surfel.hpp"
+
+#include <cstddef>
+
+// Compact vertex format of a surfel, 24 instead of 52 bytes. The tangent
+// frame is stored as an octahedral encoded normal together with the angle
+// of u in a canonical basis of the tangent plane, the lengths of u and v as
+// half floats. Clipping planes live in a separate, optional stream since
+// most point clouds do not use them.
+struct PackedSurfel
+{
+    float           c[3];       // Position of the ellipse center point.
+    unsigned int    frame;      // Normal (2 x 10 bit snorm), angle (12 bit).
+    unsigned short  radii[2];   // Lengths of u and v.
+    unsigned int    rgba;       // Color.
+};
+
+void pack_surfels(Surfel const* surfels, std::size_t n,
+    PackedSurfel* packed);
+void unpack_surfels(PackedSurfel const* packed, std::size_t n,
+    Surfel* surfels);
+
+// Serial version of unpack_surfels() for callers that already run on a
+// worker thread.
+void unpack_surfel(PackedSurfel const& packed, Surfel& surfel);
+
+// Encodes the clipping planes as GL_INT_2_10_10_10_REV. Returns false if
+// none of the surfels is clipped.
+bool pack_clip_planes(Surfel const* surfels, std::size_t n,
+    unsigned int* planes);
+
+#endif // PACKED_SURFEL_HPP
@@ -0,0 +1,158 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+//
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+inline unsigned int
+num_worker_threads()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Splits [begin, end) into at most num_worker_threads() contiguous blocks
+// of at least grain_size elements and calls f(block_begin, block_end) for
+// each of them on its own thread. The calling thread takes the last block.
+// An exception thrown by f is rethrown on the calling thread once all
+// blocks have finished.
+template <typename Function>
+void
+parallel_for(std::size_t begin, std::size_t end, Function const& f,
+    std::size_t grain_size = 4096)
+{
+    if (end <= begin)
+    {
+        return;
+    }
+
+    std::size_t n = end - begin;
+    std::size_t num_blocks = std::min<std::size_t>(num_worker_threads(),
+        (n + grain_size - 1) / grain_size);
+
+    if (num_blocks <= 1)
+    {
+        f(begin, end);
+        return;
+    }
+
+    // Rounding the block size up may leave fewer blocks than threads, the
+    // last one ending at end.
+    std::size_t block_size = (n + num_blocks - 1) / num_blocks;
+    num_blocks = (n + block_size - 1) / block_size;
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_blocks - 1);
+
+    std::vector<std::exception_ptr> errors(num_blocks);
+
+    for (std::size_t i(0); i + 1 < num_blocks; ++i)
+    {
+        std::size_t block_begin = begin + i * block_size;
+        threads.push_back(std::thread([&f, &errors, i, block_begin,
+            block_size]()
+        {
+            try
+            {
+                f(block_begin, block_begin + block_size);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }));
+    }
+
+    try
+    {
+        f(begin + (num_blocks - 1) * block_size, end);
+    }
+    catch (...)
+    {
+        errors[num_blocks - 1] = std::current_exception();
+    }
+
+    for (std::size_t i(0); i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    for (std::size_t i(0); i < num_blocks; ++i)
+    {
+        if (errors[i])
+        {
+            std::rethrow_exception(errors[i]);
+        }
+    }
+}
+
+// Sorts [begin, end) by sorting one block per thread and merging pairs of
+// sorted runs in parallel until a single run is left.
+template <typename RandomIt>
+void
+parallel_sort(RandomIt begin, RandomIt end, std::size_t grain_size = 65536)
+{
+    std::size_t n = static_cast<std::size_t>(end - begin);
+    std::size_t num_blocks = std::min<std::size_t>(num_worker_threads(),
+        (n + grain_size - 1) / grain_size);
+
+    if (num_blocks <= 1)
+    {
+        std::sort(begin, end);
+        return;
+    }
+
+    std::size_t block_size = (n + num_blocks - 1) / num_blocks;
+
+    parallel_for(0, num_blocks, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i(first); i < last; ++i)
+        {
+            std::sort(begin + std::min(n, i * block_size),
+                begin + std::min(n, (i + 1) * block_size));
+        }
+    }, 1);
+
+    for (std::size_t width(block_size); width < n; width *= 2)
+    {
+        std::size_t num_merges = (n + 2 * width - 1) / (2 * width);
+
+        parallel_for(0, num_merges, [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t i(first); i < last; ++i)
+            {
+                std::size_t lo = i * 2 * width;
+                std::size_t mid = std::min(n, lo + width);
+                std::size_t hi = std::min(n, lo + 2 * width);
+
+                if (mid < hi)
+                {
+                    std::inplace_merge(begin + lo, begin + mid, begin + hi);
+                }
+            }
+        }, 1);
+    }
+}
+
+#endif // PARALLEL_HPP
@@ -0,0 +1,856 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ply_reader.hpp"
+#include "number_parser.hpp"
+#include "parallel.hpp"
+
+#include <GLviz>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace Eigen;
+
+namespace
+{
+
+enum PlyType
+{
+    PlyInt8, PlyUInt8, PlyInt16, PlyUInt16,
+    PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64
+};
+
+enum PlyTarget
+{
+    TargetNone,
+    TargetX, TargetY, TargetZ,
+    TargetNX, TargetNY, TargetNZ,
+    TargetRed, TargetGreen, TargetBlue, TargetAlpha,
+    TargetRadius,
+    TargetIndices
+};
+
+struct PlyProperty
+{
+    PlyType type;
+    bool list;
+    PlyType count_type;
+    PlyTarget target;
+};
+
+struct PlyElement
+{
+    std::size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+struct PlyHeader
+{
+    bool binary;
+    std::size_t body_offset;
+    std::vector<PlyElement> elements;
+};
+
+// ASCII bodies are read in blocks of about this size.
+const std::size_t ascii_block_size = 64 << 20;
+
+void
+throw_error(std::string const& filename, std::string const& what)
+{
+    std::ostringstream error_message;
+    error_message << "Error: " << filename << ": " << what << "."
+        << std::endl;
+
+    throw std::runtime_error(error_message.str().c_str());
+}
+
+bool
+parse_type(std::string const& name, PlyType& type)
+{
+    static char const* const names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" },
+        { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" },
+        { "float", "float32" }, { "double", "float64" } };
+
+    for (unsigned int i(0); i < 8; ++i)
+    {
+        if (name == names[i][0] || name == names[i][1])
+        {
+            type = static_cast<PlyType>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t
+type_size(PlyType type)
+{
+    static const std::size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+PlyTarget
+property_target(std::string const& element, std::string const& name)
+{
+    if (element == "vertex")
+    {
+        static char const* const names[] = { "x", "y", "z", "nx", "ny",
+            "nz", "red", "green", "blue", "alpha", "radius" };
+
+        for (unsigned int i(0); i < 11; ++i)
+        {
+            if (name == names[i])
+            {
+                return static_cast<PlyTarget>(TargetX + i);
+            }
+        }
+    }
+    else if (element == "face")
+    {
+        if (name == "vertex_indices" || name == "vertex_index")
+        {
+            return TargetIndices;
+        }
+    }
+
+    return TargetNone;
+}
+
+PlyHeader
+read_header(std::string const& filename)
+{
+    std::ifstream input(filename, std::ios::in | std::ios::binary);
+
+    if (input.fail())
+    {
+        throw_error(filename, "can not open");
+    }
+
+    PlyHeader header;
+    header.binary = false;
+
+    std::vector<std::string> element_names;
+    std::string line;
+    bool format(false), magic(false);
+
+    while (std::getline(input, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if (!magic)
+        {
+            if (keyword != "ply")
+            {
+                throw_error(filename, "not a PLY file");
+            }
+
+            magic = true;
+        }
+        else if (keyword == "format")
+        {
+            std::string name;
+            tokens >> name;
+
+            if (name == "binary_little_endian")
+            {
+                header.binary = true;
+            }
+            else if (name != "ascii")
+            {
+                throw_error(filename, "unsupported format " + name);
+            }
+
+            format = true;
+        }
+        else if (keyword == "element")
+        {
+            std::string name;
+            std::size_t count(0);
+            tokens >> name >> count;
+
+            if (tokens.fail())
+            {
+                throw_error(filename, "malformed element " + line);
+            }
+
+            header.elements.push_back(PlyElement());
+            header.elements.back().count = count;
+            element_names.push_back(name);
+        }
+        else if (keyword == "property")
+        {
+            if (header.elements.empty())
+            {
+                throw_error(filename, "property without element");
+            }
+
+            PlyProperty property;
+            std::string type, name;
+            tokens >> type;
+
+            property.list = type == "list";
+            property.count_type = PlyUInt8;
+
+            if (property.list)
+            {
+                std::string count_type;
+                tokens >> count_type >> type;
+
+                if (!parse_type(count_type, property.count_type))
+                {
+                    throw_error(filename, "unknown type " + count_type);
+                }
+            }
+
+            tokens >> name;
+
+            if (!parse_type(type, property.type) || tokens.fail())
+            {
+                throw_error(filename, "malformed property " + line);
+            }
+
+            property.target = property_target(element_names.back(), name);
+            if (property.list != (property.target == TargetIndices))
+            {
+                property.target = TargetNone;
+            }
+
+            header.elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            if (!format)
+            {
+                throw_error(filename, "missing format");
+            }
+
+            header.body_offset = static_cast<std::size_t>(input.tellg());
+            return header;
+        }
+        else if (keyword != "comment" && keyword != "obj_info"
+            && !keyword.empty())
+        {
+            throw_error(filename, "unknown header line " + line);
+        }
+    }
+
+    throw_error(filename, "missing end_header");
+    return header;
+}
+
+double
+read_binary(char const* p, PlyType type)
+{
+    switch (type)
+    {
+    case PlyInt8:
+        { std::int8_t x; std::memcpy(&x, p, 1); return x; }
+    case PlyUInt8:
+        { std::uint8_t x; std::memcpy(&x, p, 1); return x; }
+    case PlyInt16:
+        { std::int16_t x; std::memcpy(&x, p, 2); return x; }
+    case PlyUInt16:
+        { std::uint16_t x; std::memcpy(&x, p, 2); return x; }
+    case PlyInt32:
+        { std::int32_t x; std::memcpy(&x, p, 4); return x; }
+    case PlyUInt32:
+        { std::uint32_t x; std::memcpy(&x, p, 4); return x; }
+    case PlyFloat32:
+        { float x; std::memcpy(&x, p, 4); return x; }
+    default:
+        { double x; std::memcpy(&x, p, 8); return x; }
+    }
+}
+
+// Whether value is a whole number in [0, max].
+bool
+valid_count(double value, double max)
+{
+    return value >= 0.0 && value <= max && value == std::floor(value);
+}
+
+// Receives the values of one element record.
+class RecordSink
+{
+
+public:
+    RecordSink(PlyData& data, std::vector<std::array<unsigned int, 3> >&
+        faces)
+        : m_data(data), m_faces(faces)
+    {
+    }
+
+    void scalar(std::size_t i, PlyProperty const& property, double value)
+    {
+        switch (property.target)
+        {
+        case TargetX: case TargetY: case TargetZ:
+            m_data.positions[i](property.target - TargetX) =
+                static_cast<float>(value);
+            break;
+        case TargetNX: case TargetNY: case TargetNZ:
+            m_data.normals[i](property.target - TargetNX) =
+                static_cast<float>(value);
+            break;
+        case TargetRed: case TargetGreen: case TargetBlue: case TargetAlpha:
+        {
+            if (property.type == PlyFloat32 || property.type == PlyFloat64)
+            {
+                value *= 255.0;
+            }
+
+            unsigned int shift = 8 * (property.target - TargetRed);
+            unsigned int channel = static_cast<unsigned int>(
+                std::min(std::max(value, 0.0), 255.0) + 0.5);
+
+            m_data.colors[i] = (m_data.colors[i] & ~(0xffu << shift))
+                | channel << shift;
+            break;
+        }
+        case TargetRadius:
+            m_data.radii[i] = static_cast<float>(value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Splits the polygon into a triangle fan, returns false if an index is
+    // not a vertex.
+    bool polygon(unsigned int const* indices, std::size_t n)
+    {
+        for (std::size_t k(0); k < n; ++k)
+        {
+            if (indices[k] >= m_data.positions.size())
+            {
+                return false;
+            }
+        }
+
+        for (std::size_t k(1); k + 1 < n; ++k)
+        {
+            std::array<unsigned int, 3> face = {{ indices[0], indices[k],
+                indices[k + 1] }};
+            m_faces.push_back(face);
+        }
+
+        return true;
+    }
+
+private:
+    PlyData& m_data;
+    std::vector<std::array<unsigned int, 3> >& m_faces;
+};
+
+// Sizes the arrays of data for the properties of the vertex element.
+void
+prepare_vertices(PlyElement& element, PlyData& data)
+{
+    bool targets[TargetIndices + 1] = { false };
+    for (std::size_t i(0); i < element.properties.size(); ++i)
+    {
+        targets[element.properties[i].target] = true;
+    }
+
+    std::size_t n = element.count;
+
+    data.positions.assign(targets[TargetX] || targets[TargetY]
+        || targets[TargetZ] ? n : 0, Vector3f::Zero());
+    data.normals.assign(targets[TargetNX] && targets[TargetNY]
+        && targets[TargetNZ] ? n : 0, Vector3f::Zero());
+    data.radii.assign(targets[TargetRadius] ? n : 0, 0.0f);
+    data.colors.assign(targets[TargetRed] || targets[TargetGreen]
+        || targets[TargetBlue] ? n : 0, 0xff000000);
+
+    // Normals are only kept if all three components exist, alpha only
+    // along with a color.
+    for (std::size_t i(0); i < element.properties.size(); ++i)
+    {
+        PlyTarget& target = element.properties[i].target;
+
+        if (data.normals.empty() && target >= TargetNX
+            && target <= TargetNZ)
+        {
+            target = TargetNone;
+        }
+
+        if (data.colors.empty() && target == TargetAlpha)
+        {
+            target = TargetNone;
+        }
+    }
+}
+
+// Parses one ASCII record from p and returns the position after it, or
+// nullptr if a list has an invalid length or index.
+char const*
+parse_ascii_record(char const* p, char const* end, PlyElement const& element,
+    std::size_t i, RecordSink& sink, std::vector<unsigned int>& indices)
+{
+    for (std::size_t j(0); j < element.properties.size(); ++j)
+    {
+        PlyProperty const& property = element.properties[j];
+        double value;
+
+        if (property.list)
+        {
+            // Every list entry takes at least two characters.
+            p = parse_number(p, end, value);
+            if (!valid_count(value, static_cast<double>(end - p) / 2 + 1))
+            {
+                return nullptr;
+            }
+
+            std::size_t n = static_cast<std::size_t>(value);
+            bool vertex_indices = property.target == TargetIndices;
+
+            indices.resize(n);
+            for (std::size_t k(0); k < n; ++k)
+            {
+                p = parse_number(p, end, value);
+                if (vertex_indices && !valid_count(value, UINT32_MAX))
+                {
+                    return nullptr;
+                }
+
+                indices[k] = static_cast<unsigned int>(value);
+            }
+
+            if (vertex_indices && !sink.polygon(indices.data(), n))
+            {
+                return nullptr;
+            }
+        }
+        else
+        {
+            p = parse_number(p, end, value);
+            sink.scalar(i, property, value);
+        }
+    }
+
+    return p;
+}
+
+bool
+blank_line(char const* p, char const* end)
+{
+    for (; p != end; ++p)
+    {
+        if (*p != ' ' && *p != '\t' && *p != '\r')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Streams the ASCII body in blocks of whole lines. Every block is split at
+// line ends into pieces that are parsed in parallel, faces are collected
+// per piece and appended in order.
+void
+read_ascii_body(std::string const& filename, PlyHeader const& header,
+    PlyData& data)
+{
+    std::ifstream input(filename, std::ios::in | std::ios::binary);
+    input.seekg(static_cast<std::streamoff>(header.body_offset));
+
+    std::vector<PlyElement> const& elements = header.elements;
+
+    // Index of the first line of every element, plus the total.
+    std::vector<std::size_t> first_line(elements.size() + 1, 0);
+    for (std::size_t e(0); e < elements.size(); ++e)
+    {
+        first_line[e + 1] = first_line[e] + elements[e].count;
+    }
+
+    std::size_t total_lines = first_line.back(), lines_done(0);
+    std::vector<char> block;
+    std::size_t carry(0);
+
+    while (lines_done < total_lines)
+    {
+        block.resize(carry + ascii_block_size);
+        input.read(block.data() + carry, ascii_block_size);
+        std::size_t size = carry + static_cast<std::size_t>(input.gcount());
+        bool last = input.eof() || input.fail();
+
+        // Only whole lines are parsed, the rest is carried over.
+        std::size_t cut = size;
+        if (!last)
+        {
+            while (cut > 0 && block[cut - 1] != '\n')
+            {
+                --cut;
+            }
+
+            if (cut == 0)
+            {
+                throw_error(filename, "line too long");
+            }
+        }
+
+        char const* text = block.data();
+        std::size_t num_pieces = std::max<std::size_t>(1,
+            std::min<std::size_t>(4 * num_worker_threads(), cut >> 16));
+
+        std::vector<std::size_t> piece_begin(num_pieces + 1, cut);
+        piece_begin[0] = 0;
+        for (std::size_t k(1); k < num_pieces; ++k)
+        {
+            std::size_t b = std::max(piece_begin[k - 1], k * cut
+                / num_pieces);
+            while (b < cut && b > 0 && text[b - 1] != '\n')
+            {
+                ++b;
+            }
+            piece_begin[k] = b;
+        }
+
+        // Counts the records per piece, then parses them knowing their
+        // global line index.
+        std::vector<std::size_t> piece_lines(num_pieces + 1, 0);
+
+        parallel_for(0, num_pieces, [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t k(first); k < last; ++k)
+            {
+                char const* p = text + piece_begin[k];
+                char const* end = text + piece_begin[k + 1];
+
+                while (p != end)
+                {
+                    char const* eol = static_cast<char const*>(
+                        std::memchr(p, '\n', end - p));
+                    eol = eol ? eol : end;
+
+                    piece_lines[k + 1] += !blank_line(p, eol);
+                    p = eol == end ? end : eol + 1;
+                }
+            }
+        }, 1);
+
+        for (std::size_t k(0); k < num_pieces; ++k)
+        {
+            piece_lines[k + 1] += piece_lines[k];
+        }
+
+        std::vector<std::vector<std::array<unsigned int, 3> > >
+            piece_faces(num_pieces);
+
+        parallel_for(0, num_pieces, [&](std::size_t first, std::size_t last)
+        {
+            std::vector<unsigned int> indices;
+
+            for (std::size_t k(first); k < last; ++k)
+            {
+                RecordSink sink(data, piece_faces[k]);
+
+                char const* p = text + piece_begin[k];
+                char const* end = text + piece_begin[k + 1];
+                std::size_t line = lines_done + piece_lines[k];
+                std::size_t e(0);
+
+                while (p != end && line < total_lines)
+                {
+                    char const* eol = static_cast<char const*>(
+                        std::memchr(p, '\n', end - p));
+                    eol = eol ? eol : end;
+
+                    if (!blank_line(p, eol))
+                    {
+                        while (line >= first_line[e + 1])
+                        {
+                            ++e;
+                        }
+
+                        char const* parsed(nullptr);
+                        try
+                        {
+                            parsed = parse_ascii_record(p, eol, elements[e],
+                                line - first_line[e], sink, indices);
+                        }
+                        catch (std::runtime_error const&)
+                        {
+                            throw_error(filename, "malformed number");
+                        }
+
+                        if (!parsed)
+                        {
+                            throw_error(filename, "malformed face");
+                        }
+
+                        ++line;
+                    }
+
+                    p = eol == end ? end : eol + 1;
+                }
+            }
+        }, 1);
+
+        for (std::size_t k(0); k < num_pieces; ++k)
+        {
+            data.faces.insert(data.faces.end(), piece_faces[k].begin(),
+                piece_faces[k].end());
+        }
+
+        lines_done += piece_lines[num_pieces];
+
+        if (last)
+        {
+            break;
+        }
+
+        carry = size - cut;
+        std::memmove(block.data(), block.data() + cut, carry);
+    }
+
+    if (lines_done < total_lines)
+    {
+        throw_error(filename, "unexpected end of file");
+    }
+}
+
+// Size of a record without list properties, zero otherwise.
+std::size_t
+fixed_record_size(PlyElement const& element)
+{
+    std::size_t size(0);
+    for (std::size_t j(0); j < element.properties.size(); ++j)
+    {
+        if (element.properties[j].list)
+        {
+            return 0;
+        }
+
+        size += type_size(element.properties[j].type);
+    }
+
+    return size;
+}
+
+// Reads the records of one element from p, returns the position after
+// them or nullptr if the body ends early.
+char const*
+read_binary_element(std::string const& filename, char const* p,
+    char const* end, PlyElement const& element, PlyData& data)
+{
+    std::size_t record_size = fixed_record_size(element);
+
+    // Fixed size records are read in parallel.
+    if (record_size > 0)
+    {
+        if (static_cast<std::size_t>(end - p) / record_size < element.count)
+        {
+            return nullptr;
+        }
+
+        parallel_for(0, element.count, [&](std::size_t begin,
+            std::size_t last)
+        {
+            std::vector<std::array<unsigned int, 3> > unused;
+            RecordSink sink(data, unused);
+
+            for (std::size_t i(begin); i < last; ++i)
+            {
+                char const* q = p + i * record_size;
+
+                for (std::size_t j(0); j < element.properties.size(); ++j)
+                {
+                    PlyProperty const& property = element.properties[j];
+
+                    if (property.target != TargetNone)
+                    {
+                        sink.scalar(i, property, read_binary(q,
+                            property.type));
+                    }
+
+                    q += type_size(property.type);
+                }
+            }
+        });
+
+        return p + element.count * record_size;
+    }
+
+    std::vector<std::array<unsigned int, 3> > faces;
+    RecordSink sink(data, faces);
+    std::vector<unsigned int> indices;
+
+    for (std::size_t i(0); i < element.count; ++i)
+    {
+        for (std::size_t j(0); j < element.properties.size(); ++j)
+        {
+            PlyProperty const& property = element.properties[j];
+            std::size_t size = type_size(property.type);
+
+            if (property.list)
+            {
+                std::size_t count_size = type_size(property.count_type);
+                if (static_cast<std::size_t>(end - p) < count_size)
+                {
+                    return nullptr;
+                }
+
+                double value = read_binary(p, property.count_type);
+                p += count_size;
+
+                if (!valid_count(value, UINT32_MAX))
+                {
+                    throw_error(filename, "malformed face");
+                }
+
+                std::size_t n = static_cast<std::size_t>(value);
+                if (static_cast<std::size_t>(end - p) / size < n)
+                {
+                    return nullptr;
+                }
+
+                if (property.target == TargetIndices)
+                {
+                    indices.resize(n);
+                    for (std::size_t k(0); k < n; ++k)
+                    {
+                        value = read_binary(p + k * size, property.type);
+                        if (!valid_count(value, UINT32_MAX))
+                        {
+                            throw_error(filename, "malformed face");
+                        }
+
+                        indices[k] = static_cast<unsigned int>(value);
+                    }
+
+                    if (!sink.polygon(indices.data(), n))
+                    {
+                        throw_error(filename, "malformed face");
+                    }
+                }
+
+                p += n * size;
+            }
+            else
+            {
+                if (static_cast<std::size_t>(end - p) < size)
+                {
+                    return nullptr;
+                }
+
+                sink.scalar(i, property, read_binary(p, property.type));
+                p += size;
+            }
+        }
+    }
+
+    data.faces.insert(data.faces.end(), faces.begin(), faces.end());
+    return p;
+}
+
+}
+
+void
+read_ply(std::string const& filename, PlyData& data)
+{
+    PlyHeader header = read_header(filename);
+
+    data = PlyData();
+
+    for (std::size_t e(0); e < header.elements.size(); ++e)
+    {
+        PlyElement& element = header.elements[e];
+
+        for (std::size_t j(0); j < element.properties.size(); ++j)
+        {
+            PlyTarget target = element.properties[j].target;
+
+            if (target >= TargetX && target <= TargetRadius)
+            {
+                prepare_vertices(element, data);
+                break;
+            }
+        }
+    }
+
+    if (!header.binary)
+    {
+        read_ascii_body(filename, header, data);
+        return;
+    }
+
+    GLviz::MappedFile file(filename);
+
+    char const* p = file.data() + std::min(header.body_offset, file.size());
+    char const* end = file.data() + file.size();
+
+    for (std::size_t e(0); e < header.elements.size(); ++e)
+    {
+        p = read_binary_element(filename, p, end, header.elements[e],
+            data);
+
+        if (!p)
+        {
+            throw_error(filename, "unexpected end of file");
+        }
+    }
+}
+
+bool
+ply_to_surfels(PlyData const& data, std::vector<Surfel>& surfels)
+{
+    std::size_t n = data.positions.size();
+
+    if (n == 0 || data.normals.size() != n || data.radii.size() != n)
+    {
+        return false;
+    }
+
+    surfels.resize(n);
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            Vector3f normal = data.normals[i].normalized();
+            Vector3f u = normal.unitOrthogonal();
+
+            surfels[i].c = data.positions[i];
+            surfels[i].u = data.radii[i] * u;
+            surfels[i].v = data.radii[i] * normal.cross(u);
+            surfels[i].p = Vector3f::Zero();
+            surfels[i].rgba = data.colors.size() == n ? data.colors[i]
+                : 0xffffffff;
+        }
+    });
+
+    return true;
+}
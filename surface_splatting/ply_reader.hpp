@@ -0,0 +1,51 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLY_READER_HPP
+#define PLY_READER_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+
+#include <array>
+#include <string>
+#include <vector>
+
+// Vertex and face data of a PLY file. Arrays of properties missing in the
+// file stay empty, polygons are split into triangle fans.
+struct PlyData
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> normals;       // nx, ny, nz
+    std::vector<float> radii;                   // radius
+    std::vector<unsigned int> colors;           // red, green, blue, alpha
+    std::vector<std::array<unsigned int, 3> > faces;
+};
+
+// Reads ASCII and binary little endian PLY files. Binary bodies are mapped
+// and read in place, fixed size records on all cores. ASCII bodies are
+// read in large blocks of whole lines and every block is parsed on all
+// cores, so the text is never held in memory completely. Throws
+// std::runtime_error on malformed or unsupported files.
+void read_ply(std::string const& filename, PlyData& data);
+
+// Makes circular surfels of the given radius in the plane of the normals.
+// Returns false if the file has no normals or no radii.
+bool ply_to_surfels(PlyData const& data, std::vector<Surfel>& surfels);
+
+#endif // PLY_READER_HPP
@@ -0,0 +1,148 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "point_cloud.hpp"
+#include "kd_tree.hpp"
+#include "parallel.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace
+{
+
+void
+fit_surfel(KdTree const& tree, std::vector<Vector3f> const& positions,
+    std::size_t i, Vector3f const& reference, SurfelFitting const& fitting,
+    std::vector<unsigned int>& indices, std::vector<float>& distances,
+    std::vector<float>& metric, Surfel& surfel)
+{
+    Vector3f const& c = positions[i];
+
+    surfel.c = c;
+    surfel.u = Vector3f::Zero();
+    surfel.v = Vector3f::Zero();
+    surfel.p = Vector3f::Zero();
+
+    unsigned int n = tree.knn(c, fitting.neighbours, indices, distances);
+    if (n < 3)
+    {
+        return;
+    }
+
+    Vector3f mean = Vector3f::Zero();
+    for (unsigned int j(0); j < n; ++j)
+    {
+        mean += positions[indices[j]];
+    }
+    mean /= static_cast<float>(n);
+
+    Matrix3f covariance = Matrix3f::Zero();
+    for (unsigned int j(0); j < n; ++j)
+    {
+        Vector3f d = positions[indices[j]] - mean;
+        covariance += d * d.transpose();
+    }
+    covariance /= static_cast<float>(n);
+
+    // The eigenvalues are in increasing order, the smallest belongs to the
+    // normal and the others measure the spread along the tangents.
+    SelfAdjointEigenSolver<Matrix3f> eigen;
+    eigen.computeDirect(covariance);
+
+    Vector3f normal = eigen.eigenvectors().col(0);
+    Vector3f t0 = eigen.eigenvectors().col(2);
+
+    float l0 = eigen.eigenvalues()(2);
+    float l1 = std::max(eigen.eigenvalues()(1),
+        l0 / (fitting.max_aspect * fitting.max_aspect));
+
+    if (!(l0 > 0.0f))
+    {
+        return;
+    }
+
+    if (fitting.viewpoint ? normal.dot(*fitting.viewpoint - c) < 0.0f
+        : normal.dot(c - reference) < 0.0f)
+    {
+        normal = -normal;
+    }
+
+    Vector3f t1 = normal.cross(t0);
+
+    // Distances of the neighbours in the metric of the ellipse with axes
+    // sqrt(l0) and sqrt(l1), the point itself is the first neighbour.
+    metric.clear();
+    for (unsigned int j(1); j < n; ++j)
+    {
+        Vector3f d = positions[indices[j]] - c;
+        float x = d.dot(t0), y = d.dot(t1);
+
+        metric.push_back(x * x / l0 + y * y / l1);
+    }
+
+    std::size_t r = std::min<std::size_t>(std::max(fitting.reach, 1u),
+        metric.size()) - 1;
+    std::nth_element(metric.begin(), metric.begin() + r, metric.end());
+
+    float scale = std::sqrt(metric[r]);
+
+    surfel.u = scale * std::sqrt(l0) * t0;
+    surfel.v = scale * std::sqrt(l1) * t1;
+}
+
+}
+
+void
+fit_surfels(PointCloud const& cloud, std::vector<Surfel>& surfels,
+    SurfelFitting const& fitting)
+{
+    std::vector<Vector3f> const& positions = cloud.positions;
+    std::size_t n = positions.size();
+
+    KdTree tree(positions);
+
+    Vector3d sum = Vector3d::Zero();
+    for (std::size_t i(0); i < n; ++i)
+    {
+        sum += positions[i].cast<double>();
+    }
+
+    Vector3f centroid = n > 0 ? Vector3f((sum / static_cast<double>(n))
+        .cast<float>()) : Vector3f::Zero();
+
+    surfels.resize(n);
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        std::vector<unsigned int> indices;
+        std::vector<float> distances, metric;
+
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            fit_surfel(tree, positions, i, centroid, fitting, indices,
+                distances, metric, surfels[i]);
+
+            surfels[i].rgba = cloud.colors.size() == n ? cloud.colors[i]
+                : 0xffffffff;
+        }
+    });
+}
@@ -0,0 +1,65 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef POINT_CLOUD_HPP
+#define POINT_CLOUD_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+// Unoriented scanner points with optional colors as 0xAABBGGRR.
+struct PointCloud
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<unsigned int> colors;
+};
+
+struct SurfelFitting
+{
+    SurfelFitting()
+        : neighbours(16), reach(8), max_aspect(4.0f), viewpoint(nullptr)
+    {
+    }
+
+    // Neighbours per point for the PCA, including the point itself.
+    unsigned int neighbours;
+
+    // Each ellipse reaches this many of its neighbours, measured in the
+    // metric of its own shape. Larger values close holes in irregular
+    // samplings at the cost of more overlapping fragments.
+    unsigned int reach;
+
+    // Upper bound for the ratio of the axes.
+    float max_aspect;
+
+    // Normals point towards the viewpoint if given, otherwise away from the
+    // centroid of the cloud.
+    Eigen::Vector3f const* viewpoint;
+};
+
+// Fits one surfel per point. A kd-tree provides the neighbours of each
+// point, the eigenvectors of their covariance give the normal and the
+// tangent directions and the ellipse follows the neighbour spacing along
+// them. Runs on all cores.
+void fit_surfels(PointCloud const& cloud, std::vector<Surfel>& surfels,
+    SurfelFitting const& fitting = SurfelFitting());
+
+#endif // POINT_CLOUD_HPP
@@ -27,7 +27,8 @@ extern unsigned char const lighting_glsl[];
 ProgramAttribute::ProgramAttribute()
     : m_ewa_filter(false), m_backface_culling(false),
       m_visibility_pass(true), m_smooth(false), m_color_material(false),
-      m_pointsize_method(0)
+      m_batched(false), m_pointsize_method(0), m_vertex_format(0),
+      m_instance_base_location(-1)
 {
     initialize_shader_obj();
     initialize_program_obj();
@@ -93,6 +94,32 @@ ProgramAttribute::set_color_material(bool enable)
     }
 }
 
+void
+ProgramAttribute::set_vertex_format(unsigned int vertex_format)
+{
+    if (m_vertex_format != vertex_format)
+    {
+        m_vertex_format = vertex_format;
+        initialize_program_obj();
+    }
+}
+
+void
+ProgramAttribute::set_batched(bool enable)
+{
+    if (m_batched != enable)
+    {
+        m_batched = enable;
+        initialize_program_obj();
+    }
+}
+
+void
+ProgramAttribute::set_instance_base(GLint instance_base)
+{
+    glUniform1i(m_instance_base_location, instance_base);
+}
+
 void
 ProgramAttribute::initialize_shader_obj()
 {
@@ -130,6 +157,10 @@ ProgramAttribute::initialize_program_obj()
             m_smooth ? 1 : 0));
         defines.insert(std::make_pair("COLOR_MATERIAL",
             m_color_material ? 1 : 0));
+        defines.insert(std::make_pair("VERTEX_FORMAT",
+            static_cast<int>(m_vertex_format)));
+        defines.insert(std::make_pair("BATCHED",
+            m_batched ? 1 : 0));
 
         m_attribute_vs_obj.compile(defines);
         m_attribute_fs_obj.compile(defines);
@@ -153,6 +184,10 @@ ProgramAttribute::initialize_program_obj()
         std::exit(EXIT_FAILURE);
     }
 
+    // Looked up once, it is set for every batch.
+    m_instance_base_location = glGetUniformLocation(m_program_obj,
+        "instance_base");
+
     try
     {
         set_uniform_block_binding("Camera", 0);
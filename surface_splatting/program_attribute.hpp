@@ -32,6 +32,11 @@ public:
     void set_visibility_pass(bool enable = true);
     void set_smooth(bool enable = true);
     void set_color_material(bool enable = true);
+    void set_vertex_format(unsigned int vertex_format);
+    void set_batched(bool enable = true);
+
+    // Index of the first instance transform of the next batched draw call.
+    void set_instance_base(GLint instance_base);
 
 private:
     void initialize_shader_obj();
@@ -42,8 +47,9 @@ private:
     glFragmentShader m_attribute_fs_obj;
 
     bool m_ewa_filter, m_backface_culling,
-         m_visibility_pass, m_smooth, m_color_material;
-    unsigned int m_pointsize_method;
+         m_visibility_pass, m_smooth, m_color_material, m_batched;
+    unsigned int m_pointsize_method, m_vertex_format;
+    GLint m_instance_base_location;
 };
 
 #endif // PROGRAM_RENDER_HPP
@@ -0,0 +1,91 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "program_bounding_box.hpp"
+
+#include <iostream>
+#include <cstdlib>
+
+extern unsigned char const bounding_box_vs_glsl[];
+extern unsigned char const bounding_box_fs_glsl[];
+
+ProgramBoundingBox::ProgramBoundingBox()
+    : m_box_min_location(-1), m_box_max_location(-1)
+{
+    initialize_shader_obj();
+    initialize_program_obj();
+}
+
+void
+ProgramBoundingBox::set_box(float const* min, float const* max)
+{
+    glUniform3fv(m_box_min_location, 1, min);
+    glUniform3fv(m_box_max_location, 1, max);
+}
+
+void
+ProgramBoundingBox::initialize_shader_obj()
+{
+    m_bounding_box_vs_obj.load_from_cstr(
+        reinterpret_cast<char const*>(bounding_box_vs_glsl));
+    m_bounding_box_fs_obj.load_from_cstr(
+        reinterpret_cast<char const*>(bounding_box_fs_glsl));
+
+    attach_shader(m_bounding_box_vs_obj);
+    attach_shader(m_bounding_box_fs_obj);
+}
+
+void
+ProgramBoundingBox::initialize_program_obj()
+{
+    try
+    {
+        std::map<std::string, int> defines;
+
+        m_bounding_box_vs_obj.compile(defines);
+        m_bounding_box_fs_obj.compile(defines);
+    }
+    catch (shader_compilation_error const& e)
+    {
+        std::cerr << "Error: A shader failed to compile." << std::endl
+            << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    try
+    {
+        link();
+    }
+    catch (shader_link_error const& e)
+    {
+        std::cerr << "Error: A program failed to link." << std::endl
+            << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    m_box_min_location = glGetUniformLocation(m_program_obj, "box_min");
+    m_box_max_location = glGetUniformLocation(m_program_obj, "box_max");
+
+    try
+    {
+        set_uniform_block_binding("Camera", 0);
+    }
+    catch (uniform_not_found_error const& e)
+    {
+        std::cerr << "[program_bounding_box] Uniform error! name = "
+            << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,43 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef PROGRAM_BOUNDING_BOX_HPP
+#define PROGRAM_BOUNDING_BOX_HPP
+
+#include <GLviz>
+
+// Draws an axis aligned box as a triangle strip of 14 vertices without
+// any vertex attributes, for occlusion queries.
+class ProgramBoundingBox : public glProgram
+{
+
+public:
+    ProgramBoundingBox();
+
+    void set_box(float const* min, float const* max);
+
+private:
+    void initialize_shader_obj();
+    void initialize_program_obj();
+
+private:
+    glVertexShader   m_bounding_box_vs_obj;
+    glFragmentShader m_bounding_box_fs_obj;
+
+    GLint m_box_min_location, m_box_max_location;
+};
+
+#endif // PROGRAM_BOUNDING_BOX_HPP
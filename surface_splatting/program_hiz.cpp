@@ -0,0 +1,102 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "program_hiz.hpp"
+
+#include <iostream>
+#include <cstdlib>
+
+extern unsigned char const hiz_vs_glsl[];
+extern unsigned char const hiz_fs_glsl[];
+
+ProgramHiZ::ProgramHiZ(bool first_level)
+    : m_first_level(first_level), m_multisampling(false),
+      m_source_level_location(-1), m_source_offset_location(-1),
+      m_source_size_location(-1)
+{
+    initialize_shader_obj();
+    initialize_program_obj();
+}
+
+void
+ProgramHiZ::set_multisampling(bool enable)
+{
+    if (m_multisampling != enable)
+    {
+        m_multisampling = enable;
+        initialize_program_obj();
+    }
+}
+
+void
+ProgramHiZ::set_source(GLint level, GLint const* offset, GLint const* size)
+{
+    glUniform1i(m_source_level_location, level);
+    glUniform2iv(m_source_offset_location, 1, offset);
+    glUniform2iv(m_source_size_location, 1, size);
+}
+
+void
+ProgramHiZ::initialize_shader_obj()
+{
+    m_hiz_vs_obj.load_from_cstr(
+        reinterpret_cast<char const*>(hiz_vs_glsl));
+    m_hiz_fs_obj.load_from_cstr(
+        reinterpret_cast<char const*>(hiz_fs_glsl));
+
+    attach_shader(m_hiz_vs_obj);
+    attach_shader(m_hiz_fs_obj);
+}
+
+void
+ProgramHiZ::initialize_program_obj()
+{
+    try
+    {
+        std::map<std::string, int> defines;
+        defines.insert(std::make_pair("FIRST_LEVEL",
+            m_first_level ? 1 : 0));
+        defines.insert(std::make_pair("MULTISAMPLING",
+            m_multisampling ? 1 : 0));
+
+        m_hiz_vs_obj.compile(defines);
+        m_hiz_fs_obj.compile(defines);
+    }
+    catch (shader_compilation_error const& e)
+    {
+        std::cerr << "Error: A shader failed to compile." << std::endl
+            << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    try
+    {
+        link();
+    }
+    catch (shader_link_error const& e)
+    {
+        std::cerr << "Error: A program failed to link." << std::endl
+            << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    m_source_level_location = glGetUniformLocation(m_program_obj,
+        "source_level");
+    m_source_offset_location = glGetUniformLocation(m_program_obj,
+        "source_offset");
+    m_source_size_location = glGetUniformLocation(m_program_obj,
+        "source_size");
+}
@@ -0,0 +1,49 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef PROGRAM_HIZ_HPP
+#define PROGRAM_HIZ_HPP
+
+#include <GLviz>
+
+// Reduces 2 x 2 texels of a depth texture, or of one level of the depth
+// pyramid, to their farthest depth.
+class ProgramHiZ : public glProgram
+{
+
+public:
+    // The first level reads the depth attachment of the framebuffer.
+    explicit ProgramHiZ(bool first_level = false);
+
+    void set_multisampling(bool enable);
+
+    // Region of the source level to be reduced, in texels.
+    void set_source(GLint level, GLint const* offset, GLint const* size);
+
+private:
+    void initialize_shader_obj();
+    void initialize_program_obj();
+
+private:
+    glVertexShader   m_hiz_vs_obj;
+    glFragmentShader m_hiz_fs_obj;
+
+    bool m_first_level, m_multisampling;
+    GLint m_source_level_location, m_source_offset_location,
+          m_source_size_location;
+};
+
+#endif // PROGRAM_HIZ_HPP
@@ -0,0 +1,49 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef PROGRAM_PREPASS_HPP
+#define PROGRAM_PREPASS_HPP
+
+#include <GLviz>
+
+// Bounds, culls and lights every splat once per frame with the vertex
+// shader of ProgramAttribute and captures the survivors into a
+// SplatFeedback, from which both raster passes draw.
+class ProgramPrepass : public glProgram
+{
+
+public:
+    ProgramPrepass();
+
+    void set_pointsize_method(unsigned int pointsize_method);
+    void set_backface_culling(bool enable = true);
+    void set_smooth(bool enable = true);
+    void set_color_material(bool enable = true);
+    void set_vertex_format(unsigned int vertex_format);
+
+private:
+    void initialize_shader_obj();
+    void initialize_program_obj();
+
+private:
+    glVertexShader m_attribute_vs_obj, m_lighting_vs_obj;
+    glGeometryShader m_prepass_gs_obj;
+
+    bool m_backface_culling, m_smooth, m_color_material;
+    unsigned int m_pointsize_method, m_vertex_format;
+};
+
+#endif // PROGRAM_PREPASS_HPP
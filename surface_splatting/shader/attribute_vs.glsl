@@ -23,6 +23,8 @@
 #define COLOR_MATERIAL     0
 #define EWA_FILTER         0
 #define POINTSIZE_METHOD   0
+#define VERTEX_FORMAT      0
+#define BATCHED            0
 
 layout(std140, column_major) uniform Camera
 {
@@ -51,14 +53,39 @@ layout(std140) uniform Parameter
     float epsilon;
 };
 
-#define ATTR_CENTER 0
-layout(location = ATTR_CENTER) in vec3 c;
+#if VERTEX_FORMAT == 2
+    // SurfelBuffer columns, see surfel_buffer.hpp.
+    #define ATTR_CENTER_X 0
+    layout(location = ATTR_CENTER_X) in float cx;
 
-#define ATTR_T1 1
-layout(location = ATTR_T1) in vec3 u;
+    #define ATTR_CENTER_Y 5
+    layout(location = ATTR_CENTER_Y) in float cy;
 
-#define ATTR_T2 2
-layout(location = ATTR_T2) in vec3 v;
+    #define ATTR_CENTER_Z 6
+    layout(location = ATTR_CENTER_Z) in float cz;
+
+    vec3 c;
+#else
+    #define ATTR_CENTER 0
+    layout(location = ATTR_CENTER) in vec3 c;
+#endif
+
+#if VERTEX_FORMAT == 0 || VERTEX_FORMAT == 2 || VERTEX_FORMAT == 3
+    #define ATTR_T1 1
+    layout(location = ATTR_T1) in vec3 u;
+
+    #define ATTR_T2 2
+    layout(location = ATTR_T2) in vec3 v;
+#elif VERTEX_FORMAT == 1
+    // PackedSurfel, see packed_surfel.cpp.
+    #define ATTR_FRAME 1
+    layout(location = ATTR_FRAME) in uint frame;
+
+    #define ATTR_RADII 2
+    layout(location = ATTR_RADII) in vec2 radii;
+
+    vec3 u, v;
+#endif
 
 #define ATTR_PLANE 3
 layout(location = ATTR_PLANE) in vec3 p;
@@ -66,6 +93,23 @@ layout(location = ATTR_PLANE) in vec3 p;
 #define ATTR_COLOR 4
 layout(location = ATTR_COLOR) in vec4 rgba;
 
+#if VERTEX_FORMAT == 3
+    // Splats that passed the pre-pass, see prepass_gs.glsl. Centers and
+    // tangents are in eye space already, the color is lit.
+    #define ATTR_SCREEN_POSITION 5
+    layout(location = ATTR_SCREEN_POSITION) in vec4 p_scr;
+
+    #define ATTR_POINT_SIZE 6
+    layout(location = ATTR_POINT_SIZE) in float point_size;
+#endif
+
+#if BATCHED
+    // Object to scene transforms, four texels per matrix. A negative base
+    // draws without transform.
+    uniform samplerBuffer instance_transforms;
+    uniform int instance_base;
+#endif
+
 out block
 {
     flat out vec3 c_eye;
@@ -87,6 +131,60 @@ Out;
     vec3 lighting(vec3 n_eye, vec3 v_eye, vec3 color, float shininess);
 #endif
 
+#if VERTEX_FORMAT == 1
+float
+snorm10(uint bits)
+{
+    return max(-1.0, float(int(bits << 22u) >> 22) / 511.0);
+}
+
+void
+unpack_tangents()
+{
+    vec2 o = vec2(snorm10(frame), snorm10(frame >> 10u));
+    vec3 n = vec3(o, 1.0 - abs(o.x) - abs(o.y));
+
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(o.yx)) * vec2(
+            o.x >= 0.0 ? 1.0 : -1.0, o.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    n = normalize(n);
+
+    // Orthonormal basis of the tangent plane (Duff et al. 2017).
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+
+    vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);
+
+    float angle = float(frame >> 20u) * (6.28318530718 / 4096.0);
+    vec3 t = cos(angle) * b1 + sin(angle) * b2;
+
+    u = radii.x * t;
+    v = radii.y * cross(n, t);
+}
+#endif
+
+#if BATCHED
+mat4
+instance_matrix()
+{
+    if (instance_base < 0)
+    {
+        return mat4(1.0);
+    }
+
+    int i = 4 * (instance_base + gl_InstanceID);
+    return mat4(texelFetch(instance_transforms, i),
+        texelFetch(instance_transforms, i + 1),
+        texelFetch(instance_transforms, i + 2),
+        texelFetch(instance_transforms, i + 3));
+}
+#endif
+
 void
 intersect(in vec4 v1, in vec4 v2, in int p,
           out int n_pts, out vec4[2] pts)
@@ -330,10 +428,45 @@ pointsprite(in vec3 c, in vec3 u, in vec3 v,
 
 void main()
 {
+#if VERTEX_FORMAT == 3
+    gl_Position = p_scr;
+
+    Out.c_eye = c;
+    Out.u_eye = u;
+    Out.v_eye = v;
+    Out.p = p;
+    Out.n_eye = normalize(cross(u, v));
+
+    #if !VISIBILITY_PASS
+        Out.color = vec3(rgba);
+
+        #if EWA_FILTER
+            Out.c_scr = vec2((p_scr.xy + 1.0) * viewport.zw * 0.5);
+            gl_PointSize = max(2.0, point_size);
+        #else
+            gl_PointSize = point_size;
+        #endif
+    #else
+        gl_PointSize = point_size;
+    #endif
+#else
+#if VERTEX_FORMAT == 1
+    unpack_tangents();
+#elif VERTEX_FORMAT == 2
+    c = vec3(cx, cy, cz);
+#endif
+
+#if BATCHED
+    mat4 instance = instance_matrix();
+    vec4 c_moved = instance * vec4(c, 1.0) - vec4(model_offset[0], model_offset[1], model_offset[2], 0.0);
+    mat3 tangent_matrix = mat3(modelview_matrix) * mat3(instance);
+#else
     vec4 c_moved = vec4(c, 1.0) - vec4(model_offset[0], model_offset[1], model_offset[2], 0.0);
+    mat3 tangent_matrix = mat3(modelview_matrix);
+#endif
     vec4 c_eye = modelview_matrix * c_moved;
-    vec3 u_eye = radius_scale * mat3(modelview_matrix) * u;
-    vec3 v_eye = radius_scale * mat3(modelview_matrix) * v;
+    vec3 u_eye = radius_scale * tangent_matrix * u;
+    vec3 v_eye = radius_scale * tangent_matrix * v;
     vec3 n_eye = normalize(cross(u_eye, v_eye));
 
     vec4 p_scr;
@@ -391,4 +524,5 @@ void main()
         gl_Position = vec4(1.0, 0.0, 0.0, 0.0);
     }
 #endif
+#endif
 }
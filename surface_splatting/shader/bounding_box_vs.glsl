@@ -0,0 +1,38 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#version 330
+
+layout(std140, column_major) uniform Camera
+{
+    mat4 modelview_matrix;
+    mat4 projection_matrix;
+    vec3 model_offset;
+};
+
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+void main()
+{
+    // Triangle strip of 14 vertices around the unit cube.
+    int b = 1 << gl_VertexID;
+    vec3 t = vec3((0x287a & b) != 0, (0x02af & b) != 0, (0x31e3 & b) != 0);
+
+    vec3 p = mix(box_min, box_max, t) - model_offset;
+    gl_Position = projection_matrix * (modelview_matrix * vec4(p, 1.0));
+}
@@ -0,0 +1,83 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#version 330
+
+#define FIRST_LEVEL        0
+#define MULTISAMPLING      0
+
+// The first level reduces the depth attachment of the framebuffer, the
+// others the previous level of the pyramid.
+#if FIRST_LEVEL && MULTISAMPLING
+uniform sampler2DMS source;
+#else
+uniform sampler2D source;
+#endif
+
+uniform int source_level;
+uniform ivec2 source_offset;
+uniform ivec2 source_size;
+
+layout(location = 0) out float depth;
+
+float fetch(ivec2 p)
+{
+    p = source_offset + clamp(p, ivec2(0), source_size - 1);
+
+#if FIRST_LEVEL && MULTISAMPLING
+    // Samples of the framebuffer, see framebuffer.cpp.
+    float d = texelFetch(source, p, 0).r;
+    for (int i = 1; i < 4; ++i)
+    {
+        d = max(d, texelFetch(source, p, i).r);
+    }
+
+    return d;
+#else
+    return texelFetch(source, p, source_level).r;
+#endif
+}
+
+void main()
+{
+    ivec2 p = 2 * ivec2(gl_FragCoord.xy);
+
+    float d = max(max(fetch(p), fetch(p + ivec2(1, 0))),
+        max(fetch(p + ivec2(0, 1)), fetch(p + ivec2(1, 1))));
+
+    // The last row and column of an odd sized level fold into their
+    // neighbors.
+    bool extra_x = (source_size.x & 1) == 1 && p.x == source_size.x - 3;
+    bool extra_y = (source_size.y & 1) == 1 && p.y == source_size.y - 3;
+
+    if (extra_x)
+    {
+        d = max(d, max(fetch(p + ivec2(2, 0)), fetch(p + ivec2(2, 1))));
+    }
+
+    if (extra_y)
+    {
+        d = max(d, max(fetch(p + ivec2(0, 2)), fetch(p + ivec2(1, 2))));
+    }
+
+    if (extra_x && extra_y)
+    {
+        d = max(d, fetch(p + ivec2(2, 2)));
+    }
+
+    depth = d;
+}
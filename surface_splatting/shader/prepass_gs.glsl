@@ -0,0 +1,79 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#version 330
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+layout(std140, column_major) uniform Raycast
+{
+    mat4 projection_matrix_inv;
+    vec4 viewport;
+};
+
+// Written by attribute_vs.glsl with VISIBILITY_PASS and EWA_FILTER off.
+in block
+{
+    flat in vec3 c_eye;
+    flat in vec3 u_eye;
+    flat in vec3 v_eye;
+    flat in vec3 p;
+    flat in vec3 n_eye;
+    flat in vec3 color;
+}
+In[];
+
+// Captured by transform feedback, see FeedbackSplat in splat_feedback.hpp
+// and VERTEX_FORMAT 3 in attribute_vs.glsl.
+out vec4 p_scr;
+out float point_size;
+out vec3 c;
+out vec3 u;
+out vec3 v;
+out vec3 p;
+out vec3 color;
+
+void main()
+{
+    vec4 position = gl_in[0].gl_Position;
+
+    // Splats dropped by pointsprite() or by backface culling have w = 0,
+    // the rest is tested against the clip volume the rasterizer would
+    // clip the point sprite with.
+    if (position.w <= 0.0 || abs(position.z) > position.w)
+    {
+        return;
+    }
+
+    vec2 extent = gl_in[0].gl_PointSize / viewport.zw;
+    if (any(greaterThan(abs(position.xy / position.w) - extent,
+        vec2(1.0))))
+    {
+        return;
+    }
+
+    p_scr = position;
+    point_size = gl_in[0].gl_PointSize;
+    c = In[0].c_eye;
+    u = In[0].u_eye;
+    v = In[0].v_eye;
+    p = In[0].p;
+    color = In[0].color;
+
+    EmitVertex();
+}
@@ -0,0 +1,178 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "splat_feedback.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace
+{
+
+void
+feedback_attribute(GLuint index, GLint size, std::size_t offset)
+{
+    glEnableVertexAttribArray(index);
+    glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE,
+        sizeof(FeedbackSplat), reinterpret_cast<const GLbyte*>(0) + offset);
+}
+
+}
+
+SplatFeedback::SplatFeedback()
+    : m_feedback(0), m_buffer(0), m_vao(0), m_query(0), m_capacity(0),
+      m_native(GLAD_GL_VERSION_4_0 || GLAD_GL_ARB_transform_feedback2),
+      m_captured(false)
+{
+    if (m_native)
+    {
+        glGenTransformFeedbacks(1, &m_feedback);
+    }
+    else
+    {
+        glGenQueries(1, &m_query);
+    }
+
+    glGenBuffers(1, &m_buffer);
+    glGenVertexArrays(1, &m_vao);
+
+    // The attributes stay valid when reserve() reallocates the storage
+    // under the same name.
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    feedback_attribute(0, 3, offsetof(FeedbackSplat, c));
+    feedback_attribute(1, 3, offsetof(FeedbackSplat, u));
+    feedback_attribute(2, 3, offsetof(FeedbackSplat, v));
+    feedback_attribute(3, 3, offsetof(FeedbackSplat, p));
+    feedback_attribute(4, 3, offsetof(FeedbackSplat, color));
+    feedback_attribute(5, 4, offsetof(FeedbackSplat, p_scr));
+    feedback_attribute(6, 1, offsetof(FeedbackSplat, point_size));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+SplatFeedback::~SplatFeedback()
+{
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_buffer);
+
+    if (m_native)
+    {
+        glDeleteTransformFeedbacks(1, &m_feedback);
+    }
+    else
+    {
+        glDeleteQueries(1, &m_query);
+    }
+}
+
+void
+SplatFeedback::begin(GLsizei capacity)
+{
+    reserve(capacity);
+
+    if (m_native)
+    {
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_feedback);
+    }
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffer);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    if (!m_native)
+    {
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, m_query);
+    }
+
+    glBeginTransformFeedback(GL_POINTS);
+}
+
+void
+SplatFeedback::end()
+{
+    glEndTransformFeedback();
+
+    if (m_native)
+    {
+        // The object keeps the buffer binding along with the count.
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    }
+    else
+    {
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    m_captured = true;
+}
+
+void
+SplatFeedback::draw()
+{
+    if (!m_captured)
+    {
+        return;
+    }
+
+    glBindVertexArray(m_vao);
+
+    if (m_native)
+    {
+        glDrawTransformFeedback(GL_POINTS, m_feedback);
+    }
+    else
+    {
+        // Stalls until the pre-pass has finished.
+        GLuint count(0);
+        glGetQueryObjectuiv(m_query, GL_QUERY_RESULT, &count);
+
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    }
+
+    glBindVertexArray(0);
+}
+
+void
+SplatFeedback::clear()
+{
+    m_captured = false;
+}
+
+bool
+SplatFeedback::captured() const
+{
+    return m_captured;
+}
+
+void
+SplatFeedback::reserve(GLsizei capacity)
+{
+    if (capacity <= m_capacity)
+    {
+        return;
+    }
+
+    m_capacity = std::max(capacity, m_capacity + m_capacity / 2);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_capacity)
+        * sizeof(FeedbackSplat), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
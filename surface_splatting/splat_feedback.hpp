@@ -0,0 +1,65 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef SPLAT_FEEDBACK_HPP
+#define SPLAT_FEEDBACK_HPP
+
+#include <glad/glad.h>
+
+// Splat captured by the pre-pass, in the order of the varyings of
+// prepass_gs.glsl. Centers and tangents are in eye space, the color is lit.
+struct FeedbackSplat
+{
+    float p_scr[4];
+    float point_size;
+    float c[3], u[3], v[3], p[3];
+    float color[3];
+};
+
+// Transform feedback buffer holding the splats that survived the
+// pre-pass, drawn as VERTEX_FORMAT 3 of attribute_vs.glsl. With OpenGL 4.0
+// or GL_ARB_transform_feedback2 the number of splats never leaves the GPU,
+// otherwise it is read back from a query before drawing.
+class SplatFeedback
+{
+
+public:
+    SplatFeedback();
+    ~SplatFeedback();
+
+    // Starts capturing up to capacity splats with rasterization turned
+    // off. Points drawn until end() go through the pre-pass.
+    void begin(GLsizei capacity);
+    void end();
+
+    // Draws the splats captured by the last begin() and end(), if any.
+    void draw();
+
+    // Forgets the last capture, draw() does nothing until the next one.
+    void clear();
+
+    bool captured() const;
+
+private:
+    void reserve(GLsizei capacity);
+
+private:
+    GLuint m_feedback, m_buffer, m_vao, m_query;
+    GLsizei m_capacity;
+    bool m_native, m_captured;
+};
+
+#endif // SPLAT_FEEDBACK_HPP
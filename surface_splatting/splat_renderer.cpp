@@ -16,11 +16,13 @@
 // along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
 
 #include "splat_renderer.hpp"
+#include "circumellipse.hpp"
 
 #include <GLviz>
 
 
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 
 using namespace Eigen;
@@ -83,14 +85,28 @@ UniformBufferParameter::set_buffer_data(Vector3f const& color, float shininess,
 
 
 SplatRenderer::SplatRenderer(GLviz::Camera const& camera)
-    : m_camera(camera),
+    : m_camera(camera), m_num_pts(0), m_uploaded_bytes(0),
+      m_stream(sizeof(Surfel)), m_stream_vbo(0),
+      m_dirty_fraction_threshold(0.25f), m_uploaded_pts(0),
+      m_batch_format(0), m_batches_changed(false), m_instances_changed(false),
       m_soft_zbuffer(true), m_backface_culling(false), m_smooth(false),
       m_color_material(true), m_ewa_filter(false), m_multisample(false),
+      m_streaming(false), m_upload_pending(true), m_packed_format(false),
+      m_clipped(false), m_frustum_culling(false), m_occlusion_culling(false),
+      m_transform_feedback(false),
       m_pointsize_method(2),
       m_color(Vector3f(0.0, 0.25f, 1.0f)),
       m_epsilon(5.0f * 1e-3f), m_shininess(8.0f), m_radius_scale(1.0f),
       m_ewa_radius(1.0f),
-      is_custom_viewport(false)
+      is_custom_viewport(false),
+      m_geometry(nullptr), m_async_geometry(nullptr),
+      m_spatial_reordering(false), m_curve(MortonCurve),
+      m_reordered_geometry(nullptr), m_surfel_buffer(nullptr),
+      m_external(nullptr), m_external_count(0), m_external_layout(false),
+      m_released_vao(0),
+      m_chunk_cache(nullptr), m_chunk_vao(0), m_lod(nullptr),
+      m_num_visible(0), m_box_vao(0), m_occlusion_queried(false),
+      m_num_occluded(0)
 {
     m_uniform_camera.bind_buffer_base(0);
     m_uniform_raycast.bind_buffer_base(1);
@@ -105,14 +121,35 @@ SplatRenderer::SplatRenderer(GLviz::Camera const& camera)
 
 SplatRenderer::~SplatRenderer()
 {
+    // Joins the worker, which deletes buffers not handed over yet.
+    m_uploader.reset();
+
+    release_external();
+
     glDeleteVertexArrays(1, &m_vao);
     glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_plane_vbo);
+    glDeleteVertexArrays(1, &m_stream_vao);
+    glDeleteVertexArrays(1, &m_chunk_vao);
+
+    glDeleteVertexArrays(1, &m_batch_vao);
+    glDeleteBuffers(1, &m_batch_vbo);
+    glDeleteBuffers(1, &m_batch_plane_vbo);
+    glDeleteTextures(1, &m_instance_texture);
+    glDeleteBuffers(1, &m_instance_buffer);
 
     glDeleteBuffers(1, &m_rect_vertices_vbo);
     glDeleteBuffers(1, &m_rect_texture_uv_vbo);
     glDeleteVertexArrays(1, &m_rect_vao);
 
     glDeleteTextures(1, &m_filter_kernel);
+
+    glDeleteVertexArrays(1, &m_box_vao);
+    if (!m_occlusion_queries.empty())
+    {
+        glDeleteQueries(static_cast<GLsizei>(m_occlusion_queries.size()),
+            m_occlusion_queries.data());
+    }
 }
 
 void
@@ -203,38 +240,217 @@ void
 SplatRenderer::setup_vertex_array_buffer_object()
 {
     glGenBuffers(1, &m_vbo);
+    glGenBuffers(1, &m_plane_vbo);
 
     glGenVertexArrays(1, &m_vao);
     glBindVertexArray(m_vao);
-
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    setup_vertex_attributes();
+    glBindVertexArray(0);
+
+    // The stream buffer is allocated on first use, its vertex array object
+    // is pointed at it in upload_geometry().
+    glGenVertexArrays(1, &m_stream_vao);
+
+    // Pointed at the buffers of a chunk cache in setup_chunk_attributes().
+    glGenVertexArrays(1, &m_chunk_vao);
+
+    glGenBuffers(1, &m_batch_vbo);
+    glGenBuffers(1, &m_batch_plane_vbo);
+    glGenVertexArrays(1, &m_batch_vao);
+
+    glGenBuffers(1, &m_instance_buffer);
+    glGenTextures(1, &m_instance_texture);
+}
+
+void
+SplatRenderer::setup_vertex_attributes()
+{
+    if (m_surfel_buffer)
+    {
+        SurfelBuffer const& buffer = *m_surfel_buffer;
+
+        // Center c, one column per coordinate.
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::CenterX));
+
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::CenterY));
+
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::CenterZ));
+
+        // Tangent vectors u and v.
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::TangentU));
+
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::TangentV));
+
+        // Clipping plane p.
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::ClipPlane));
+
+        // Color rgba.
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0,
+            reinterpret_cast<const GLbyte*>(0)
+            + buffer.column_offset(SurfelBuffer::Color));
+    }
+    else if (m_external_layout)
+    {
+        setup_surfel_attributes(m_layout, false);
+    }
+    else if (m_packed_format && !m_lod)
+    {
+        setup_packed_attributes(m_plane_vbo, m_clipped);
+    }
+    else
+    {
+        setup_surfel_attributes(SurfelLayout(), false);
+    }
+}
+
+void
+SplatRenderer::setup_surfel_attributes(SurfelLayout const& layout,
+    bool split_center)
+{
+    GLsizei stride = static_cast<GLsizei>(layout.stride);
+
+    // Center c. The SurfelBuffer vertex format reads it as three floats.
+    if (split_center)
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.c);
+
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.c + 4);
+
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.c + 8);
+    }
+    else
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.c);
+
+        glDisableVertexAttribArray(5);
+        glDisableVertexAttribArray(6);
+    }
+
+    // Tangent vector u.
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const GLbyte*>(0) + layout.u);
+
+    // Tangent vector v.
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const GLbyte*>(0) + layout.v);
+
+    // Clipping plane p, zero never clips.
+    if (layout.p != SurfelLayout::none)
+    {
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.p);
+    }
+    else
+    {
+        glDisableVertexAttribArray(3);
+        glVertexAttrib3f(3, 0.0f, 0.0f, 0.0f);
+    }
+
+    // Color rgba, white if omitted.
+    if (layout.rgba != SurfelLayout::none)
+    {
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+            reinterpret_cast<const GLbyte*>(0) + layout.rgba);
+    }
+    else
+    {
+        glDisableVertexAttribArray(4);
+        glVertexAttrib4f(4, 1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
+
+void
+SplatRenderer::setup_chunk_attributes()
+{
+    glBindVertexArray(m_chunk_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_chunk_cache->vertex_buffer());
+
+    // The plane stream of a packed cache is always present.
+    if (m_chunk_cache->packed())
+    {
+        setup_packed_attributes(m_chunk_cache->plane_buffer(), true);
+    }
+    else
+    {
+        setup_surfel_attributes(SurfelLayout(), false);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void
+SplatRenderer::setup_packed_attributes(GLuint plane_vbo, bool clipped)
+{
+    glDisableVertexAttribArray(5);
+    glDisableVertexAttribArray(6);
 
     // Center c.
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-        sizeof(Surfel), reinterpret_cast<const GLfloat*>(0));
+        sizeof(PackedSurfel), reinterpret_cast<const GLfloat*>(0));
 
-    // Tagent vector u.
+    // Normal and tangent angle.
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-        sizeof(Surfel), reinterpret_cast<const GLfloat*>(12));
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT,
+        sizeof(PackedSurfel), reinterpret_cast<const GLuint*>(12));
 
-    // Tangent vector v.
+    // Lengths of u and v.
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,
-        sizeof(Surfel), reinterpret_cast<const GLfloat*>(24));
-
-    // Clipping plane p.
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE,
-        sizeof(Surfel), reinterpret_cast<const GLfloat*>(36));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE,
+        sizeof(PackedSurfel), reinterpret_cast<const GLbyte*>(16));
 
     // Color rgba.
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE,
-        sizeof(Surfel), reinterpret_cast<const GLbyte*>(48));
+        sizeof(PackedSurfel), reinterpret_cast<const GLbyte*>(20));
 
-    glBindVertexArray(0);
+    // Clipping plane p. Without a plane stream the attribute defaults
+    // to zero, which never clips.
+    if (clipped)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, plane_vbo);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+            sizeof(GLuint), reinterpret_cast<const GLuint*>(0));
+    }
+    else
+    {
+        glDisableVertexAttribArray(3);
+        glVertexAttrib3f(3, 0.0f, 0.0f, 0.0f);
+    }
 }
 
 bool
@@ -253,14 +469,27 @@ SplatRenderer::set_smooth(bool enable)
         m_attribute.set_smooth(enable);
         m_finalization.set_smooth(enable);
 
+        if (m_transform_feedback)
+        {
+            m_prepass->set_smooth(enable);
+            m_feedback_attribute->set_smooth(enable);
+        }
+
+        // Occlusion culling keeps the depth texture.
         if (m_smooth)
         {
-            m_fbo.enable_depth_texture();
+            if (!m_occlusion_culling)
+            {
+                m_fbo.enable_depth_texture();
+            }
             m_fbo.attach_normal_texture();
         }
         else
         {
-            m_fbo.disable_depth_texture();
+            if (!m_occlusion_culling)
+            {
+                m_fbo.disable_depth_texture();
+            }
             m_fbo.detach_normal_texture();
         }
     }
@@ -279,6 +508,11 @@ SplatRenderer::set_color_material(bool enable)
     {
         m_color_material = enable;
         m_attribute.set_color_material(enable);
+
+        if (m_transform_feedback)
+        {
+            m_prepass->set_color_material(enable);
+        }
     }
 }
 
@@ -296,6 +530,13 @@ SplatRenderer::set_backface_culling(bool enable)
         m_backface_culling = enable;
         m_visibility.set_backface_culling(enable);
         m_attribute.set_backface_culling(enable);
+
+        if (m_transform_feedback)
+        {
+            m_prepass->set_backface_culling(enable);
+        }
+
+        update_chunk_culling();
     }
 }
 
@@ -346,6 +587,11 @@ SplatRenderer::set_pointsize_method(unsigned int pointsize_method)
         m_pointsize_method = pointsize_method;
         m_visibility.set_pointsize_method(pointsize_method);
         m_attribute.set_pointsize_method(pointsize_method);
+
+        if (m_transform_feedback)
+        {
+            m_prepass->set_pointsize_method(pointsize_method);
+        }
     }
 }
 
@@ -362,6 +608,11 @@ SplatRenderer::set_ewa_filter(bool enable)
     {
         m_ewa_filter = enable;
         m_attribute.set_ewa_filter(enable);
+
+        if (m_transform_feedback)
+        {
+            m_feedback_attribute->set_ewa_filter(enable);
+        }
     }
 }
 
@@ -379,6 +630,227 @@ SplatRenderer::set_multisample(bool enable)
         m_multisample = enable;
         m_finalization.set_multisampling(enable);
         m_fbo.set_multisample(enable);
+
+        // The framebuffer brings back the depth texture for smooth shading
+        // only.
+        if (m_occlusion_culling && !m_smooth)
+        {
+            m_fbo.enable_depth_texture();
+        }
+    }
+}
+
+bool
+SplatRenderer::streaming() const
+{
+    return m_streaming;
+}
+
+void
+SplatRenderer::set_streaming(bool enable)
+{
+    if (m_streaming != enable)
+    {
+        m_streaming = enable;
+        m_upload_pending = true;
+    }
+}
+
+bool
+SplatRenderer::spatial_reordering() const
+{
+    return m_spatial_reordering;
+}
+
+void
+SplatRenderer::set_spatial_reordering(bool enable, SpaceFillingCurve curve)
+{
+    if (m_spatial_reordering != enable || m_curve != curve)
+    {
+        m_spatial_reordering = enable;
+        m_curve = curve;
+
+        // Reorder the current geometry on the next set_geometry() call.
+        m_reordered_geometry = nullptr;
+        m_permutation.clear();
+    }
+}
+
+std::vector<unsigned int> const&
+SplatRenderer::geometry_permutation() const
+{
+    return m_permutation;
+}
+
+bool
+SplatRenderer::packed_format() const
+{
+    return m_packed_format;
+}
+
+void
+SplatRenderer::set_packed_format(bool enable)
+{
+    if (m_packed_format != enable)
+    {
+        m_packed_format = enable;
+        update_vertex_format();
+        m_upload_pending = true;
+    }
+}
+
+std::size_t
+SplatRenderer::uploaded_bytes() const
+{
+    return m_uploaded_bytes;
+}
+
+bool
+SplatRenderer::frustum_culling() const
+{
+    return m_frustum_culling;
+}
+
+void
+SplatRenderer::set_frustum_culling(bool enable)
+{
+    if (m_frustum_culling != enable)
+    {
+        m_frustum_culling = enable;
+        update_chunk_culling();
+    }
+}
+
+bool
+SplatRenderer::occlusion_culling() const
+{
+    return m_occlusion_culling;
+}
+
+void
+SplatRenderer::set_occlusion_culling(bool enable)
+{
+    if (m_occlusion_culling != enable)
+    {
+        m_occlusion_culling = enable;
+
+        // The pyramid is reduced from the depth attachment, which smooth
+        // shading turns into a texture already.
+        if (!m_smooth)
+        {
+            if (enable)
+            {
+                m_fbo.enable_depth_texture();
+            }
+            else
+            {
+                m_fbo.disable_depth_texture();
+            }
+        }
+
+        if (enable)
+        {
+            m_hiz.reset(new HiZBuffer());
+            m_bounding_box.reset(new ProgramBoundingBox());
+            glGenVertexArrays(1, &m_box_vao);
+        }
+        else
+        {
+            m_hiz.reset();
+            m_bounding_box.reset();
+            glDeleteVertexArrays(1, &m_box_vao);
+            m_box_vao = 0;
+
+            m_occluded.clear();
+            m_num_occluded = 0;
+        }
+
+        update_chunk_culling();
+    }
+}
+
+bool
+SplatRenderer::transform_feedback() const
+{
+    return m_transform_feedback;
+}
+
+void
+SplatRenderer::set_transform_feedback(bool enable)
+{
+    if (m_transform_feedback != enable)
+    {
+        m_transform_feedback = enable;
+
+        if (enable)
+        {
+            m_prepass.reset(new ProgramPrepass());
+            m_prepass->set_pointsize_method(m_pointsize_method);
+            m_prepass->set_backface_culling(m_backface_culling);
+            m_prepass->set_smooth(m_smooth);
+            m_prepass->set_color_material(m_color_material);
+            m_prepass->set_vertex_format(vertex_format());
+
+            // Both read the splats as captured, bounded and lit already.
+            m_feedback_visibility.reset(new ProgramAttribute());
+            m_feedback_visibility->set_vertex_format(3);
+
+            m_feedback_attribute.reset(new ProgramAttribute());
+            m_feedback_attribute->set_visibility_pass(false);
+            m_feedback_attribute->set_vertex_format(3);
+            m_feedback_attribute->set_ewa_filter(m_ewa_filter);
+            m_feedback_attribute->set_smooth(m_smooth);
+
+            m_feedback.reset(new SplatFeedback());
+        }
+        else
+        {
+            m_prepass.reset();
+            m_feedback_visibility.reset();
+            m_feedback_attribute.reset();
+            m_feedback.reset();
+        }
+    }
+}
+
+std::size_t
+SplatRenderer::num_visible_surfels() const
+{
+    return m_num_visible;
+}
+
+std::size_t
+SplatRenderer::num_occluded_surfels() const
+{
+    return m_num_occluded;
+}
+
+unsigned int
+SplatRenderer::vertex_format() const
+{
+    if (m_chunk_cache)
+    {
+        return m_chunk_cache->packed() ? 1 : 0;
+    }
+
+    if (m_lod)
+    {
+        return 0;
+    }
+
+    return m_surfel_buffer ? 2
+        : (m_packed_format && !m_external_layout ? 1 : 0);
+}
+
+void
+SplatRenderer::update_vertex_format()
+{
+    m_visibility.set_vertex_format(vertex_format());
+    m_attribute.set_vertex_format(vertex_format());
+
+    if (m_transform_feedback)
+    {
+        m_prepass->set_vertex_format(vertex_format());
     }
 }
 
@@ -452,6 +924,24 @@ void SplatRenderer::computerPrincipalDirections(float const * vertex1_ptr, float
     steiner_circumellipse(vertex1_ptr, vertex2_ptr, vertex3_ptr, ellipsis_center_ptr, ellipsis_principal_direction_1_ptr, ellipsis_principal_direction_2_ptr);
 }
 
+void
+SplatRenderer::computePrincipalDirectionsBatch(
+    std::vector<Vector3f> const& vertices,
+    std::vector<std::array<unsigned int, 3> > const& faces,
+    std::vector<Surfel>& surfels)
+{
+    static_assert(sizeof(std::array<unsigned int, 3>)
+        == 3 * sizeof(unsigned int), "faces must be tightly packed");
+
+    surfels.resize(faces.size());
+
+    if (!faces.empty())
+    {
+        steiner_circumellipses(vertices.data(), faces.front().data(),
+            faces.size(), surfels.data());
+    }
+}
+
 void
 SplatRenderer::setup_uniforms(glProgram& program)
 {
@@ -510,7 +1000,7 @@ SplatRenderer::render_pass(bool depth_only)
         glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
     }
 
-    glProgram &program = depth_only ? m_visibility : m_attribute;
+    ProgramAttribute &program = depth_only ? m_visibility : m_attribute;
 
     program.use();
 
@@ -539,9 +1029,32 @@ SplatRenderer::render_pass(bool depth_only)
         program.set_uniform_1i("filter_kernel", 1);
     }
 
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_POINTS, 0, m_num_pts);
-    glBindVertexArray(0);
+    if (!m_batches.empty())
+    {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_BUFFER, m_instance_texture);
+
+        program.set_uniform_1i("instance_transforms", 2);
+    }
+
+    if (m_transform_feedback)
+    {
+        ProgramAttribute& splats = depth_only ? *m_feedback_visibility
+            : *m_feedback_attribute;
+
+        splats.use();
+
+        if (!depth_only && m_soft_zbuffer && m_ewa_filter)
+        {
+            splats.set_uniform_1i("filter_kernel", 1);
+        }
+
+        m_feedback->draw();
+
+        program.use();
+    }
+
+    draw_geometry(program);
 
     program.unuse();
 
@@ -551,20 +1064,732 @@ SplatRenderer::render_pass(bool depth_only)
 }
 
 void
-SplatRenderer::steiner_circumellipse(float const* v0_ptr, float const* v1_ptr,
-    float const* v2_ptr, float* p0_ptr, float* t1_ptr, float* t2_ptr)
+SplatRenderer::upload_geometry()
 {
-    Matrix2f Q;
-    Vector3f d0, d1, d2;
+    if (m_surfel_buffer)
     {
-        const Vector3f v0 = Map<const Vector3f>(v0_ptr);
-        const Vector3f v1 = Map<const Vector3f>(v1_ptr);
-        const Vector3f v2 = Map<const Vector3f>(v2_ptr);
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, m_surfel_buffer->data_size(),
+            m_surfel_buffer->data(), GL_DYNAMIC_DRAW);
+
+        // Column offsets depend on the number of surfels.
+        setup_vertex_attributes();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        m_uploaded_pts = m_num_pts;
+        m_uploaded_bytes += m_surfel_buffer->data_size();
+        build_hierarchy();
+        return;
+    }
 
-        const Vector3f v[3] = { v0, v1, v2 };
+    if (m_external_layout)
+    {
+        if (m_streaming)
+        {
+            m_stream.set_element_size(static_cast<GLsizeiptr>(
+                m_layout.stride));
+            m_stream.upload(m_external, static_cast<GLsizei>(m_num_pts));
+            m_stream_vbo = m_stream.buffer();
 
-        d0 = v[1] - v[0];
-        d0.normalize();
+            glBindVertexArray(m_stream_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, m_stream_vbo);
+        }
+        else
+        {
+            glBindVertexArray(m_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, m_layout.stride * m_num_pts,
+                m_external, GL_DYNAMIC_DRAW);
+        }
+
+        setup_vertex_attributes();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        m_uploaded_pts = m_num_pts;
+        m_uploaded_bytes += m_layout.stride * m_num_pts;
+
+        // The caller's memory is no longer needed once it has been copied.
+        // Nothing can be uploaded again after that, so the hierarchy is
+        // built for any culling mode enabled later, and the copy is drawn
+        // from the buffer it went into.
+        if (m_release)
+        {
+            m_hierarchy.build(m_external, m_external_count, m_layout);
+            release_external();
+            m_released_vao = m_streaming ? m_stream_vao : m_vao;
+        }
+        else
+        {
+            build_hierarchy();
+        }
+
+        return;
+    }
+
+    Surfel const* surfels = &m_geometry->front();
+
+    if (m_packed_format)
+    {
+        m_clip_planes.resize(m_num_pts);
+        m_clipped = pack_clip_planes(surfels, m_num_pts,
+            m_clip_planes.data());
+    }
+
+    if (m_streaming)
+    {
+        // Packed surfels are encoded straight into the mapped slot.
+        if (m_packed_format)
+        {
+            m_stream.set_element_size(sizeof(PackedSurfel));
+            pack_surfels(surfels, m_num_pts, static_cast<PackedSurfel*>(
+                m_stream.map(static_cast<GLsizei>(m_num_pts))));
+            m_stream.unmap();
+        }
+        else
+        {
+            m_stream.set_element_size(sizeof(Surfel));
+            m_stream.upload(surfels, static_cast<GLsizei>(m_num_pts));
+        }
+
+        // The stream buffer is reallocated when it grows, the attribute
+        // layout changes with the vertex format.
+        m_stream_vbo = m_stream.buffer();
+
+        glBindVertexArray(m_stream_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_stream_vbo);
+        setup_vertex_attributes();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else
+    {
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+
+        if (m_packed_format)
+        {
+            m_packed.resize(m_num_pts);
+            pack_surfels(surfels, m_num_pts, m_packed.data());
+
+            glBufferData(GL_ARRAY_BUFFER, sizeof(PackedSurfel) * m_num_pts,
+                m_packed.data(), GL_DYNAMIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(Surfel) * m_num_pts,
+                surfels, GL_DYNAMIC_DRAW);
+        }
+
+        setup_vertex_attributes();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (m_packed_format && m_clipped)
+    {
+        // Streamed surfels are drawn from their slot of the ring, so the
+        // planes go to the same indices. The plane attribute stays at
+        // offset zero.
+        GLsizeiptr first = m_streaming ? m_stream.first() : 0;
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_plane_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * (first + m_num_pts),
+            NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLuint) * first,
+            sizeof(GLuint) * m_num_pts, m_clip_planes.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        m_uploaded_bytes += sizeof(GLuint) * m_num_pts;
+    }
+
+    m_uploaded_pts = m_num_pts;
+    m_uploaded_bytes += (m_packed_format ? sizeof(PackedSurfel)
+        : sizeof(Surfel)) * m_num_pts;
+    build_hierarchy();
+}
+
+bool
+SplatRenderer::chunk_culling() const
+{
+    return m_frustum_culling || m_backface_culling || m_occlusion_culling;
+}
+
+void
+SplatRenderer::update_chunk_culling()
+{
+    // The hierarchy is built along with the next upload. Released geometry
+    // keeps the one built before the release.
+    if (!chunk_culling() && !m_released_vao)
+    {
+        m_hierarchy.clear();
+    }
+    else if (m_hierarchy.num_chunks() == 0)
+    {
+        m_upload_pending = true;
+    }
+}
+
+GLuint
+SplatRenderer::surfel_vao() const
+{
+    if (m_released_vao)
+    {
+        return m_released_vao;
+    }
+
+    bool stream = (m_streaming && !m_surfel_buffer) || m_lod;
+    return stream ? m_stream_vao : m_vao;
+}
+
+void
+SplatRenderer::draw_surfels()
+{
+    glBindVertexArray(surfel_vao());
+
+    if (chunk_culling() && m_hierarchy.size() == m_num_pts)
+    {
+        glMultiDrawArrays(GL_POINTS, m_cull_first.data(),
+            m_cull_count.data(), static_cast<GLsizei>(m_cull_first.size()));
+    }
+    else if (surfel_vao() == m_stream_vao)
+    {
+        glDrawArrays(GL_POINTS, m_stream.first(), m_stream.count());
+    }
+    else
+    {
+        glDrawArrays(GL_POINTS, 0, m_num_pts);
+    }
+}
+
+void
+SplatRenderer::capture_splats()
+{
+    m_feedback->clear();
+
+    if (m_num_pts == 0 || m_num_visible == 0)
+    {
+        return;
+    }
+
+    m_prepass->use();
+    setup_uniforms(*m_prepass);
+
+    // At most every submitted surfel survives.
+    m_feedback->begin(static_cast<GLsizei>(m_num_visible));
+    draw_surfels();
+    m_feedback->end();
+
+    glBindVertexArray(0);
+    m_prepass->unuse();
+}
+
+void
+SplatRenderer::build_hierarchy()
+{
+    if (!chunk_culling())
+    {
+        return;
+    }
+
+    if (m_surfel_buffer)
+    {
+        m_hierarchy.build(*m_surfel_buffer);
+    }
+    else if (m_external_layout)
+    {
+        m_hierarchy.build(m_external, m_external_count, m_layout);
+    }
+    else if (m_geometry)
+    {
+        m_hierarchy.build(m_geometry->data(), m_geometry->size());
+    }
+}
+
+Matrix4f
+SplatRenderer::surfel_modelview() const
+{
+    // Same transform as the vertex shader, centers are moved by the
+    // position offset before the modelview matrix is applied.
+    Matrix4f offset = Matrix4f::Identity();
+    offset.block<3, 1>(0, 3) = -m_camera.get_position_offset();
+
+    return m_camera.get_model_matrix() * m_camera.get_view_matrix()
+        * offset;
+}
+
+void
+SplatRenderer::cull_geometry()
+{
+    Matrix4f modelview = surfel_modelview();
+    Matrix4f clip = m_camera.get_projection_matrix() * modelview;
+
+    // Eye position in the coordinates of the surfels.
+    Vector4f eye = modelview.inverse().col(3);
+    Vector3f eye_position = eye.head<3>() / eye(3);
+
+    // The depth of the previous frame, once it has arrived.
+    DepthPyramid const* pyramid = nullptr;
+    if (m_occlusion_culling)
+    {
+        m_hiz->fetch();
+        pyramid = &m_hiz->pyramid();
+    }
+
+    m_num_visible = m_hierarchy.cull(clip, m_radius_scale, m_cull_first,
+        m_cull_count, m_backface_culling ? &eye_position : nullptr,
+        pyramid, m_occlusion_culling ? &m_occluded : nullptr);
+
+    m_num_occluded = 0;
+    for (std::size_t i(0); i < m_occluded.size(); ++i)
+    {
+        m_num_occluded += m_occluded[i].count;
+    }
+
+    if (surfel_vao() == m_stream_vao)
+    {
+        for (std::size_t i(0); i < m_cull_first.size(); ++i)
+        {
+            m_cull_first[i] += m_stream.first();
+        }
+
+        for (std::size_t i(0); i < m_occluded.size(); ++i)
+        {
+            m_occluded[i].first += m_stream.first();
+        }
+    }
+
+    m_occlusion_queried = false;
+}
+
+void
+SplatRenderer::query_occluded_ranges()
+{
+    GLboolean depth_mask, color_mask[4];
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_mask);
+    glGetBooleanv(GL_COLOR_WRITEMASK, color_mask);
+
+    glDepthMask(GL_FALSE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    // Boxes reaching behind the near plane are clamped instead of clipped.
+    glEnable(GL_DEPTH_CLAMP);
+
+    std::size_t num_queries = m_occlusion_queries.size();
+    if (num_queries < m_occluded.size())
+    {
+        m_occlusion_queries.resize(m_occluded.size());
+        glGenQueries(static_cast<GLsizei>(m_occluded.size() - num_queries),
+            m_occlusion_queries.data() + num_queries);
+    }
+
+    m_bounding_box->use();
+    glBindVertexArray(m_box_vao);
+
+    for (std::size_t i(0); i < m_occluded.size(); ++i)
+    {
+        m_bounding_box->set_box(m_occluded[i].min.data(),
+            m_occluded[i].max.data());
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, m_occlusion_queries[i]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+
+    glBindVertexArray(0);
+    m_bounding_box->unuse();
+
+    glDisable(GL_DEPTH_CLAMP);
+    glDepthMask(depth_mask);
+    glColorMask(color_mask[0], color_mask[1], color_mask[2], color_mask[3]);
+
+    m_occlusion_queried = true;
+}
+
+void
+SplatRenderer::draw_occluded_ranges()
+{
+    glBindVertexArray(surfel_vao());
+
+    // The GPU waits for the queries, the CPU does not.
+    for (std::size_t i(0); i < m_occluded.size(); ++i)
+    {
+        glBeginConditionalRender(m_occlusion_queries[i], GL_QUERY_WAIT);
+        glDrawArrays(GL_POINTS, m_occluded[i].first, m_occluded[i].count);
+        glEndConditionalRender();
+    }
+}
+
+void
+SplatRenderer::update_hiz()
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    m_hiz->update(m_fbo.depth_texture(), m_multisample, viewport,
+        m_camera.get_projection_matrix() * surfel_modelview());
+}
+
+void
+SplatRenderer::upload_lod()
+{
+    Matrix4f modelview = surfel_modelview();
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    m_num_pts = static_cast<unsigned int>(m_lod->select(modelview,
+        m_camera.get_projection_matrix(), static_cast<float>(viewport[3]),
+        m_radius_scale));
+
+    if (m_num_pts == 0)
+    {
+        return;
+    }
+
+    m_stream.set_element_size(sizeof(Surfel));
+    m_lod->write(static_cast<Surfel*>(m_stream.map(
+        static_cast<GLsizei>(m_num_pts))));
+    m_stream.unmap();
+    m_uploaded_bytes += sizeof(Surfel) * m_num_pts;
+
+    // The stream buffer may have been reallocated under the name of the
+    // old one, the attributes are cheap to set again.
+    m_stream_vbo = m_stream.buffer();
+
+    glBindVertexArray(m_stream_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream_vbo);
+    setup_vertex_attributes();
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void
+SplatRenderer::upload_dirty_ranges()
+{
+    // Coalesce overlapping and adjacent [first, last) ranges.
+    std::sort(m_dirty_ranges.begin(), m_dirty_ranges.end());
+
+    std::size_t n(0), num_dirty(0);
+    for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+    {
+        std::pair<std::size_t, std::size_t> range = m_dirty_ranges[i];
+        range.second = std::min<std::size_t>(range.second, m_num_pts);
+
+        if (range.first >= range.second)
+        {
+            continue;
+        }
+
+        if (n > 0 && range.first <= m_dirty_ranges[n - 1].second)
+        {
+            num_dirty += std::max(range.second, m_dirty_ranges[n - 1].second)
+                - m_dirty_ranges[n - 1].second;
+            m_dirty_ranges[n - 1].second = std::max(range.second,
+                m_dirty_ranges[n - 1].second);
+        }
+        else
+        {
+            num_dirty += range.second - range.first;
+            m_dirty_ranges[n++] = range;
+        }
+    }
+    m_dirty_ranges.resize(n);
+
+    // The slots of the stream buffer hold complete copies of the geometry,
+    // patching one of them would leave the others stale.
+    if ((m_streaming && !m_surfel_buffer) || static_cast<float>(num_dirty)
+        > m_dirty_fraction_threshold * static_cast<float>(m_num_pts))
+    {
+        upload_geometry();
+        m_dirty_ranges.clear();
+    }
+    else if (m_surfel_buffer)
+    {
+        char const* data = static_cast<char const*>(m_surfel_buffer->data());
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        for (unsigned int c(0); c < SurfelBuffer::NumColumns; ++c)
+        {
+            SurfelBuffer::Column column = static_cast<SurfelBuffer::Column>(c);
+            std::size_t offset = m_surfel_buffer->column_offset(column);
+            std::size_t size = SurfelBuffer::column_element_size(column);
+
+            for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+            {
+                std::size_t first = offset + size * m_dirty_ranges[i].first;
+                glBufferSubData(GL_ARRAY_BUFFER, first, size
+                    * (m_dirty_ranges[i].second - m_dirty_ranges[i].first),
+                    data + first);
+                m_uploaded_bytes += size
+                    * (m_dirty_ranges[i].second - m_dirty_ranges[i].first);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else if (m_external_layout)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+        {
+            std::size_t first = m_layout.stride * m_dirty_ranges[i].first;
+            glBufferSubData(GL_ARRAY_BUFFER, first, m_layout.stride
+                * (m_dirty_ranges[i].second - m_dirty_ranges[i].first),
+                m_external + first);
+            m_uploaded_bytes += m_layout.stride
+                * (m_dirty_ranges[i].second - m_dirty_ranges[i].first);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else if (m_packed_format)
+    {
+        for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+        {
+            std::size_t first = m_dirty_ranges[i].first;
+            std::size_t count = m_dirty_ranges[i].second - first;
+
+            pack_surfels(&(*m_geometry)[first], count, &m_packed[first]);
+
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(PackedSurfel) * first,
+                sizeof(PackedSurfel) * count, &m_packed[first]);
+            m_uploaded_bytes += sizeof(PackedSurfel) * count;
+
+            // A newly clipped surfel needs the plane stream enabled.
+            if (pack_clip_planes(&(*m_geometry)[first], count,
+                &m_clip_planes[first]) && !m_clipped)
+            {
+                m_upload_pending = true;
+            }
+            else if (m_clipped)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, m_plane_vbo);
+                glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLuint) * first,
+                    sizeof(GLuint) * count, &m_clip_planes[first]);
+                m_uploaded_bytes += sizeof(GLuint) * count;
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (m_upload_pending)
+        {
+            upload_geometry();
+            m_upload_pending = false;
+        }
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER,
+                sizeof(Surfel) * m_dirty_ranges[i].first,
+                sizeof(Surfel) * (m_dirty_ranges[i].second
+                    - m_dirty_ranges[i].first),
+                &(*m_geometry)[m_dirty_ranges[i].first]);
+            m_uploaded_bytes += sizeof(Surfel) * (m_dirty_ranges[i].second
+                - m_dirty_ranges[i].first);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (chunk_culling())
+    {
+        for (std::size_t i(0); i < m_dirty_ranges.size(); ++i)
+        {
+            std::size_t first = m_dirty_ranges[i].first;
+            std::size_t count = m_dirty_ranges[i].second - first;
+
+            if (m_surfel_buffer)
+            {
+                m_hierarchy.refit(*m_surfel_buffer, first, count);
+            }
+            else if (m_external_layout)
+            {
+                m_hierarchy.refit(m_external, m_layout, first, count);
+            }
+            else
+            {
+                m_hierarchy.refit(m_geometry->data(), SurfelLayout(), first,
+                    count);
+            }
+        }
+    }
+
+    m_dirty_ranges.clear();
+}
+
+void
+SplatRenderer::draw_geometry(ProgramAttribute& program)
+{
+    if (m_num_pts > 0)
+    {
+        if (!m_batches.empty())
+        {
+            program.set_instance_base(-1);
+        }
+
+        // Splats captured by the pre-pass are drawn by render_pass().
+        if (!m_transform_feedback)
+        {
+            draw_surfels();
+        }
+
+        // Held back ranges are queried once, against the depth of the
+        // first pass.
+        if (!m_occluded.empty())
+        {
+            if (!m_occlusion_queried)
+            {
+                query_occluded_ranges();
+                program.use();
+            }
+
+            draw_occluded_ranges();
+        }
+    }
+
+    if (m_chunk_cache && m_chunk_cache->vertex_buffer())
+    {
+        if (!m_batches.empty())
+        {
+            program.set_instance_base(-1);
+        }
+
+        std::vector<GLint> const& first = m_chunk_cache->draw_first();
+        std::vector<GLsizei> const& count = m_chunk_cache->draw_count();
+
+        glBindVertexArray(m_chunk_vao);
+        glMultiDrawArrays(GL_POINTS, first.data(), count.data(),
+            static_cast<GLsizei>(first.size()));
+    }
+
+    if (!m_batches.empty())
+    {
+        glBindVertexArray(m_batch_vao);
+
+        for (std::size_t i(0); i < m_batches.size(); ++i)
+        {
+            Batch const& batch = m_batches[i];
+
+            program.set_instance_base(batch.instance_base);
+            glDrawArraysInstanced(GL_POINTS,
+                static_cast<GLint>(batch.first),
+                static_cast<GLsizei>(batch.count),
+                static_cast<GLsizei>(std::max<std::size_t>(1,
+                    batch.instances.size())));
+        }
+    }
+
+    glBindVertexArray(0);
+}
+
+void
+SplatRenderer::upload_batches()
+{
+    std::size_t n = m_batch_surfels.size();
+    Surfel const* surfels = m_batch_surfels.data();
+
+    m_batch_format = vertex_format();
+
+    glBindVertexArray(m_batch_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_batch_vbo);
+
+    // Batches follow the vertex format of the current geometry since both
+    // are drawn by the same programs.
+    if (m_batch_format == 1)
+    {
+        std::vector<PackedSurfel> packed(n);
+        pack_surfels(surfels, n, packed.data());
+
+        glBufferData(GL_ARRAY_BUFFER, sizeof(PackedSurfel) * n,
+            packed.data(), GL_STATIC_DRAW);
+
+        std::vector<GLuint> planes(n);
+        bool clipped = pack_clip_planes(surfels, n, planes.data());
+
+        if (clipped)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, m_batch_plane_vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * n,
+                planes.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, m_batch_vbo);
+            m_uploaded_bytes += sizeof(GLuint) * n;
+        }
+
+        setup_packed_attributes(m_batch_plane_vbo, clipped);
+        m_uploaded_bytes += sizeof(PackedSurfel) * n;
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Surfel) * n, surfels,
+            GL_STATIC_DRAW);
+
+        setup_surfel_attributes(SurfelLayout(), m_batch_format == 2);
+        m_uploaded_bytes += sizeof(Surfel) * n;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_batches_changed = false;
+}
+
+void
+SplatRenderer::upload_instance_transforms()
+{
+    Matrix4fVector transforms;
+
+    for (std::size_t i(0); i < m_batches.size(); ++i)
+    {
+        Batch& batch = m_batches[i];
+        batch.instance_base = static_cast<GLint>(transforms.size());
+
+        if (batch.instances.empty())
+        {
+            transforms.push_back(batch.model);
+        }
+
+        for (std::size_t j(0); j < batch.instances.size(); ++j)
+        {
+            transforms.push_back(batch.model * batch.instances[j]);
+        }
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_instance_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(Matrix4f) * transforms.size(),
+        transforms.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    m_uploaded_bytes += sizeof(Matrix4f) * transforms.size();
+
+    // One column per texel.
+    glBindTexture(GL_TEXTURE_BUFFER, m_instance_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instance_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    m_instances_changed = false;
+}
+
+void
+SplatRenderer::steiner_circumellipse(float const* v0_ptr, float const* v1_ptr,
+    float const* v2_ptr, float* p0_ptr, float* t1_ptr, float* t2_ptr)
+{
+    Matrix2f Q;
+    Vector3f d0, d1, d2;
+    {
+        const Vector3f v0 = Map<const Vector3f>(v0_ptr);
+        const Vector3f v1 = Map<const Vector3f>(v1_ptr);
+        const Vector3f v2 = Map<const Vector3f>(v2_ptr);
+
+        const Vector3f v[3] = { v0, v1, v2 };
+
+        d0 = v[1] - v[0];
+        d0.normalize();
 
         d1 = v[2] - v[0];
         d1 = d1 - d0 * d0.dot(d1);
@@ -687,25 +1912,391 @@ SplatRenderer::end_frame()
 
 void
 SplatRenderer::set_geometry(std::vector<Surfel> * visible_geometry) {
+    cancel_async_upload();
+    release_external();
+    m_external = nullptr;
+
+    if (m_surfel_buffer || m_external_layout || m_chunk_cache || m_lod)
+    {
+        m_surfel_buffer = nullptr;
+        m_external_layout = false;
+        m_chunk_cache = nullptr;
+        m_lod = nullptr;
+        update_vertex_format();
+        m_upload_pending = true;
+    }
+
+    if (m_spatial_reordering && visible_geometry && (visible_geometry
+        != m_reordered_geometry || visible_geometry->size()
+        != m_permutation.size()))
+    {
+        m_permutation = reorder_surfels(*visible_geometry, m_curve);
+        m_reordered_geometry = visible_geometry;
+        m_upload_pending = true;
+    }
+
     m_geometry = visible_geometry;
 }
 
+void
+SplatRenderer::set_geometry(SurfelBuffer* visible_geometry)
+{
+    cancel_async_upload();
+    release_external();
+    m_external = nullptr;
+
+    bool format_changed = !m_surfel_buffer;
+
+    m_geometry = nullptr;
+    m_surfel_buffer = visible_geometry;
+    m_external_layout = false;
+    m_chunk_cache = nullptr;
+    m_lod = nullptr;
+
+    if (format_changed)
+    {
+        update_vertex_format();
+        m_upload_pending = true;
+    }
+}
+
+void
+SplatRenderer::set_geometry(void const* data, std::size_t count,
+    SurfelLayout const& layout, std::function<void()> const& release)
+{
+    // Passing the same memory again keeps the uploaded copy, changes are
+    // picked up through mark_dirty() or has_data_changed.
+    bool unchanged = m_external_layout && !m_release && !release
+        && m_external == data && m_external_count == count
+        && m_layout == layout;
+
+    cancel_async_upload();
+    release_external();
+
+    m_geometry = nullptr;
+    m_surfel_buffer = nullptr;
+    m_chunk_cache = nullptr;
+    m_lod = nullptr;
+
+    m_external = static_cast<char const*>(data);
+    m_external_count = count;
+    m_layout = layout;
+    m_release = release;
+    m_external_layout = true;
+
+    // Attribute offsets and stride may differ from the previous call.
+    update_vertex_format();
+
+    if (!unchanged)
+    {
+        m_upload_pending = true;
+    }
+}
+
+void
+SplatRenderer::set_geometry(SurfelChunkCache* visible_geometry)
+{
+    cancel_async_upload();
+    release_external();
+    m_external = nullptr;
+
+    m_geometry = nullptr;
+    m_surfel_buffer = nullptr;
+    m_external_layout = false;
+    m_chunk_cache = visible_geometry;
+    m_lod = nullptr;
+
+    update_vertex_format();
+}
+
+void
+SplatRenderer::set_geometry(SurfelLod* visible_geometry)
+{
+    cancel_async_upload();
+    release_external();
+    m_external = nullptr;
+
+    m_geometry = nullptr;
+    m_surfel_buffer = nullptr;
+    m_external_layout = false;
+    m_chunk_cache = nullptr;
+    m_lod = visible_geometry;
+    m_hierarchy.clear();
+
+    update_vertex_format();
+}
+
+void
+SplatRenderer::release_external()
+{
+    m_released_vao = 0;
+
+    if (m_release)
+    {
+        m_release();
+        m_release = std::function<void()>();
+
+        m_external = nullptr;
+    }
+}
+
+void
+SplatRenderer::enable_async_upload(
+    std::function<void (bool)> const& make_current)
+{
+    m_uploader.reset(new AsyncUploader(make_current));
+}
+
+void
+SplatRenderer::set_geometry_async(std::vector<Surfel>* visible_geometry)
+{
+    if (!m_uploader || m_streaming || !visible_geometry)
+    {
+        set_geometry(visible_geometry);
+        m_upload_pending = true;
+        return;
+    }
+
+    if (m_spatial_reordering && (visible_geometry != m_reordered_geometry
+        || visible_geometry->size() != m_permutation.size()))
+    {
+        m_permutation = reorder_surfels(*visible_geometry, m_curve);
+        m_reordered_geometry = visible_geometry;
+    }
+
+    m_async_geometry = visible_geometry;
+    m_uploader->upload(visible_geometry->data(), visible_geometry->size(),
+        m_packed_format);
+}
+
+void
+SplatRenderer::cancel_async_upload()
+{
+    // Geometry set directly is newer than any upload still on its way.
+    if (m_uploader)
+    {
+        m_uploader->cancel();
+        m_async_geometry = nullptr;
+    }
+}
+
+bool
+SplatRenderer::async_upload_pending() const
+{
+    return m_uploader && m_uploader->pending();
+}
+
+void
+SplatRenderer::swap_async_geometry()
+{
+    AsyncUploader::Result result;
+    if (!m_uploader->poll(result))
+    {
+        return;
+    }
+
+    release_external();
+    m_external = nullptr;
+    m_external_layout = false;
+    m_surfel_buffer = nullptr;
+    m_chunk_cache = nullptr;
+    m_lod = nullptr;
+    m_geometry = m_async_geometry;
+    update_vertex_format();
+
+    // Settings changed while uploading, upload again on this thread.
+    if (result.packed != m_packed_format || m_streaming)
+    {
+        glDeleteBuffers(1, &result.vbo);
+        glDeleteBuffers(1, &result.plane_vbo);
+
+        m_upload_pending = true;
+        return;
+    }
+
+    glDeleteBuffers(1, &m_vbo);
+    m_vbo = result.vbo;
+
+    if (result.clipped)
+    {
+        glDeleteBuffers(1, &m_plane_vbo);
+        m_plane_vbo = result.plane_vbo;
+    }
+
+    m_clipped = result.clipped;
+    m_packed.swap(result.packed_surfels);
+    m_clip_planes.swap(result.clip_planes);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    setup_vertex_attributes();
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The copy was made by the uploader thread over the last frames, it
+    // is counted for the frame that starts drawing it.
+    m_uploaded_pts = static_cast<unsigned int>(result.count);
+    m_uploaded_bytes += (result.packed ? sizeof(PackedSurfel)
+        + (result.clipped ? sizeof(GLuint) : 0) : sizeof(Surfel))
+        * result.count;
+    m_upload_pending = false;
+    m_dirty_ranges.clear();
+
+    build_hierarchy();
+}
+
+unsigned int
+SplatRenderer::add_batch(Surfel const* surfels, std::size_t count,
+    Matrix4f const& model)
+{
+    Batch batch;
+    batch.first = m_batch_surfels.size();
+    batch.count = count;
+    batch.model = model;
+    batch.instance_base = 0;
+
+    m_batch_surfels.insert(m_batch_surfels.end(), surfels, surfels + count);
+    m_batches.push_back(batch);
+
+    m_visibility.set_batched();
+    m_attribute.set_batched();
+
+    m_batches_changed = true;
+    m_instances_changed = true;
+
+    return static_cast<unsigned int>(m_batches.size() - 1);
+}
+
+void
+SplatRenderer::set_batch_model(unsigned int batch, Matrix4f const& model)
+{
+    m_batches[batch].model = model;
+    m_instances_changed = true;
+}
+
+void
+SplatRenderer::set_batch_instances(unsigned int batch,
+    Matrix4f const* instances, std::size_t count)
+{
+    m_batches[batch].instances.assign(instances, instances + count);
+    m_instances_changed = true;
+}
+
+void
+SplatRenderer::clear_batches()
+{
+    m_batches.clear();
+    m_batch_surfels.clear();
+
+    m_visibility.set_batched(false);
+    m_attribute.set_batched(false);
+
+    m_batches_changed = false;
+    m_instances_changed = false;
+}
+
+std::size_t
+SplatRenderer::num_batches() const
+{
+    return m_batches.size();
+}
+
+void
+SplatRenderer::mark_dirty(std::size_t first, std::size_t count)
+{
+    m_dirty_ranges.push_back(std::make_pair(first, first + count));
+}
+
+float
+SplatRenderer::dirty_fraction_threshold() const
+{
+    return m_dirty_fraction_threshold;
+}
+
+void
+SplatRenderer::set_dirty_fraction_threshold(float threshold)
+{
+    m_dirty_fraction_threshold = threshold;
+}
+
 GLuint
 SplatRenderer::render_frame(bool has_data_changed, float r, float g, float b, float a)
 {
-    if (m_geometry) {
+    m_uploaded_bytes = 0;
+
+    if (m_uploader)
+    {
+        swap_async_geometry();
+    }
+
+    bool has_geometry = m_geometry || m_surfel_buffer || m_external_layout
+        || m_chunk_cache || m_lod;
+
+    if (has_geometry || !m_batches.empty()) {
         begin_frame(r, g, b, a);
 
-        m_num_pts = static_cast<unsigned int>(m_geometry->size());
+        // Released external memory keeps being drawn from its uploaded copy.
+        bool has_data = m_geometry || m_surfel_buffer || m_external;
 
-        if (m_num_pts > 0)
+        m_num_pts = static_cast<unsigned int>(m_geometry ? m_geometry->size()
+            : (m_surfel_buffer ? m_surfel_buffer->size()
+            : (m_external_layout ? m_external_count : 0)));
+
+        if (!m_batches.empty())
         {
-            if (has_data_changed) {
-                glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-                glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-                glBufferData(GL_ARRAY_BUFFER, sizeof(Surfel) * m_num_pts,
-                    &m_geometry->front(), GL_DYNAMIC_DRAW);
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
+            if (m_batches_changed || m_batch_format != vertex_format()) {
+                upload_batches();
+            }
+
+            if (m_instances_changed) {
+                upload_instance_transforms();
+            }
+        }
+
+        if (m_lod)
+        {
+            upload_lod();
+        }
+
+        if (m_chunk_cache)
+        {
+            m_chunk_cache->update(m_camera);
+            m_uploaded_bytes += m_chunk_cache->uploaded_bytes();
+
+            // A few calls, and a new budget may reallocate the buffers
+            // under the names of the old ones.
+            if (m_chunk_cache->vertex_buffer()) {
+                setup_chunk_attributes();
+            }
+        }
+
+        if (m_num_pts > 0 || !m_batches.empty() || m_chunk_cache || m_lod)
+        {
+            if (m_num_pts == 0 || !has_data) {
+                m_dirty_ranges.clear();
+            }
+            else if (has_data_changed || m_upload_pending
+                || m_uploaded_pts != m_num_pts) {
+                upload_geometry();
+                m_upload_pending = false;
+                m_dirty_ranges.clear();
+            }
+            else if (!m_dirty_ranges.empty()) {
+                upload_dirty_ranges();
+            }
+
+            m_num_visible = m_num_pts;
+            m_occluded.clear();
+            m_num_occluded = 0;
+
+            if (chunk_culling() && m_num_pts > 0
+                && m_hierarchy.size() == m_num_pts) {
+                cull_geometry();
+            }
+
+            if (m_transform_feedback)
+            {
+                capture_splats();
             }
 
             if (m_multisample)
@@ -722,6 +2313,17 @@ SplatRenderer::render_frame(bool has_data_changed, float r, float g, float b, fl
 
             render_pass(false);
 
+            // Depth of this frame for culling the next one.
+            if (m_occlusion_culling)
+            {
+                update_hiz();
+            }
+
+            if (m_num_pts > 0 && surfel_vao() == m_stream_vao)
+            {
+                m_stream.fence();
+            }
+
             if (m_multisample)
             {
                 glDisable(GL_MULTISAMPLE);
@@ -20,14 +20,32 @@
 
 #include "program_attribute.hpp"
 #include "program_finalization.hpp"
+#include "surfel_stream_buffer.hpp"
+#include "surfel.hpp"
+#include "surfel_buffer.hpp"
+#include "packed_surfel.hpp"
+#include "surfel_order.hpp"
+#include "async_uploader.hpp"
+#include "surfel_chunk_cache.hpp"
+#include "surfel_hierarchy.hpp"
+#include "surfel_lod.hpp"
+#include "hiz_buffer.hpp"
+#include "program_bounding_box.hpp"
+#include "program_prepass.hpp"
+#include "splat_feedback.hpp"
 
 #include <GLviz>
 
 #include "framebuffer.hpp"
 
 #include <Eigen/Core>
+#include <array>
 #include <string>
 #include <vector>
+#include <utility>
+#include <cstddef>
+#include <functional>
+#include <memory>
 
 class CrudeCamera : public GLviz::Camera {
 public:
@@ -36,21 +54,6 @@ public:
     void set_Projection(const Eigen::Matrix4f & projection);
 };
 
-struct Surfel
-{
-    Surfel() { }
-
-    Surfel(Eigen::Vector3f c_, Eigen::Vector3f u_, Eigen::Vector3f v_,
-           Eigen::Vector3f p_, unsigned int rgba_)
-        : c(c_), u(u_), v(v_), p(p_), rgba(rgba_) { }
-
-    Eigen::Vector3f c,      // Position of the ellipse center point.
-                    u, v,   // Ellipse major and minor axis.
-                    p;      // Clipping plane.
-
-    unsigned int    rgba;   // Color.
-};
-
 class UniformBufferRaycast : public GLviz::glUniformBuffer
 {
 
@@ -88,14 +91,88 @@ public:
     virtual ~SplatRenderer();
 
 	void set_geometry(std::vector<Surfel> * visible_geometry);
+
+    // Renders from the columns of a SurfelBuffer. The arena is uploaded as
+    // is and every column is bound as its own attribute stream. This path
+    // neither streams nor packs, streaming() and packed_format() are ignored.
+    void set_geometry(SurfelBuffer* visible_geometry);
+
+    // Renders count surfels described by layout straight from caller memory,
+    // without copying them into a vector first. Without a release callback
+    // data has to stay valid while it is the current geometry. Otherwise
+    // release is called exactly once, either after the first upload or when
+    // the geometry is replaced, and the uploaded copy is drawn from then on.
+    // The copy stays in the buffer it was uploaded to, later calls to
+    // set_streaming() do not move it, and the culling modes use a hierarchy
+    // built before the release.
+    // Passing the same data, count and layout again without a release
+    // callback does not upload anything, only ranges marked dirty.
+    // This path does not pack, packed_format() is ignored.
+    void set_geometry(void const* data, std::size_t count,
+        SurfelLayout const& layout = SurfelLayout(),
+        std::function<void()> const& release = std::function<void()>());
+
+    // Renders the resident chunks of an out-of-core cache inside the view
+    // frustum and lets it stream in missing ones, see SurfelChunkCache. The
+    // vertex format is the one of the cache, packed_format(), streaming()
+    // and spatial_reordering() are ignored.
+    void set_geometry(SurfelChunkCache* visible_geometry);
+
+    // Renders a level of detail cut through a SurfelLod, selected anew for
+    // every frame and written straight into the ring of stream buffers.
+    // Surfels are uploaded unpacked, packed_format(), streaming(),
+    // spatial_reordering() and frustum_culling() are ignored.
+    void set_geometry(SurfelLod* visible_geometry);
 	GLuint render_frame(bool has_data_changed, float r, float g, float b, float a);
 
+    // Uploads geometry passed to set_geometry_async() on a worker thread.
+    // make_current(true) makes a context sharing objects with the render
+    // context current on the calling thread, make_current(false) releases
+    // it again.
+    void enable_async_upload(std::function<void (bool)> const& make_current);
+
+    // Starts uploading the vector in the background. The current geometry
+    // is drawn until the upload has finished, the new one replaces it at
+    // the beginning of the next frame after that. The vector must not be
+    // changed while async_upload_pending() is true, frames rendered in the
+    // meantime should pass has_data_changed == false. Streaming geometry
+    // and renderers without async upload fall back to set_geometry(). A
+    // later set_geometry() call cancels an upload that has not replaced
+    // the current geometry yet.
+    void set_geometry_async(std::vector<Surfel>* visible_geometry);
+    bool async_upload_pending() const;
+
+    // Batches are drawn together with the geometry passed to set_geometry(),
+    // by the same programs into the same framebuffer. A batch is drawn once
+    // per instance; the scene transform of an instance is the model matrix
+    // of its batch times the instance matrix. Without instances a batch is
+    // drawn once with its model matrix. The surfels are copied.
+    unsigned int add_batch(Surfel const* surfels, std::size_t count,
+        Eigen::Matrix4f const& model = Eigen::Matrix4f::Identity());
+    void set_batch_model(unsigned int batch, Eigen::Matrix4f const& model);
+    void set_batch_instances(unsigned int batch,
+        Eigen::Matrix4f const* instances, std::size_t count);
+    void clear_batches();
+    std::size_t num_batches() const;
+
+    // Marks count surfels starting at first as modified. A frame rendered
+    // with has_data_changed == false uploads only the marked ranges.
+    void mark_dirty(std::size_t first, std::size_t count);
+
+    // Fraction of all surfels above which the marked ranges are uploaded as
+    // a whole instead of range by range.
+    float dirty_fraction_threshold() const;
+    void set_dirty_fraction_threshold(float threshold);
+
     bool smooth() const;
     void set_smooth(bool enable = true);
 
     bool color_material() const;
     void set_color_material(bool enable = true);
 
+    // Besides the per splat test in the shaders, drops chunks of the
+    // geometry whose normal cones face away from the eye on the CPU, with
+    // the same SurfelHierarchy as frustum_culling().
     bool backface_culling() const;
     void set_backface_culling(bool enable = true);
 
@@ -114,11 +191,69 @@ public:
     bool multisample() const;
     void set_multisample(bool enable = true);
 
+    // Sorts vectors passed to set_geometry() along a space filling curve
+    // for better vertex fetch and blending locality. A vector is reordered
+    // in place the first time it is passed and whenever its size changes.
+    // The permutation maps new to old indices, see reorder_surfels(), and
+    // dirty ranges refer to the new indices.
+    bool spatial_reordering() const;
+    void set_spatial_reordering(bool enable = true,
+        SpaceFillingCurve curve = MortonCurve);
+    std::vector<unsigned int> const& geometry_permutation() const;
+
+    // Streams changed geometry through a ring of mapped buffers instead of
+    // reallocating the vertex buffer on every update.
+    bool streaming() const;
+    void set_streaming(bool enable = true);
+
+    // Uploads surfels as PackedSurfel, which cuts vertex fetch of both
+    // passes to less than half.
+    bool packed_format() const;
+    void set_packed_format(bool enable = true);
+
+    // Bytes of geometry copied to the GPU by the last frame, including the
+    // chunks loaded by an out-of-core cache.
+    std::size_t uploaded_bytes() const;
+
+    // Culls chunks of the geometry against the view frustum on the CPU
+    // with a SurfelHierarchy built at upload time, and submits only the
+    // visible ranges with one glMultiDrawArrays call per pass. Pays off for
+    // spatially coherent geometry, see set_spatial_reordering(). Batches
+    // are not culled.
+    bool frustum_culling() const;
+    void set_frustum_culling(bool enable = true);
+
+    // Holds back chunks of the geometry hidden behind a hierarchical depth
+    // buffer of the previous frame, see HiZBuffer. After the first pass
+    // their boxes are drawn into occlusion queries against the depth of
+    // the current frame, and chunks that turn out visible are drawn with
+    // conditional rendering in both passes, so nothing pops in. Uses the
+    // same SurfelHierarchy as frustum_culling().
+    bool occlusion_culling() const;
+    void set_occlusion_culling(bool enable = true);
+
+    // Bounds, culls and lights the geometry passed to set_geometry() once
+    // per frame in a pre-pass, which keeps only the splats left over in a
+    // transform feedback buffer. Both raster passes draw that buffer
+    // instead of the geometry, see SplatFeedback. Chunks held back by
+    // occlusion culling, the chunk cache and batches skip the pre-pass.
+    bool transform_feedback() const;
+    void set_transform_feedback(bool enable = true);
+
+    // Surfels submitted by the last frame, all of them without culling.
+    std::size_t num_visible_surfels() const;
+
+    // Surfels held back by occlusion culling in the last frame, drawn only
+    // where their queries passed.
+    std::size_t num_occluded_surfels() const;
+
     float const* material_color() const;
     void set_material_color(float const* color_ptr);
     float material_shininess() const;
     void set_material_shininess(float shininess);
 
+    // Global factor on the splat axes, on top of any per-surfel scale baked
+    // in with scale_to_coverage().
     float radius_scale() const;
     void set_radius_scale(float radius_scale);
 
@@ -131,6 +266,14 @@ public:
 	static void computerPrincipalDirections(float const* vertex1_ptr, float const* vertex2_ptr, float const* vertex3_ptr,
 		float* ellipsis_center_ptr, float* ellipsis_principal_direction_1_ptr, float* ellipsis_principal_direction_2_ptr);
 
+    // Converts every face of a triangle mesh into the surfel spanned by its
+    // Steiner circumellipse, vectorized and spread across all cores. The
+    // surfels are oriented along the face normals and colored white.
+    static void computePrincipalDirectionsBatch(
+        std::vector<Eigen::Vector3f> const& vertices,
+        std::vector<std::array<unsigned int, 3> > const& faces,
+        std::vector<Surfel>& surfels);
+
     GLuint get_fbo_texture_id() {
         return m_fbo.color_texture();
     }
@@ -140,16 +283,59 @@ private:
     void setup_filter_kernel();
     void setup_screen_size_quad();
     void setup_vertex_array_buffer_object();
+    void setup_vertex_attributes();
+    void setup_surfel_attributes(SurfelLayout const& layout,
+        bool split_center);
+    void setup_packed_attributes(GLuint plane_vbo, bool clipped);
+    void setup_chunk_attributes();
+    unsigned int vertex_format() const;
+    void update_vertex_format();
+    void release_external();
 
     void setup_uniforms(glProgram& program);
 
     void begin_frame(float r, float g, float b, float a);
     void end_frame();
     void render_pass(bool depth_only = false);
+    void upload_geometry();
+    void upload_dirty_ranges();
+    void cancel_async_upload();
+    bool chunk_culling() const;
+    GLuint surfel_vao() const;
+    void draw_surfels();
+    void capture_splats();
+    void update_chunk_culling();
+    void build_hierarchy();
+    Eigen::Matrix4f surfel_modelview() const;
+    void cull_geometry();
+    void query_occluded_ranges();
+    void draw_occluded_ranges();
+    void update_hiz();
+    void upload_lod();
+    void swap_async_geometry();
+    void upload_batches();
+    void upload_instance_transforms();
+    void draw_geometry(ProgramAttribute& program);
 
 	static void steiner_circumellipse(float const* v0_ptr, float const* v1_ptr,
 		float const* v2_ptr, float* p0_ptr, float* t1_ptr, float* t2_ptr);
 
+private:
+    typedef std::vector<Eigen::Matrix4f,
+        Eigen::aligned_allocator<Eigen::Matrix4f> > Matrix4fVector;
+
+    struct Batch
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        std::size_t first, count;
+        Eigen::Matrix4f model;
+        Matrix4fVector instances;
+
+        // Index of the first transform in the instance texture buffer.
+        GLint instance_base;
+    };
+
 private:
     GLviz::Camera const& m_camera;
 
@@ -158,6 +344,25 @@ private:
 
     GLuint m_vbo, m_vao;
     unsigned int m_num_pts;
+    std::size_t m_uploaded_bytes;
+
+    SurfelStreamBuffer m_stream;
+    GLuint m_stream_vao, m_stream_vbo;
+
+    std::vector<std::pair<std::size_t, std::size_t> > m_dirty_ranges;
+    float m_dirty_fraction_threshold;
+    unsigned int m_uploaded_pts;
+
+    GLuint m_plane_vbo;
+    std::vector<PackedSurfel> m_packed;
+    std::vector<GLuint> m_clip_planes;
+
+    std::vector<Batch, Eigen::aligned_allocator<Batch> > m_batches;
+    std::vector<Surfel> m_batch_surfels;
+    GLuint m_batch_vbo, m_batch_vao, m_batch_plane_vbo,
+        m_instance_buffer, m_instance_texture;
+    unsigned int m_batch_format;
+    bool m_batches_changed, m_instances_changed;
 
     ProgramAttribute m_visibility, m_attribute;
     ProgramFinalization m_finalization;
@@ -165,7 +370,9 @@ private:
     Framebuffer m_fbo;
 
     bool m_soft_zbuffer, m_backface_culling, m_smooth,
-        m_color_material, m_ewa_filter, m_multisample;
+        m_color_material, m_ewa_filter, m_multisample, m_streaming,
+        m_upload_pending, m_packed_format, m_clipped, m_frustum_culling,
+        m_occlusion_culling, m_transform_feedback;
     unsigned int m_pointsize_method;
     Eigen::Vector3f m_color;
     float m_epsilon, m_shininess, m_radius_scale,
@@ -180,6 +387,48 @@ private:
     GLuint custom_viewport[4];
 
 	std::vector<Surfel> * m_geometry;
+
+    std::unique_ptr<AsyncUploader> m_uploader;
+    std::vector<Surfel>* m_async_geometry;
+
+    bool m_spatial_reordering;
+    SpaceFillingCurve m_curve;
+    std::vector<Surfel> const* m_reordered_geometry;
+    std::vector<unsigned int> m_permutation;
+    SurfelBuffer* m_surfel_buffer;
+
+    char const* m_external;
+    std::size_t m_external_count;
+    SurfelLayout m_layout;
+    std::function<void()> m_release;
+    bool m_external_layout;
+
+    // Vertex array of the uploaded copy of released caller memory, 0 while
+    // there is none.
+    GLuint m_released_vao;
+
+    SurfelChunkCache* m_chunk_cache;
+    GLuint m_chunk_vao;
+
+    SurfelLod* m_lod;
+
+    SurfelHierarchy m_hierarchy;
+    std::vector<GLint> m_cull_first;
+    std::vector<GLsizei> m_cull_count;
+    std::size_t m_num_visible;
+
+    std::unique_ptr<HiZBuffer> m_hiz;
+    std::unique_ptr<ProgramBoundingBox> m_bounding_box;
+    GLuint m_box_vao;
+    std::vector<SurfelHierarchy::OccludedRange> m_occluded;
+    std::vector<GLuint> m_occlusion_queries;
+    bool m_occlusion_queried;
+    std::size_t m_num_occluded;
+
+    std::unique_ptr<ProgramPrepass> m_prepass;
+    std::unique_ptr<ProgramAttribute> m_feedback_visibility,
+        m_feedback_attribute;
+    std::unique_ptr<SplatFeedback> m_feedback;
 };
 
 #endif // SPLATRENDER_HPP
@@ -0,0 +1,71 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_HPP
+#define SURFEL_HPP
+
+#include <Eigen/Core>
+#include <cstddef>
+
+struct Surfel
+{
+    Surfel() { }
+
+    Surfel(Eigen::Vector3f c_, Eigen::Vector3f u_, Eigen::Vector3f v_,
+           Eigen::Vector3f p_, unsigned int rgba_)
+        : c(c_), u(u_), v(v_), p(p_), rgba(rgba_) { }
+
+    Eigen::Vector3f c,      // Position of the ellipse center point.
+                    u, v,   // Ellipse major and minor axis.
+                    p;      // Clipping plane.
+
+    unsigned int    rgba;   // Color.
+};
+
+// Describes surfels stored in caller memory: the byte distance between two
+// surfels and the byte offset of each attribute within one of them. Vectors
+// are three floats, the color is four normalized bytes. The clipping plane
+// and the color may be omitted. The default describes Surfel.
+struct SurfelLayout
+{
+    static const std::size_t none = static_cast<std::size_t>(-1);
+
+    SurfelLayout()
+        : stride(sizeof(Surfel)), c(0), u(12), v(24), p(36), rgba(48) { }
+
+    SurfelLayout(std::size_t stride_, std::size_t c_, std::size_t u_,
+                 std::size_t v_, std::size_t p_ = none,
+                 std::size_t rgba_ = none)
+        : stride(stride_), c(c_), u(u_), v(v_), p(p_), rgba(rgba_) { }
+
+    std::size_t stride, c, u, v, p, rgba;
+};
+
+inline bool
+operator==(SurfelLayout const& a, SurfelLayout const& b)
+{
+    return a.stride == b.stride && a.c == b.c && a.u == b.u && a.v == b.v
+        && a.p == b.p && a.rgba == b.rgba;
+}
+
+inline bool
+operator!=(SurfelLayout const& a, SurfelLayout const& b)
+{
+    return !(a == b);
+}
+
+#endif // SURFEL_HPP
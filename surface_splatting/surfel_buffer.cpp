@@ -0,0 +1,201 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_buffer.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+SurfelBuffer::SurfelBuffer()
+    : m_size(0), m_data_size(0), m_arena(nullptr), m_data(nullptr)
+{
+    std::fill(m_offset, m_offset + NumColumns, 0);
+}
+
+SurfelBuffer::SurfelBuffer(std::size_t size)
+    : SurfelBuffer()
+{
+    resize(size);
+}
+
+SurfelBuffer::SurfelBuffer(SurfelBuffer&& other)
+    : SurfelBuffer()
+{
+    *this = std::move(other);
+}
+
+SurfelBuffer::~SurfelBuffer()
+{
+    std::free(m_arena);
+}
+
+SurfelBuffer&
+SurfelBuffer::operator=(SurfelBuffer&& other)
+{
+    if (this != &other)
+    {
+        std::free(m_arena);
+
+        m_size = other.m_size;
+        m_data_size = other.m_data_size;
+        std::copy(other.m_offset, other.m_offset + NumColumns, m_offset);
+        m_arena = other.m_arena;
+        m_data = other.m_data;
+
+        other.m_size = other.m_data_size = 0;
+        other.m_arena = other.m_data = nullptr;
+    }
+
+    return *this;
+}
+
+std::size_t
+SurfelBuffer::size() const
+{
+    return m_size;
+}
+
+void
+SurfelBuffer::resize(std::size_t size)
+{
+    if (size == m_size)
+    {
+        return;
+    }
+
+    std::size_t offset[NumColumns];
+    std::size_t data_size = arena_layout(size, offset);
+
+    char* arena = static_cast<char*>(std::malloc(data_size + alignment));
+    if (!arena)
+    {
+        throw std::bad_alloc();
+    }
+
+    char* data = arena + (alignment - reinterpret_cast<std::size_t>(arena)
+        % alignment) % alignment;
+
+    // Keep the common prefix of every column.
+    std::size_t n = std::min(size, m_size);
+    for (unsigned int c(0); c < NumColumns; ++c)
+    {
+        std::size_t column_size = n * column_element_size(
+            static_cast<Column>(c));
+        if (column_size > 0)
+        {
+            std::memcpy(data + offset[c], m_data + m_offset[c],
+                column_size);
+        }
+    }
+
+    std::free(m_arena);
+
+    m_size = size;
+    m_data_size = data_size;
+    std::copy(offset, offset + NumColumns, m_offset);
+    m_arena = arena;
+    m_data = data;
+}
+
+Surfel
+SurfelBuffer::get(std::size_t i) const
+{
+    return Surfel(Eigen::Vector3f(cx()[i], cy()[i], cz()[i]),
+        u()[i], v()[i], p()[i], rgba()[i]);
+}
+
+void
+SurfelBuffer::set(std::size_t i, Surfel const& surfel)
+{
+    cx()[i] = surfel.c.x();
+    cy()[i] = surfel.c.y();
+    cz()[i] = surfel.c.z();
+    u()[i] = surfel.u;
+    v()[i] = surfel.v;
+    p()[i] = surfel.p;
+    rgba()[i] = surfel.rgba;
+}
+
+void
+SurfelBuffer::assign(Surfel const* surfels, std::size_t n)
+{
+    resize(n);
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            set(i, surfels[i]);
+        }
+    });
+}
+
+void const*
+SurfelBuffer::data() const
+{
+    return m_data;
+}
+
+std::size_t
+SurfelBuffer::data_size() const
+{
+    return m_data_size;
+}
+
+std::size_t
+SurfelBuffer::column_offset(Column column) const
+{
+    return m_offset[column];
+}
+
+std::size_t
+SurfelBuffer::column_element_size(Column column)
+{
+    switch (column)
+    {
+        case TangentU:
+        case TangentV:
+        case ClipPlane:
+            return sizeof(Eigen::Vector3f);
+
+        case Color:
+            return sizeof(unsigned int);
+
+        default:
+            return sizeof(float);
+    }
+}
+
+std::size_t
+SurfelBuffer::arena_layout(std::size_t size, std::size_t* offset)
+{
+    std::size_t data_size(0);
+
+    for (unsigned int c(0); c < NumColumns; ++c)
+    {
+        offset[c] = data_size;
+
+        std::size_t column_size = size * column_element_size(
+            static_cast<Column>(c));
+        data_size += (column_size + alignment - 1) / alignment * alignment;
+    }
+
+    return data_size;
+}
@@ -0,0 +1,103 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_BUFFER_HPP
+#define SURFEL_BUFFER_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+#include <cstddef>
+
+// Structure-of-arrays storage of surfels. All columns live in one arena
+// allocation, each of them starting at a 64 byte boundary, so that the
+// arena can be uploaded to the GPU as is and CPU passes over a single
+// attribute run at full vector width.
+class SurfelBuffer
+{
+
+public:
+    enum Column
+    {
+        CenterX, CenterY, CenterZ, TangentU, TangentV, ClipPlane, Color,
+        NumColumns
+    };
+
+    static const std::size_t alignment = 64;
+
+    SurfelBuffer();
+    explicit SurfelBuffer(std::size_t size);
+    SurfelBuffer(SurfelBuffer&& other);
+    ~SurfelBuffer();
+
+    SurfelBuffer& operator=(SurfelBuffer&& other);
+
+    std::size_t size() const;
+    void resize(std::size_t size);
+
+    float* cx() { return column<float>(CenterX); }
+    float* cy() { return column<float>(CenterY); }
+    float* cz() { return column<float>(CenterZ); }
+    Eigen::Vector3f* u() { return column<Eigen::Vector3f>(TangentU); }
+    Eigen::Vector3f* v() { return column<Eigen::Vector3f>(TangentV); }
+    Eigen::Vector3f* p() { return column<Eigen::Vector3f>(ClipPlane); }
+    unsigned int* rgba() { return column<unsigned int>(Color); }
+
+    float const* cx() const { return column<float>(CenterX); }
+    float const* cy() const { return column<float>(CenterY); }
+    float const* cz() const { return column<float>(CenterZ); }
+    Eigen::Vector3f const* u() const
+        { return column<Eigen::Vector3f>(TangentU); }
+    Eigen::Vector3f const* v() const
+        { return column<Eigen::Vector3f>(TangentV); }
+    Eigen::Vector3f const* p() const
+        { return column<Eigen::Vector3f>(ClipPlane); }
+    unsigned int const* rgba() const { return column<unsigned int>(Color); }
+
+    Surfel get(std::size_t i) const;
+    void set(std::size_t i, Surfel const& surfel);
+
+    // Resizes the buffer to n surfels and scatters them into the columns.
+    void assign(Surfel const* surfels, std::size_t n);
+
+    // The arena, its size and the byte offset of each column within it.
+    void const* data() const;
+    std::size_t data_size() const;
+    std::size_t column_offset(Column column) const;
+    static std::size_t column_element_size(Column column);
+
+private:
+    SurfelBuffer(SurfelBuffer const&);
+    SurfelBuffer& operator=(SurfelBuffer const&);
+
+    template <typename T>
+    T* column(Column c) const
+    {
+        return reinterpret_cast<T*>(m_data + m_offset[c]);
+    }
+
+    static std::size_t arena_layout(std::size_t size, std::size_t* offset);
+
+private:
+    std::size_t m_size, m_data_size;
+    std::size_t m_offset[NumColumns];
+
+    char* m_arena;
+    char* m_data;
+};
+
+#endif // SURFEL_BUFFER_HPP
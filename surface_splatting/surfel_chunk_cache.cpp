@@ -0,0 +1,508 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_chunk_cache.hpp"
+#include "frustum.hpp"
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+using namespace Eigen;
+
+namespace
+{
+
+// Loaded chunks allowed to wait for their upload, per upload of a frame.
+const std::size_t loaded_per_upload = 2;
+
+const std::size_t no_slot = static_cast<std::size_t>(-1);
+
+}
+
+SurfelChunkCache::SurfelChunkCache(SurfelFile const& file, std::size_t budget,
+    bool packed)
+    : m_file(file), m_budget(budget), m_packed(packed),
+      m_prefetch_frames(8.0f), m_max_uploads(8),
+      m_record_size(packed ? sizeof(PackedSurfel) : sizeof(Surfel)),
+      m_plane_size(packed ? sizeof(GLuint) : 0), m_slot_size(0),
+      m_vbo(0), m_plane_vbo(0), m_num_slots(0),
+      m_chunk_slot(file.num_chunks(), -1), m_frame(0),
+      m_previous_clip(Matrix4f::Identity()), m_has_previous(false),
+      m_num_visible(0), m_uploaded_bytes(0), m_next_request(0),
+      m_queued(file.num_chunks(), 0), m_failed(file.num_chunks(), 0),
+      m_stop(false)
+{
+    for (std::size_t i(0); i < file.num_chunks(); ++i)
+    {
+        m_slot_size = std::max<std::size_t>(m_slot_size,
+            file.chunk(i).count);
+    }
+
+    m_thread = std::thread(&SurfelChunkCache::run, this);
+}
+
+SurfelChunkCache::~SurfelChunkCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+
+    release();
+}
+
+std::size_t
+SurfelChunkCache::budget() const
+{
+    return m_budget;
+}
+
+void
+SurfelChunkCache::set_budget(std::size_t budget)
+{
+    m_budget = budget;
+    release();
+}
+
+float
+SurfelChunkCache::prefetch_frames() const
+{
+    return m_prefetch_frames;
+}
+
+void
+SurfelChunkCache::set_prefetch_frames(float frames)
+{
+    m_prefetch_frames = frames;
+}
+
+unsigned int
+SurfelChunkCache::max_uploads_per_frame() const
+{
+    return m_max_uploads;
+}
+
+void
+SurfelChunkCache::set_max_uploads_per_frame(unsigned int max_uploads)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_max_uploads = std::max(max_uploads, 1u);
+    }
+
+    m_condition.notify_one();
+}
+
+bool
+SurfelChunkCache::packed() const
+{
+    return m_packed;
+}
+
+GLuint
+SurfelChunkCache::vertex_buffer() const
+{
+    return m_vbo;
+}
+
+GLuint
+SurfelChunkCache::plane_buffer() const
+{
+    return m_plane_vbo;
+}
+
+std::vector<GLint> const&
+SurfelChunkCache::draw_first() const
+{
+    return m_draw_first;
+}
+
+std::vector<GLsizei> const&
+SurfelChunkCache::draw_count() const
+{
+    return m_draw_count;
+}
+
+std::size_t
+SurfelChunkCache::num_visible() const
+{
+    return m_num_visible;
+}
+
+std::size_t
+SurfelChunkCache::num_resident() const
+{
+    return m_num_slots - m_free_slots.size();
+}
+
+std::size_t
+SurfelChunkCache::num_slots() const
+{
+    return m_num_slots;
+}
+
+std::size_t
+SurfelChunkCache::uploaded_bytes() const
+{
+    return m_uploaded_bytes;
+}
+
+void
+SurfelChunkCache::allocate()
+{
+    std::size_t slot_bytes = m_slot_size * (m_record_size + m_plane_size);
+    m_num_slots = std::max<std::size_t>(1, m_budget / slot_bytes);
+
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, m_num_slots * m_slot_size * m_record_size,
+        nullptr, GL_STATIC_DRAW);
+
+    if (m_packed)
+    {
+        glGenBuffers(1, &m_plane_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, m_plane_vbo);
+        glBufferData(GL_ARRAY_BUFFER, m_num_slots * m_slot_size
+            * m_plane_size, nullptr, GL_STATIC_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_slot_chunk.assign(m_num_slots, -1);
+    m_slot_used.assign(m_num_slots, 0);
+
+    // Slots are handed out from the back, lowest first.
+    m_free_slots.resize(m_num_slots);
+    for (std::size_t i(0); i < m_num_slots; ++i)
+    {
+        m_free_slots[i] = m_num_slots - 1 - i;
+    }
+}
+
+void
+SurfelChunkCache::release()
+{
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_plane_vbo);
+    m_vbo = 0;
+    m_plane_vbo = 0;
+
+    m_num_slots = 0;
+    m_slot_chunk.clear();
+    m_slot_used.clear();
+    m_free_slots.clear();
+    std::fill(m_chunk_slot.begin(), m_chunk_slot.end(), -1);
+
+    m_draw_first.clear();
+    m_draw_count.clear();
+}
+
+void
+SurfelChunkCache::cull(Matrix4f const& clip, std::vector<char>& inside) const
+{
+    Vector4f planes[6];
+    frustum_planes(clip, planes);
+
+    inside.resize(m_file.num_chunks());
+    for (std::size_t i(0); i < inside.size(); ++i)
+    {
+        SurfelChunk const& chunk = m_file.chunk(i);
+        inside[i] = chunk.count > 0 && box_in_frustum(planes,
+            chunk.bounds_min, chunk.bounds_max);
+    }
+}
+
+void
+SurfelChunkCache::update(GLviz::Camera const& camera)
+{
+    if (!m_vbo && m_slot_size > 0)
+    {
+        allocate();
+    }
+
+    ++m_frame;
+    m_uploaded_bytes = 0;
+
+    // Same transform as the vertex shader, centers are moved by the
+    // position offset before the modelview matrix is applied.
+    Matrix4f offset = Matrix4f::Identity();
+    offset.block<3, 1>(0, 3) = -camera.get_position_offset();
+
+    Matrix4f modelview = camera.get_model_matrix()
+        * camera.get_view_matrix() * offset;
+    Matrix4f clip = camera.get_projection_matrix() * modelview;
+
+    std::vector<char> inside, ahead;
+    cull(clip, inside);
+
+    if (m_has_previous && m_prefetch_frames > 0.0f)
+    {
+        cull(clip + m_prefetch_frames * (clip - m_previous_clip), ahead);
+    }
+    else
+    {
+        ahead.assign(inside.size(), 0);
+    }
+
+    m_previous_clip = clip;
+    m_has_previous = true;
+
+    // Visible chunks ordered front to back by the distance of their center.
+    std::vector<std::pair<float, std::size_t> > visible, prefetch;
+    for (std::size_t i(0); i < inside.size(); ++i)
+    {
+        if (!inside[i] && (!ahead[i] || m_chunk_slot[i] >= 0))
+        {
+            continue;
+        }
+
+        SurfelChunk const& chunk = m_file.chunk(i);
+        Vector4f center(0.5f * (chunk.bounds_min[0] + chunk.bounds_max[0]),
+            0.5f * (chunk.bounds_min[1] + chunk.bounds_max[1]),
+            0.5f * (chunk.bounds_min[2] + chunk.bounds_max[2]), 1.0f);
+        float distance = (modelview * center).head<3>().squaredNorm();
+
+        (inside[i] ? visible : prefetch).push_back(
+            std::make_pair(distance, i));
+    }
+
+    std::sort(visible.begin(), visible.end());
+    std::sort(prefetch.begin(), prefetch.end());
+
+    // Resident chunks in view must not be evicted by this frame's uploads.
+    for (std::size_t i(0); i < visible.size(); ++i)
+    {
+        long slot = m_chunk_slot[visible[i].second];
+        if (slot >= 0)
+        {
+            m_slot_used[slot] = m_frame;
+        }
+    }
+
+    std::vector<LoadedChunk> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_requests.clear();
+        m_next_request = 0;
+
+        for (std::size_t i(0); i < visible.size() + prefetch.size(); ++i)
+        {
+            std::size_t chunk = i < visible.size() ? visible[i].second
+                : prefetch[i - visible.size()].second;
+
+            if (m_chunk_slot[chunk] < 0 && !m_queued[chunk]
+                && !m_failed[chunk])
+            {
+                m_requests.push_back(chunk);
+            }
+        }
+
+        while (!m_loaded.empty() && loaded.size() < m_max_uploads)
+        {
+            loaded.push_back(std::move(m_loaded.front()));
+            m_loaded.pop_front();
+            m_queued[loaded.back().chunk] = 0;
+        }
+    }
+
+    m_condition.notify_one();
+
+    // Chunks that left the view while loading are dropped, they are
+    // requested again when they come back.
+    for (std::size_t i(0); i < loaded.size(); ++i)
+    {
+        std::size_t chunk = loaded[i].chunk;
+
+        if ((inside[chunk] || ahead[chunk]) && m_chunk_slot[chunk] < 0)
+        {
+            upload(loaded[i]);
+        }
+    }
+
+    m_draw_first.clear();
+    m_draw_count.clear();
+
+    for (std::size_t i(0); i < visible.size(); ++i)
+    {
+        long slot = m_chunk_slot[visible[i].second];
+        if (slot >= 0)
+        {
+            m_draw_first.push_back(static_cast<GLint>(slot * m_slot_size));
+            m_draw_count.push_back(static_cast<GLsizei>(
+                m_file.chunk(visible[i].second).count));
+        }
+    }
+
+    m_num_visible = visible.size();
+}
+
+bool
+SurfelChunkCache::upload(LoadedChunk const& loaded)
+{
+    std::size_t slot;
+    if (!m_free_slots.empty())
+    {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    }
+    else
+    {
+        slot = evict();
+    }
+
+    // Every slot holds a chunk in view, the budget is too small for it.
+    if (slot == no_slot)
+    {
+        return false;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, slot * m_slot_size * m_record_size,
+        loaded.records.size(), loaded.records.data());
+
+    if (m_packed)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_plane_vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, slot * m_slot_size * m_plane_size,
+            loaded.planes.size() * sizeof(GLuint), loaded.planes.data());
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_uploaded_bytes += loaded.records.size()
+        + loaded.planes.size() * sizeof(GLuint);
+
+    m_slot_chunk[slot] = static_cast<long>(loaded.chunk);
+    m_chunk_slot[loaded.chunk] = static_cast<long>(slot);
+    m_slot_used[slot] = m_frame;
+
+    return true;
+}
+
+// Frees the least recently drawn slot not used in the current frame. A
+// linear scan, there are at most a few thousand slots.
+std::size_t
+SurfelChunkCache::evict()
+{
+    std::size_t oldest(no_slot);
+
+    for (std::size_t i(0); i < m_num_slots; ++i)
+    {
+        if (m_slot_used[i] < m_frame && (oldest == no_slot
+            || m_slot_used[i] < m_slot_used[oldest]))
+        {
+            oldest = i;
+        }
+    }
+
+    if (oldest != no_slot)
+    {
+        m_chunk_slot[m_slot_chunk[oldest]] = -1;
+        m_slot_chunk[oldest] = -1;
+    }
+
+    return oldest;
+}
+
+void
+SurfelChunkCache::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_condition.wait(lock, [this]
+        {
+            return m_stop || (m_next_request < m_requests.size()
+                && m_loaded.size() < loaded_per_upload * m_max_uploads);
+        });
+
+        if (m_stop)
+        {
+            break;
+        }
+
+        std::size_t chunk = m_requests[m_next_request++];
+        if (m_queued[chunk] || m_failed[chunk])
+        {
+            continue;
+        }
+
+        m_queued[chunk] = 1;
+        lock.unlock();
+
+        LoadedChunk loaded;
+        bool complete(true);
+
+        try
+        {
+            load(chunk, loaded);
+        }
+        catch (std::runtime_error const& e)
+        {
+            std::cerr << e.what();
+            complete = false;
+        }
+
+        lock.lock();
+
+        if (complete)
+        {
+            m_loaded.push_back(std::move(loaded));
+        }
+        else
+        {
+            m_queued[chunk] = 0;
+            m_failed[chunk] = 1;
+        }
+    }
+}
+
+// Runs on the loader thread. Reading plain chunks from the mapping is what
+// pulls them from disk.
+void
+SurfelChunkCache::load(std::size_t chunk, LoadedChunk& loaded) const
+{
+    std::size_t n = m_file.chunk(chunk).count;
+    loaded.chunk = chunk;
+
+    if (!m_packed)
+    {
+        loaded.records.resize(n * sizeof(Surfel));
+        m_file.decode_chunk(chunk, reinterpret_cast<Surfel*>(
+            loaded.records.data()));
+        return;
+    }
+
+    std::vector<Surfel> surfels(n);
+    m_file.decode_chunk(chunk, surfels.data());
+
+    loaded.records.resize(n * sizeof(PackedSurfel));
+    pack_surfels(surfels.data(), n, reinterpret_cast<PackedSurfel*>(
+        loaded.records.data()));
+
+    loaded.planes.resize(n);
+    pack_clip_planes(surfels.data(), n, loaded.planes.data());
+}
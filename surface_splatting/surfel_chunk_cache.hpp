@@ -0,0 +1,155 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_CHUNK_CACHE_HPP
+#define SURFEL_CHUNK_CACHE_HPP
+
+#include "surfel_file.hpp"
+#include "packed_surfel.hpp"
+
+#include <GLviz>
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Out-of-core geometry for SplatRenderer::set_geometry(SurfelChunkCache*).
+// The chunks of a surfel file are read and decoded by a background thread
+// and kept in one vertex buffer of a fixed byte budget, split into a slot
+// per chunk. Every frame the chunks whose bounds intersect the view frustum
+// are requested nearest first, followed by those entering the frustum
+// extrapolated from the camera motion of the last frame. Loaded chunks take
+// a free slot or the least recently drawn one. Only resident chunks inside
+// the frustum are drawn, missing ones appear as they arrive.
+//
+// The file has to stay open while the cache exists. The cache owns OpenGL
+// objects, it has to be created and destroyed with the render context
+// current.
+class SurfelChunkCache
+{
+
+public:
+    // Stores PackedSurfel if packed is set, which fits about twice as many
+    // surfels into the budget. The renderer draws the cache in its format
+    // regardless of SplatRenderer::packed_format().
+    SurfelChunkCache(SurfelFile const& file,
+        std::size_t budget = std::size_t(1) << 30, bool packed = false);
+    ~SurfelChunkCache();
+
+    // Bytes of vertex buffer memory. Changing the budget evicts all chunks.
+    std::size_t budget() const;
+    void set_budget(std::size_t budget);
+
+    // How many frames ahead the camera motion is extrapolated to prefetch
+    // chunks.
+    float prefetch_frames() const;
+    void set_prefetch_frames(float frames);
+
+    // Upper bound on chunks copied into the vertex buffer per frame.
+    unsigned int max_uploads_per_frame() const;
+    void set_max_uploads_per_frame(unsigned int max_uploads);
+
+    bool packed() const;
+
+    // Culls the chunks against the frustum of camera, requests the missing
+    // ones and uploads the chunks loaded since the last call. Called by the
+    // renderer once per frame.
+    void update(GLviz::Camera const& camera);
+
+    // Buffers of the resident chunks, they change when the budget does.
+    // The plane buffer holds clipping planes as GL_INT_2_10_10_10_REV in
+    // the packed format and is zero otherwise.
+    GLuint vertex_buffer() const;
+    GLuint plane_buffer() const;
+
+    // Vertex ranges of the resident chunks inside the frustum.
+    std::vector<GLint> const& draw_first() const;
+    std::vector<GLsizei> const& draw_count() const;
+
+    std::size_t num_visible() const;
+    std::size_t num_resident() const;
+    std::size_t num_slots() const;
+
+    // Bytes copied into the slots by the last update().
+    std::size_t uploaded_bytes() const;
+
+private:
+    struct LoadedChunk
+    {
+        std::size_t chunk;
+        std::vector<char> records;
+        std::vector<GLuint> planes;
+    };
+
+    void allocate();
+    void release();
+
+    void cull(Eigen::Matrix4f const& clip, std::vector<char>& inside) const;
+    bool upload(LoadedChunk const& loaded);
+    std::size_t evict();
+
+    void run();
+    void load(std::size_t chunk, LoadedChunk& loaded) const;
+
+private:
+    SurfelFile const& m_file;
+    std::size_t m_budget;
+    bool m_packed;
+    float m_prefetch_frames;
+    unsigned int m_max_uploads;
+
+    // Bytes of a surfel in the vertex and plane buffer, surfels per slot.
+    std::size_t m_record_size, m_plane_size, m_slot_size;
+
+    GLuint m_vbo, m_plane_vbo;
+    std::size_t m_num_slots;
+
+    // Per chunk: its slot or -1. Per slot: its chunk or -1 and the frame
+    // it was last drawn in.
+    std::vector<long> m_chunk_slot, m_slot_chunk;
+    std::vector<unsigned long> m_slot_used;
+    std::vector<std::size_t> m_free_slots;
+    unsigned long m_frame;
+
+    Eigen::Matrix4f m_previous_clip;
+    bool m_has_previous;
+
+    std::vector<GLint> m_draw_first;
+    std::vector<GLsizei> m_draw_count;
+    std::size_t m_num_visible;
+    std::size_t m_uploaded_bytes;
+
+    // Shared with the loader thread. m_requests is replaced every frame,
+    // m_queued marks chunks being loaded or waiting in m_loaded.
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<std::size_t> m_requests;
+    std::size_t m_next_request;
+    std::vector<char> m_queued, m_failed;
+    std::deque<LoadedChunk> m_loaded;
+    bool m_stop;
+
+    std::thread m_thread;
+};
+
+#endif // SURFEL_CHUNK_CACHE_HPP
@@ -0,0 +1,204 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_coverage.hpp"
+#include "kd_tree.hpp"
+#include "parallel.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace
+{
+
+struct CellVertex
+{
+    Vector2f x;
+
+    // Set if the vertex lies on the initial square rather than only on
+    // bisectors, the cell is open there.
+    bool open;
+
+    // Set if the edge to the next vertex lies on the initial square.
+    bool open_edge;
+};
+
+// Intersects the convex polygon with the half-plane x . d <= h, which is
+// the side of the bisector towards the origin.
+void
+clip(std::vector<CellVertex> const& polygon, Vector2f const& d, float h,
+    std::vector<CellVertex>& clipped)
+{
+    clipped.clear();
+
+    for (std::size_t i(0); i < polygon.size(); ++i)
+    {
+        CellVertex const& a = polygon[i];
+        CellVertex const& b = polygon[(i + 1) % polygon.size()];
+
+        float da = a.x.dot(d) - h, db = b.x.dot(d) - h;
+
+        if (da <= 0.0f)
+        {
+            clipped.push_back(a);
+        }
+
+        // Where the bisector crosses an edge of the square the cell stays
+        // open. Leaving the half-plane, the edge to the next vertex is the
+        // bisector, entering it the rest of the crossed edge.
+        if ((da < 0.0f) != (db < 0.0f) && da != db)
+        {
+            CellVertex x;
+            x.x = a.x + (da / (da - db)) * (b.x - a.x);
+            x.open = a.open_edge;
+            x.open_edge = db < 0.0f && a.open_edge;
+            clipped.push_back(x);
+        }
+    }
+}
+
+float
+coverage_scale(KdTree const& tree, Surfel const* surfels, std::size_t i,
+    CoverageScaling const& scaling, std::vector<unsigned int>& indices,
+    std::vector<float>& distances, std::vector<CellVertex>& cell,
+    std::vector<CellVertex>& clipped)
+{
+    Surfel const& s = surfels[i];
+
+    Vector3f n = s.u.cross(s.v);
+    if (n.isZero())
+    {
+        return 1.0f;
+    }
+    n.normalize();
+
+    unsigned int k = tree.knn(s.c, scaling.neighbours, indices, distances);
+    if (k < 2)
+    {
+        return 1.0f;
+    }
+
+    // Orthonormal tangent frame and the map from it to the coordinates of
+    // the ellipse, in which the ellipse is the unit circle.
+    Vector3f t0 = s.u.normalized();
+    Vector3f t1 = n.cross(t0);
+
+    Matrix2f axes;
+    axes << s.u.dot(t0), s.v.dot(t0),
+            s.u.dot(t1), s.v.dot(t1);
+    if (!(std::abs(axes.determinant()) > 0.0f))
+    {
+        return 1.0f;
+    }
+
+    Matrix2f to_ellipse = axes.inverse();
+
+    float r = std::sqrt(distances[k - 1]);
+
+    CellVertex corners[4] = {
+        { Vector2f(-r, -r), true, true }, { Vector2f(r, -r), true, true },
+        { Vector2f(r, r), true, true }, { Vector2f(-r, r), true, true } };
+    cell.assign(corners, corners + 4);
+
+    for (unsigned int j(0); j < k; ++j)
+    {
+        Vector3f d = surfels[indices[j]].c - s.c;
+        Vector2f x(d.dot(t0), d.dot(t1));
+
+        float x2 = x.squaredNorm();
+        if (x2 > 0.0f)
+        {
+            clip(cell, x, 0.5f * x2, clipped);
+            cell.swap(clipped);
+        }
+    }
+
+    float scale(0.0f);
+    bool closed(false);
+
+    for (std::size_t j(0); j < cell.size(); ++j)
+    {
+        if (!cell[j].open)
+        {
+            scale = std::max(scale, (to_ellipse * cell[j].x).norm());
+            closed = true;
+        }
+        else
+        {
+            scale = std::max(scale, std::min(1.0f,
+                (to_ellipse * cell[j].x).norm()));
+        }
+    }
+
+    if (!closed)
+    {
+        return 1.0f;
+    }
+
+    return std::min(std::max(scaling.margin * scale, scaling.min_scale),
+        scaling.max_scale);
+}
+
+}
+
+void
+coverage_scales(Surfel const* surfels, std::size_t n,
+    std::vector<float>& scales, CoverageScaling const& scaling)
+{
+    std::vector<Vector3f> centers(n);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        centers[i] = surfels[i].c;
+    }
+
+    KdTree tree(centers);
+    scales.resize(n);
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        std::vector<unsigned int> indices;
+        std::vector<float> distances;
+        std::vector<CellVertex> cell, clipped;
+
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            scales[i] = coverage_scale(tree, surfels, i, scaling, indices,
+                distances, cell, clipped);
+        }
+    });
+}
+
+void
+scale_to_coverage(std::vector<Surfel>& surfels,
+    CoverageScaling const& scaling)
+{
+    std::vector<float> scales;
+    coverage_scales(surfels.data(), surfels.size(), scales, scaling);
+
+    parallel_for(0, surfels.size(), [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            surfels[i].u *= scales[i];
+            surfels[i].v *= scales[i];
+        }
+    });
+}
@@ -0,0 +1,57 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_COVERAGE_HPP
+#define SURFEL_COVERAGE_HPP
+
+#include "surfel.hpp"
+
+#include <cstddef>
+#include <vector>
+
+struct CoverageScaling
+{
+    CoverageScaling()
+        : neighbours(16), margin(1.05f), min_scale(0.1f), max_scale(4.0f)
+    {
+    }
+
+    // Neighbours that bound the Voronoi cell of a surfel, including itself.
+    unsigned int neighbours;
+
+    // Extra factor on top of the exact cell coverage against round-off
+    // and curvature.
+    float margin;
+
+    float min_scale, max_scale;
+};
+
+// Computes for every surfel the factor on u and v that makes its ellipse
+// just cover its Voronoi cell among the neighbouring centers in its
+// tangent plane. As the cells tile the surface the scaled splats leave no
+// holes while dense regions keep little overlap. Directions in which the
+// cell is open, as on borders, keep the original extent. Runs on all cores.
+void coverage_scales(Surfel const* surfels, std::size_t n,
+    std::vector<float>& scales,
+    CoverageScaling const& scaling = CoverageScaling());
+
+// Multiplies u and v of every surfel by its coverage scale. The renderer's
+// radius_scale stays a global factor on top.
+void scale_to_coverage(std::vector<Surfel>& surfels,
+    CoverageScaling const& scaling = CoverageScaling());
+
+#endif // SURFEL_COVERAGE_HPP
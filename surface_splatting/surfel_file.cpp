@@ -0,0 +1,834 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_file.hpp"
+#include "surfel_order.hpp"
+#include "packed_surfel.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace Eigen;
+
+namespace
+{
+
+const char surfel_file_magic[8] = { 'S', 'U', 'R', 'F', 'E', 'L', 'S', 0 };
+const std::uint32_t surfel_file_version = 1;
+const std::uint32_t compressed_file_version = 2;
+const std::uint64_t surfel_data_alignment = 64;
+const std::uint64_t surfel_chunk_alignment = 4;
+
+const std::size_t group_size = 128;
+const unsigned int num_columns = 12;
+const unsigned int column_bits[num_columns] = {
+    16, 16, 16, 10, 10, 12, 16, 16, 8, 8, 8, 8 };
+const unsigned char exception_flag = 0x80;
+
+// Centers are quantized to this fraction of the median minor radius of the
+// surfels in a chunk.
+const float position_precision = 1.0f / 32.0f;
+
+static_assert(sizeof(SurfelFileHeader) == 72,
+    "SurfelFileHeader must not contain padding");
+static_assert(sizeof(SurfelChunk) == 40,
+    "SurfelChunk must not contain padding");
+static_assert(sizeof(Surfel) == 52,
+    "Surfel records must match the vertex layout");
+
+void
+throw_error(std::string const& filename, char const* what)
+{
+    std::ostringstream error_message;
+    error_message << "Error: " << filename << ": " << what << "."
+        << std::endl;
+
+    throw std::runtime_error(error_message.str().c_str());
+}
+
+// Axis aligned box around the ellipse, whose half extent along axis k is
+// sqrt(u_k^2 + v_k^2).
+void
+extend_bounds(Surfel const& s, float* min, float* max)
+{
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        float e = std::sqrt(s.u(k) * s.u(k) + s.v(k) * s.v(k));
+
+        min[k] = std::min(min[k], s.c(k) - e);
+        max[k] = std::max(max[k], s.c(k) + e);
+    }
+}
+
+void
+reset_bounds(float* min, float* max)
+{
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        min[k] = std::numeric_limits<float>::max();
+        max[k] = -std::numeric_limits<float>::max();
+    }
+}
+
+inline std::uint32_t
+column_mask(unsigned int bits)
+{
+    return bits < 32 ? (1u << bits) - 1u : ~0u;
+}
+
+// Wraps the difference to a signed value of the column width and moves the
+// sign to the lowest bit, small differences of either sign become small
+// unsigned numbers of at most the column width.
+inline std::uint32_t
+zigzag(std::uint32_t value, std::uint32_t previous, unsigned int bits)
+{
+    std::uint32_t d = (value - previous) << (32 - bits);
+    std::int32_t s = static_cast<std::int32_t>(d) >> (32 - bits);
+
+    return ((static_cast<std::uint32_t>(s) << 1)
+        ^ static_cast<std::uint32_t>(s >> 31)) & column_mask(bits);
+}
+
+inline std::uint32_t
+unzigzag(std::uint32_t code, std::uint32_t previous, unsigned int bits)
+{
+    std::uint32_t d = (code >> 1) ^ (0u - (code & 1u));
+    return (previous + d) & column_mask(bits);
+}
+
+void
+write_bits(std::uint32_t const* values, std::size_t m, unsigned int width,
+    std::vector<unsigned char>& output)
+{
+    std::uint64_t bits(0);
+    unsigned int num_bits(0);
+
+    for (std::size_t i(0); i < m; ++i)
+    {
+        bits |= static_cast<std::uint64_t>(values[i]) << num_bits;
+        num_bits += width;
+
+        while (num_bits >= 8)
+        {
+            output.push_back(static_cast<unsigned char>(bits));
+            bits >>= 8;
+            num_bits -= 8;
+        }
+    }
+
+    if (num_bits > 0)
+    {
+        output.push_back(static_cast<unsigned char>(bits));
+    }
+}
+
+bool
+read_bits(unsigned char const*& data, unsigned char const* end,
+    std::size_t m, unsigned int width, std::uint32_t* values)
+{
+    if (static_cast<std::uint64_t>(end - data) < (m * width + 7) / 8)
+    {
+        return false;
+    }
+
+    std::uint64_t bits(0);
+    unsigned int num_bits(0);
+    std::uint32_t mask = column_mask(width);
+
+    for (std::size_t i(0); i < m; ++i)
+    {
+        while (num_bits < width)
+        {
+            bits |= static_cast<std::uint64_t>(*data++) << num_bits;
+            num_bits += 8;
+        }
+
+        values[i] = static_cast<std::uint32_t>(bits) & mask;
+
+        bits >>= width;
+        num_bits -= width;
+    }
+
+    return true;
+}
+
+// A column is packed with the width that takes the least space if the few
+// codes not fitting into it are stored as exceptions, a byte for the index
+// and their remaining high bits. Jumps of the Hilbert curve would otherwise
+// widen the whole group.
+void
+encode_column(std::uint32_t const* codes, std::size_t m,
+    std::vector<unsigned char>& output)
+{
+    std::uint32_t largest = *std::max_element(codes, codes + m);
+
+    unsigned int width(0);
+    while (width < 32 && (largest >> width) != 0)
+    {
+        ++width;
+    }
+
+    unsigned int best_width(width);
+    std::size_t best_size = m * width, num_exceptions(0);
+
+    for (unsigned int w(0); w < width; ++w)
+    {
+        std::size_t e(0);
+        for (std::size_t i(0); i < m; ++i)
+        {
+            e += (codes[i] >> w) != 0;
+        }
+
+        std::size_t size = m * w + 16 + 8 * e
+            + (e * (width - w) + 7) / 8 * 8;
+
+        if (size < best_size)
+        {
+            best_width = w;
+            best_size = size;
+            num_exceptions = e;
+        }
+    }
+
+    if (best_width == width)
+    {
+        output.push_back(static_cast<unsigned char>(width));
+        write_bits(codes, m, width, output);
+        return;
+    }
+
+    std::uint32_t low[group_size], high[group_size];
+    std::size_t e(0);
+
+    output.push_back(static_cast<unsigned char>(best_width
+        | exception_flag));
+    output.push_back(static_cast<unsigned char>(num_exceptions));
+    output.push_back(static_cast<unsigned char>(width));
+
+    for (std::size_t i(0); i < m; ++i)
+    {
+        low[i] = codes[i] & column_mask(best_width);
+
+        if (codes[i] >> best_width)
+        {
+            output.push_back(static_cast<unsigned char>(i));
+            high[e++] = codes[i] >> best_width;
+        }
+    }
+
+    write_bits(high, e, width - best_width, output);
+    write_bits(low, m, best_width, output);
+}
+
+bool
+decode_column(unsigned char const*& data, unsigned char const* end,
+    std::size_t m, unsigned int bits, std::uint32_t* codes)
+{
+    if (data == end)
+    {
+        return false;
+    }
+
+    unsigned int width = *data & ~exception_flag;
+    bool exceptions = (*data++ & exception_flag) != 0;
+
+    if (width > bits)
+    {
+        return false;
+    }
+
+    if (!exceptions)
+    {
+        return read_bits(data, end, m, width, codes);
+    }
+
+    if (end - data < 2)
+    {
+        return false;
+    }
+
+    std::size_t e = *data++;
+    unsigned int full_width = *data++;
+
+    if (e > m || full_width <= width || full_width > bits
+        || static_cast<std::size_t>(end - data) < e)
+    {
+        return false;
+    }
+
+    unsigned char const* indices = data;
+    data += e;
+
+    std::uint32_t high[group_size];
+    if (!read_bits(data, end, e, full_width - width, high)
+        || !read_bits(data, end, m, width, codes))
+    {
+        return false;
+    }
+
+    for (std::size_t i(0); i < e; ++i)
+    {
+        if (indices[i] >= m)
+        {
+            return false;
+        }
+
+        codes[indices[i]] |= high[i] << width;
+    }
+
+    return true;
+}
+
+void
+split_columns(PackedSurfel const& p, float const* min, float const* scale,
+    float levels, std::uint32_t* values)
+{
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        float q = std::floor((p.c[k] - min[k]) * scale[k] + 0.5f);
+        values[k] = static_cast<std::uint32_t>(
+            std::max(0.0f, std::min(levels, q)));
+    }
+
+    values[3] = p.frame & 0x3ffu;
+    values[4] = (p.frame >> 10) & 0x3ffu;
+    values[5] = p.frame >> 20;
+    values[6] = p.radii[0];
+    values[7] = p.radii[1];
+
+    for (unsigned int k(0); k < 4; ++k)
+    {
+        values[8 + k] = (p.rgba >> (8 * k)) & 0xffu;
+    }
+}
+
+void
+join_columns(std::uint32_t const* values, float const* min,
+    float const* step, PackedSurfel& p)
+{
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        p.c[k] = min[k] + static_cast<float>(values[k]) * step[k];
+    }
+
+    p.frame = values[3] | (values[4] << 10) | (values[5] << 20);
+    p.radii[0] = static_cast<unsigned short>(values[6]);
+    p.radii[1] = static_cast<unsigned short>(values[7]);
+    p.rgba = values[8] | (values[9] << 8) | (values[10] << 16)
+        | (values[11] << 24);
+}
+
+// Fewest bits per axis for a quantization step of position_precision times
+// the median minor radius of the chunk.
+unsigned int
+position_bits(Surfel const* surfels, SurfelChunk const& chunk)
+{
+    std::vector<float> radii(chunk.count);
+    for (std::size_t i(0); i < radii.size(); ++i)
+    {
+        radii[i] = std::sqrt(std::min(surfels[i].u.squaredNorm(),
+            surfels[i].v.squaredNorm()));
+    }
+
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2,
+        radii.end());
+    float step = position_precision * radii[radii.size() / 2];
+
+    float extent(0.0f);
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        extent = std::max(extent, chunk.bounds_max[k] - chunk.bounds_min[k]);
+    }
+
+    unsigned int bits(1);
+    while (bits < 16 && extent > step * static_cast<float>(
+        column_mask(bits)))
+    {
+        ++bits;
+    }
+
+    return bits;
+}
+
+void
+quantization(SurfelChunk const& chunk, unsigned int bits, float* scale,
+    float* step)
+{
+    float levels = static_cast<float>(column_mask(bits));
+
+    for (unsigned int k(0); k < 3; ++k)
+    {
+        float extent = chunk.bounds_max[k] - chunk.bounds_min[k];
+
+        scale[k] = extent > 0.0f ? levels / extent : 0.0f;
+        step[k] = extent / levels;
+    }
+}
+
+void
+encode_chunk(Surfel const* surfels, PackedSurfel const* packed,
+    SurfelChunk const& chunk, std::vector<unsigned char>& output)
+{
+    unsigned int bits[num_columns];
+    std::copy(column_bits, column_bits + num_columns, bits);
+    bits[0] = bits[1] = bits[2] = position_bits(surfels, chunk);
+
+    output.push_back(static_cast<unsigned char>(bits[0]));
+
+    float scale[3], step[3];
+    quantization(chunk, bits[0], scale, step);
+    float levels = static_cast<float>(column_mask(bits[0]));
+
+    std::uint32_t previous[num_columns] = { 0 };
+    std::uint32_t codes[num_columns][group_size];
+
+    for (std::size_t g(0); g < chunk.count; g += group_size)
+    {
+        std::size_t m = std::min<std::size_t>(group_size, chunk.count - g);
+
+        for (std::size_t i(0); i < m; ++i)
+        {
+            std::uint32_t values[num_columns];
+            split_columns(packed[g + i], chunk.bounds_min, scale, levels,
+                values);
+
+            for (unsigned int j(0); j < num_columns; ++j)
+            {
+                codes[j][i] = zigzag(values[j], previous[j], bits[j]);
+                previous[j] = values[j];
+            }
+        }
+
+        for (unsigned int j(0); j < num_columns; ++j)
+        {
+            encode_column(codes[j], m, output);
+        }
+    }
+}
+
+// Returns false if the data ends early or is out of range.
+bool
+decode_chunk_data(unsigned char const* data, std::uint64_t size,
+    SurfelChunk const& chunk, Surfel* surfels)
+{
+    unsigned char const* end = data + size;
+
+    if (data == end || *data < 1 || *data > column_bits[0])
+    {
+        return false;
+    }
+
+    unsigned int bits[num_columns];
+    std::copy(column_bits, column_bits + num_columns, bits);
+    bits[0] = bits[1] = bits[2] = *data++;
+
+    float scale[3], step[3];
+    quantization(chunk, bits[0], scale, step);
+
+    std::uint32_t previous[num_columns] = { 0 };
+    std::uint32_t values[num_columns][group_size];
+
+    for (std::size_t g(0); g < chunk.count; g += group_size)
+    {
+        std::size_t m = std::min<std::size_t>(group_size, chunk.count - g);
+
+        for (unsigned int j(0); j < num_columns; ++j)
+        {
+            if (!decode_column(data, end, m, bits[j], values[j]))
+            {
+                return false;
+            }
+
+            for (std::size_t i(0); i < m; ++i)
+            {
+                previous[j] = unzigzag(values[j][i], previous[j], bits[j]);
+                values[j][i] = previous[j];
+            }
+        }
+
+        for (std::size_t i(0); i < m; ++i)
+        {
+            std::uint32_t row[num_columns];
+            for (unsigned int j(0); j < num_columns; ++j)
+            {
+                row[j] = values[j][i];
+            }
+
+            PackedSurfel p;
+            join_columns(row, chunk.bounds_min, step, p);
+            unpack_surfel(p, surfels[g + i]);
+        }
+    }
+
+    return true;
+}
+
+bool
+clipped(Surfel const* surfels, std::size_t n)
+{
+    for (std::size_t i(0); i < n; ++i)
+    {
+        if (surfels[i].p != Vector3f::Zero())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+void
+write_surfel_file(std::string const& filename, Surfel const* surfels,
+    std::size_t n, unsigned int chunk_size, SurfelEncoding encoding)
+{
+    chunk_size = std::max(chunk_size, 1u);
+
+    std::vector<unsigned int> order = spatial_order(surfels, n,
+        HilbertCurve);
+
+    SurfelFileHeader header;
+    std::memcpy(header.magic, surfel_file_magic, sizeof(header.magic));
+    header.version = encoding == CompressedSurfels ? compressed_file_version
+        : surfel_file_version;
+    header.record_size = sizeof(Surfel);
+    header.num_surfels = n;
+    header.num_chunks = static_cast<std::uint32_t>((n + chunk_size - 1)
+        / chunk_size);
+    header.chunk_size = chunk_size;
+    header.chunk_table_offset = sizeof(SurfelFileHeader);
+
+    std::uint64_t table_end = header.chunk_table_offset
+        + header.num_chunks * sizeof(SurfelChunk);
+    header.data_offset = (table_end + surfel_data_alignment - 1)
+        / surfel_data_alignment * surfel_data_alignment;
+
+    reset_bounds(header.bounds_min, header.bounds_max);
+
+    std::vector<SurfelChunk> chunks(header.num_chunks);
+    for (std::size_t j(0); j < chunks.size(); ++j)
+    {
+        SurfelChunk& chunk = chunks[j];
+        std::size_t begin = j * chunk_size;
+
+        chunk.count = static_cast<std::uint32_t>(std::min<std::size_t>(
+            chunk_size, n - begin));
+        chunk.flags = 0;
+
+        reset_bounds(chunk.bounds_min, chunk.bounds_max);
+        for (std::size_t i(begin); i < begin + chunk.count; ++i)
+        {
+            extend_bounds(surfels[order[i]], chunk.bounds_min,
+                chunk.bounds_max);
+        }
+
+        for (unsigned int k(0); k < 3; ++k)
+        {
+            header.bounds_min[k] = std::min(header.bounds_min[k],
+                chunk.bounds_min[k]);
+            header.bounds_max[k] = std::max(header.bounds_max[k],
+                chunk.bounds_max[k]);
+        }
+    }
+
+    // Chunks are encoded in parallel, the output stays in file order.
+    std::vector<std::vector<unsigned char> > encoded(chunks.size());
+
+    if (encoding == CompressedSurfels)
+    {
+        std::vector<Surfel> records(n);
+        for (std::size_t i(0); i < n; ++i)
+        {
+            records[i] = surfels[order[i]];
+        }
+
+        std::vector<PackedSurfel> packed(n);
+        pack_surfels(records.data(), n, packed.data());
+
+        parallel_for(0, chunks.size(), [&](std::size_t first,
+            std::size_t last)
+        {
+            for (std::size_t j(first); j < last; ++j)
+            {
+                std::size_t begin = j * chunk_size;
+
+                if (!clipped(records.data() + begin, chunks[j].count))
+                {
+                    encode_chunk(records.data() + begin,
+                        packed.data() + begin, chunks[j], encoded[j]);
+                    chunks[j].flags = SurfelChunkCompressed;
+                }
+            }
+        }, 1);
+    }
+
+    std::uint64_t offset = header.data_offset;
+    for (std::size_t j(0); j < chunks.size(); ++j)
+    {
+        std::uint64_t size = chunks[j].flags & SurfelChunkCompressed
+            ? encoded[j].size()
+            : static_cast<std::uint64_t>(chunks[j].count) * sizeof(Surfel);
+
+        chunks[j].offset = offset;
+        offset += (size + surfel_chunk_alignment - 1)
+            / surfel_chunk_alignment * surfel_chunk_alignment;
+    }
+
+    std::ofstream output(filename, std::ios::out | std::ios::binary);
+
+    if (output.fail())
+    {
+        throw_error(filename, "can not open for writing");
+    }
+
+    output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    output.write(reinterpret_cast<char const*>(chunks.data()),
+        chunks.size() * sizeof(SurfelChunk));
+
+    std::vector<char> padding(header.data_offset - table_end, 0);
+    output.write(padding.data(), padding.size());
+
+    std::vector<Surfel> records;
+    for (std::size_t j(0); j < chunks.size(); ++j)
+    {
+        if (chunks[j].flags & SurfelChunkCompressed)
+        {
+            std::vector<unsigned char>& data = encoded[j];
+            data.resize((data.size() + surfel_chunk_alignment - 1)
+                / surfel_chunk_alignment * surfel_chunk_alignment, 0);
+
+            output.write(reinterpret_cast<char const*>(data.data()),
+                data.size());
+            continue;
+        }
+
+        std::size_t begin = j * chunk_size;
+
+        records.resize(chunks[j].count);
+        for (std::size_t i(0); i < records.size(); ++i)
+        {
+            records[i] = surfels[order[begin + i]];
+        }
+
+        output.write(reinterpret_cast<char const*>(records.data()),
+            records.size() * sizeof(Surfel));
+    }
+
+    output.close();
+
+    if (output.fail())
+    {
+        throw_error(filename, "write failed");
+    }
+}
+
+SurfelFile::SurfelFile()
+    : m_header(nullptr), m_chunks(nullptr), m_compressed(false)
+{
+}
+
+SurfelFile::SurfelFile(std::string const& filename)
+    : m_header(nullptr), m_chunks(nullptr), m_compressed(false)
+{
+    open(filename);
+}
+
+void
+SurfelFile::open(std::string const& filename)
+{
+    close();
+    m_file.open(filename);
+
+    char const* data = m_file.data();
+    std::uint64_t size = m_file.size();
+
+    if (size < sizeof(SurfelFileHeader)
+        || std::memcmp(data, surfel_file_magic, sizeof(surfel_file_magic)))
+    {
+        close();
+        throw_error(filename, "not a surfel file");
+    }
+
+    SurfelFileHeader const* header =
+        reinterpret_cast<SurfelFileHeader const*>(data);
+
+    if ((header->version != surfel_file_version
+        && header->version != compressed_file_version)
+        || header->record_size != sizeof(Surfel))
+    {
+        close();
+        throw_error(filename, "unsupported surfel file version");
+    }
+
+    bool valid = header->chunk_table_offset <= size
+        && header->num_chunks <= (size - header->chunk_table_offset)
+            / sizeof(SurfelChunk)
+        && header->chunk_table_offset % alignof(SurfelChunk) == 0
+        && header->data_offset % alignof(Surfel) == 0;
+
+    // The chunks follow each other in file order, each one ends where the
+    // next one starts. Plain chunks have to match their record count
+    // exactly, so a file without compressed chunks has no gaps for
+    // surfels().
+    SurfelChunk const* chunks = reinterpret_cast<SurfelChunk const*>(
+        data + header->chunk_table_offset);
+    std::uint64_t count(0);
+
+    if (valid)
+    {
+        m_first.resize(header->num_chunks);
+        m_sizes.resize(header->num_chunks);
+    }
+
+    for (std::uint32_t j(0); valid && j < header->num_chunks; ++j)
+    {
+        std::uint64_t offset = chunks[j].offset;
+        std::uint64_t next = j + 1 < header->num_chunks
+            ? chunks[j + 1].offset : size;
+
+        bool compressed = chunks[j].flags == SurfelChunkCompressed;
+
+        valid = offset % surfel_chunk_alignment == 0 && offset <= next
+            && next <= size
+            && (j > 0 || offset == header->data_offset)
+            && (chunks[j].flags == 0 || (compressed
+                && header->version == compressed_file_version))
+            && (compressed || next - offset
+                == static_cast<std::uint64_t>(chunks[j].count)
+                    * sizeof(Surfel));
+
+        m_first[j] = static_cast<std::size_t>(count);
+        m_sizes[j] = next - offset;
+        m_compressed = m_compressed || compressed;
+
+        count += chunks[j].count;
+    }
+
+    if (!valid || count != header->num_surfels)
+    {
+        close();
+        throw_error(filename, "chunk table does not match the file size");
+    }
+
+    m_filename = filename;
+    m_header = header;
+    m_chunks = chunks;
+}
+
+void
+SurfelFile::close()
+{
+    m_file.close();
+
+    m_filename.clear();
+    m_header = nullptr;
+    m_chunks = nullptr;
+    m_first.clear();
+    m_sizes.clear();
+    m_compressed = false;
+}
+
+std::size_t
+SurfelFile::num_surfels() const
+{
+    return m_header ? static_cast<std::size_t>(m_header->num_surfels) : 0;
+}
+
+bool
+SurfelFile::compressed() const
+{
+    return m_compressed;
+}
+
+Surfel const*
+SurfelFile::surfels() const
+{
+    return m_header && !m_compressed ? reinterpret_cast<Surfel const*>(
+        m_file.data() + m_header->data_offset) : nullptr;
+}
+
+std::size_t
+SurfelFile::num_chunks() const
+{
+    return m_header ? m_header->num_chunks : 0;
+}
+
+SurfelChunk const&
+SurfelFile::chunk(std::size_t i) const
+{
+    return m_chunks[i];
+}
+
+Surfel const*
+SurfelFile::chunk_surfels(std::size_t i) const
+{
+    return m_chunks[i].flags & SurfelChunkCompressed ? nullptr
+        : reinterpret_cast<Surfel const*>(m_file.data()
+            + m_chunks[i].offset);
+}
+
+std::size_t
+SurfelFile::chunk_first(std::size_t i) const
+{
+    return m_first[i];
+}
+
+void
+SurfelFile::decode_chunk(std::size_t i, Surfel* surfels) const
+{
+    SurfelChunk const& chunk = m_chunks[i];
+
+    if (!(chunk.flags & SurfelChunkCompressed))
+    {
+        std::copy(chunk_surfels(i), chunk_surfels(i) + chunk.count, surfels);
+        return;
+    }
+
+    unsigned char const* data = reinterpret_cast<unsigned char const*>(
+        m_file.data() + chunk.offset);
+
+    if (!decode_chunk_data(data, m_sizes[i], chunk, surfels))
+    {
+        throw_error(m_filename, "corrupt compressed chunk");
+    }
+}
+
+void
+SurfelFile::decode(Surfel* surfels) const
+{
+    parallel_for(0, num_chunks(), [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i(first); i < last; ++i)
+        {
+            decode_chunk(i, surfels + m_first[i]);
+        }
+    }, 1);
+}
+
+SurfelFileHeader const&
+SurfelFile::header() const
+{
+    return *m_header;
+}
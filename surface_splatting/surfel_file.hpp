@@ -0,0 +1,158 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_FILE_HPP
+#define SURFEL_FILE_HPP
+
+#include "surfel.hpp"
+
+#include <GLviz>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary surfel file, little endian:
+//
+//   SurfelFileHeader
+//   SurfelChunk[num_chunks]      at chunk_table_offset
+//   records of every chunk       at SurfelChunk::offset
+//
+// Version 1 stores Surfel records as they are laid out in the vertex
+// buffer, chunks follow each other without gaps starting at data_offset,
+// which is 64 byte aligned. A chunk is a run of spatially close surfels
+// along a Hilbert curve, its bounds enclose the ellipses.
+//
+// Version 2 may store chunks compressed, each one decodes on its own. Chunks
+// start 4 byte aligned in file order and end where the next one begins.
+// A compressed chunk starts with a byte giving the bits per axis of the
+// centers, quantized to the chunk bounds. Its surfels are split into groups
+// of 128, every group holds 12 columns:
+//
+//   center x, y, z      quantized to the chunk bounds
+//   normal x, y         10 bit octahedral, as in PackedSurfel::frame
+//   angle of u          12 bit
+//   lengths of u, v     half floats
+//   red, green, blue, alpha
+//
+// A column stores the differences to the previous surfel of the chunk
+// wrapped to the width of the column and zigzag encoded, packed least
+// significant bits first into a whole number of bytes. It starts with a
+// byte giving the packing width. If its high bit is set, a byte with the
+// number of exceptions and one with their full width follow, then the
+// index of each exception, their bits above the packing width and finally
+// the low bits of all differences. Clipped surfels are kept in plain
+// chunks.
+struct SurfelFileHeader
+{
+    char            magic[8];           // "SURFELS" and a zero byte.
+    std::uint32_t   version;
+    std::uint32_t   record_size;        // Bytes per surfel record.
+    std::uint64_t   num_surfels;
+    std::uint32_t   num_chunks;
+    std::uint32_t   chunk_size;         // Maximum surfels per chunk.
+    float           bounds_min[3];
+    float           bounds_max[3];
+    std::uint64_t   chunk_table_offset;
+    std::uint64_t   data_offset;
+};
+
+struct SurfelChunk
+{
+    std::uint64_t   offset;             // Byte offset of the records.
+    std::uint32_t   count;
+    std::uint32_t   flags;              // SurfelChunkFlags.
+    float           bounds_min[3];
+    float           bounds_max[3];
+};
+
+enum SurfelChunkFlags
+{
+    SurfelChunkCompressed = 1
+};
+
+enum SurfelEncoding
+{
+    PlainSurfels,
+    CompressedSurfels
+};
+
+// Writes the surfels in chunks of at most chunk_size along a Hilbert curve
+// through their centers. Throws std::runtime_error on I/O errors.
+//
+// CompressedSurfels writes a version 2 file, usually 4 to 5 times smaller.
+// Centers are quantized to 1/32 of the median minor radius of their chunk,
+// the tangent frame to the precision of PackedSurfel, colors are exact.
+void write_surfel_file(std::string const& filename, Surfel const* surfels,
+    std::size_t n, unsigned int chunk_size = 65536,
+    SurfelEncoding encoding = PlainSurfels);
+
+// Reads a surfel file through a memory mapping. Plain records are not parsed
+// or copied, surfels() points into the mapping and can be passed straight
+// to SplatRenderer::set_geometry(void const*, std::size_t), which uploads
+// it with a single copy into the vertex buffer. Compressed files are
+// decoded with decode(), for example into a mapped vertex buffer.
+class SurfelFile
+{
+
+public:
+    SurfelFile();
+    explicit SurfelFile(std::string const& filename);
+
+    // Validates the header and the chunk table against the file size and
+    // throws std::runtime_error if they do not match.
+    void open(std::string const& filename);
+    void close();
+
+    std::size_t num_surfels() const;
+    bool compressed() const;
+
+    // Null if any chunk is compressed.
+    Surfel const* surfels() const;
+
+    std::size_t num_chunks() const;
+    SurfelChunk const& chunk(std::size_t i) const;
+
+    // Null if the chunk is compressed.
+    Surfel const* chunk_surfels(std::size_t i) const;
+
+    // Index of the first surfel of chunk i within the whole file.
+    std::size_t chunk_first(std::size_t i) const;
+
+    // Writes the chunk().count surfels of a chunk to surfels, plain chunks
+    // are copied. Throws std::runtime_error if the chunk is corrupt.
+    void decode_chunk(std::size_t i, Surfel* surfels) const;
+
+    // Decodes all num_surfels() surfels, one chunk per task in parallel.
+    void decode(Surfel* surfels) const;
+
+    SurfelFileHeader const& header() const;
+
+private:
+    GLviz::MappedFile m_file;
+    std::string m_filename;
+    SurfelFileHeader const* m_header;
+    SurfelChunk const* m_chunks;
+
+    // Index of the first surfel and number of bytes of every chunk.
+    std::vector<std::size_t> m_first;
+    std::vector<std::uint64_t> m_sizes;
+    bool m_compressed;
+};
+
+#endif // SURFEL_FILE_HPP
@@ -0,0 +1,479 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "surfel_hierarchy.hpp"
+#include "frustum.hpp"
+#include "parallel.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace Eigen;
+
+namespace
+{
+
+// Surfels in caller memory with any stride and attribute offsets.
+struct StridedSurfels
+{
+    StridedSurfels(void const* data, SurfelLayout const& layout)
+        : data(static_cast<char const*>(data)), layout(layout)
+    {
+    }
+
+    Vector3f
+    get(std::size_t i, std::size_t offset) const
+    {
+        Vector3f x;
+        std::memcpy(x.data(), data + i * layout.stride + offset,
+            sizeof(Vector3f));
+
+        return x;
+    }
+
+    Vector3f center(std::size_t i) const { return get(i, layout.c); }
+    Vector3f u(std::size_t i) const { return get(i, layout.u); }
+    Vector3f v(std::size_t i) const { return get(i, layout.v); }
+
+    char const* data;
+    SurfelLayout layout;
+};
+
+struct ColumnSurfels
+{
+    explicit ColumnSurfels(SurfelBuffer const& buffer)
+        : buffer(buffer)
+    {
+    }
+
+    Vector3f
+    center(std::size_t i) const
+    {
+        return Vector3f(buffer.cx()[i], buffer.cy()[i], buffer.cz()[i]);
+    }
+
+    Vector3f u(std::size_t i) const { return buffer.u()[i]; }
+    Vector3f v(std::size_t i) const { return buffer.v()[i]; }
+
+    SurfelBuffer const& buffer;
+};
+
+enum Facing { FacingAway, FacingMixed, FacingToward };
+
+// Where the eye lies relative to all surfels with centers within radius of
+// center and normals within the cone. With d = eye - center and theta the
+// angle between axis and d, the dot product of a unit normal with the
+// direction from a center to the eye lies within
+// |d| cos(theta + angle) - radius and |d| cos(theta - angle) + radius.
+// Both bounds need a cone narrower than a half space.
+Facing
+cone_facing(Vector3f const& axis, float cone_cos, float cone_sin,
+    Vector3f const& center, float radius, Vector3f const& eye)
+{
+    if (cone_cos <= 0.0f)
+    {
+        return FacingMixed;
+    }
+
+    Vector3f d = eye - center;
+
+    float d_cos = axis.dot(d);
+    float d_sin = axis.cross(d).norm();
+
+    if (cone_cos * d_cos + cone_sin * d_sin + radius <= 0.0f)
+    {
+        return FacingAway;
+    }
+
+    if (cone_cos * d_cos - cone_sin * d_sin - radius > 0.0f)
+    {
+        return FacingToward;
+    }
+
+    return FacingMixed;
+}
+
+}
+
+SurfelHierarchy::SurfelHierarchy(std::size_t chunk_size)
+    : m_chunk_size(std::max<std::size_t>(1, chunk_size)), m_size(0),
+      m_num_chunks(0), m_num_leaves(0)
+{
+}
+
+void
+SurfelHierarchy::build(void const* data, std::size_t count,
+    SurfelLayout const& layout)
+{
+    build_from(StridedSurfels(data, layout), count);
+}
+
+void
+SurfelHierarchy::build(SurfelBuffer const& buffer)
+{
+    build_from(ColumnSurfels(buffer), buffer.size());
+}
+
+void
+SurfelHierarchy::refit(void const* data, SurfelLayout const& layout,
+    std::size_t first, std::size_t count)
+{
+    refit_from(StridedSurfels(data, layout), first, count);
+}
+
+void
+SurfelHierarchy::refit(SurfelBuffer const& buffer, std::size_t first,
+    std::size_t count)
+{
+    refit_from(ColumnSurfels(buffer), first, count);
+}
+
+void
+SurfelHierarchy::clear()
+{
+    m_size = m_num_chunks = m_num_leaves = 0;
+    m_nodes.clear();
+}
+
+template <typename Surfels>
+void
+SurfelHierarchy::build_from(Surfels const& surfels, std::size_t count)
+{
+    m_size = count;
+    m_num_chunks = (count + m_chunk_size - 1) / m_chunk_size;
+
+    m_num_leaves = 1;
+    while (m_num_leaves < m_num_chunks)
+    {
+        m_num_leaves *= 2;
+    }
+
+    m_nodes.resize(2 * m_num_leaves);
+
+    parallel_for(0, m_num_leaves, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            bound_chunk(surfels, i);
+        }
+    }, 64);
+
+    for (std::size_t node(m_num_leaves - 1); node > 0; --node)
+    {
+        merge_children(node);
+    }
+}
+
+template <typename Surfels>
+void
+SurfelHierarchy::refit_from(Surfels const& surfels, std::size_t first,
+    std::size_t count)
+{
+    if (count == 0 || first >= m_size)
+    {
+        return;
+    }
+
+    std::size_t first_chunk = first / m_chunk_size;
+    std::size_t last_chunk = (std::min(first + count, m_size) - 1)
+        / m_chunk_size;
+
+    for (std::size_t i(first_chunk); i <= last_chunk; ++i)
+    {
+        bound_chunk(surfels, i);
+    }
+
+    // Ancestors of the range form a range on every level.
+    std::size_t lo = m_num_leaves + first_chunk;
+    std::size_t hi = m_num_leaves + last_chunk;
+
+    while (lo > 1)
+    {
+        lo /= 2;
+        hi /= 2;
+
+        for (std::size_t node(lo); node <= hi; ++node)
+        {
+            merge_children(node);
+        }
+    }
+}
+
+template <typename Surfels>
+void
+SurfelHierarchy::bound_chunk(Surfels const& surfels, std::size_t chunk)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+
+    Node& leaf = m_nodes[m_num_leaves + chunk];
+    leaf.min = Vector3f::Constant(inf);
+    leaf.max = Vector3f::Constant(-inf);
+    leaf.extent = Vector3f::Zero();
+    leaf.axis = Vector3f::Zero();
+
+    std::size_t begin = std::min(m_size, chunk * m_chunk_size);
+    std::size_t end = std::min(m_size, begin + m_chunk_size);
+
+    for (std::size_t i(begin); i < end; ++i)
+    {
+        Vector3f c = surfels.center(i);
+        Vector3f u = surfels.u(i), v = surfels.v(i);
+
+        // Half extent of the ellipse c + u cos(t) + v sin(t) per axis.
+        Vector3f extent = (u.array().square()
+            + v.array().square()).sqrt().matrix();
+
+        leaf.min = leaf.min.cwiseMin(c);
+        leaf.max = leaf.max.cwiseMax(c);
+        leaf.extent = leaf.extent.cwiseMax(extent);
+        leaf.axis += u.cross(v).normalized();
+    }
+
+    // The cone around the mean normal covers all normals, degenerate
+    // chunks get the full sphere.
+    float norm = leaf.axis.norm();
+    leaf.cone_cos = -1.0f;
+    leaf.cone_sin = 0.0f;
+
+    if (norm > 0.0f)
+    {
+        leaf.axis /= norm;
+        leaf.cone_cos = 1.0f;
+
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            // Degenerate splats are never drawn.
+            Vector3f n = surfels.u(i).cross(surfels.v(i));
+            if (n.squaredNorm() > 0.0f)
+            {
+                leaf.cone_cos = std::min(leaf.cone_cos,
+                    leaf.axis.dot(n.normalized()));
+            }
+        }
+
+        leaf.cone_sin = std::sqrt(std::max(0.0f,
+            1.0f - leaf.cone_cos * leaf.cone_cos));
+    }
+}
+
+void
+SurfelHierarchy::merge_children(std::size_t node)
+{
+    Node const& left = m_nodes[2 * node];
+    Node const& right = m_nodes[2 * node + 1];
+
+    Node& parent = m_nodes[node];
+    parent.min = left.min.cwiseMin(right.min);
+    parent.max = left.max.cwiseMax(right.max);
+    parent.extent = left.extent.cwiseMax(right.extent);
+
+    // Empty nodes past the last chunk don't widen the cone.
+    if (right.min(0) > right.max(0))
+    {
+        parent.axis = left.axis;
+        parent.cone_cos = left.cone_cos;
+        parent.cone_sin = left.cone_sin;
+        return;
+    }
+
+    if (left.min(0) > left.max(0))
+    {
+        parent.axis = right.axis;
+        parent.cone_cos = right.cone_cos;
+        parent.cone_sin = right.cone_sin;
+        return;
+    }
+
+    // Smallest cone around both cones. Its boundary passes through the
+    // outer edges of both, spanning theta + left_angle + right_angle.
+    const float pi = 3.14159265f;
+
+    float left_angle = std::atan2(left.cone_sin, left.cone_cos);
+    float right_angle = std::atan2(right.cone_sin, right.cone_cos);
+    float theta = std::acos(std::max(-1.0f, std::min(1.0f,
+        left.axis.dot(right.axis))));
+
+    if (theta + right_angle <= left_angle)
+    {
+        parent.axis = left.axis;
+        parent.cone_cos = left.cone_cos;
+        parent.cone_sin = left.cone_sin;
+        return;
+    }
+
+    if (theta + left_angle <= right_angle)
+    {
+        parent.axis = right.axis;
+        parent.cone_cos = right.cone_cos;
+        parent.cone_sin = right.cone_sin;
+        return;
+    }
+
+    float angle = 0.5f * (theta + left_angle + right_angle);
+
+    if (angle >= pi)
+    {
+        parent.axis = left.axis;
+        parent.cone_cos = -1.0f;
+        parent.cone_sin = 0.0f;
+        return;
+    }
+
+    // Rotates the left axis towards the right one by angle - left_angle.
+    float t = angle - left_angle;
+    parent.axis = left.axis;
+
+    if (theta > 1e-6f)
+    {
+        parent.axis = ((std::sin(theta - t) * left.axis + std::sin(t)
+            * right.axis) / std::sin(theta)).normalized();
+    }
+
+    parent.cone_cos = std::cos(angle);
+    parent.cone_sin = std::sin(angle);
+}
+
+std::size_t
+SurfelHierarchy::cull(Matrix4f const& clip, float radius_scale,
+    std::vector<GLint>& first, std::vector<GLsizei>& count,
+    Vector3f const* eye, DepthPyramid const* pyramid,
+    std::vector<OccludedRange>* occluded) const
+{
+    first.clear();
+    count.clear();
+
+    if (occluded)
+    {
+        occluded->clear();
+    }
+
+    if (m_num_chunks == 0)
+    {
+        return 0;
+    }
+
+    Vector4f planes[6];
+    frustum_planes(clip, planes);
+
+    bool occlusion = pyramid && occluded && !pyramid->empty();
+
+    std::size_t num_visible(0);
+    std::size_t end_of_last(0);
+
+    // Node, first chunk and number of chunks below it. Right children are
+    // pushed first so that ranges come out in ascending order.
+    struct Entry { std::size_t node, chunk, span; };
+    Entry stack[64];
+    std::size_t depth(0);
+
+    stack[depth++] = Entry{ 1, 0, m_num_leaves };
+
+    while (depth > 0)
+    {
+        Entry entry = stack[--depth];
+        Node const& node = m_nodes[entry.node];
+
+        if (entry.chunk >= m_num_chunks || node.min(0) > node.max(0))
+        {
+            continue;
+        }
+
+        Vector3f extent = radius_scale * node.extent;
+        Vector3f min = node.min - extent, max = node.max + extent;
+
+        FrustumOverlap overlap = box_frustum_overlap(planes, min.data(),
+            max.data());
+
+        if (overlap == FrustumOutside)
+        {
+            continue;
+        }
+
+        Facing facing = FacingToward;
+
+        if (eye)
+        {
+            facing = cone_facing(node.axis, node.cone_cos, node.cone_sin,
+                0.5f * (node.min + node.max), 0.5f * (node.max
+                - node.min).norm(), *eye);
+        }
+
+        if (facing == FacingAway)
+        {
+            continue;
+        }
+
+        std::size_t begin = entry.chunk * m_chunk_size;
+        std::size_t end = std::min(m_size, (entry.chunk + entry.span)
+            * m_chunk_size);
+
+        if (occlusion && pyramid->occluded(min, max))
+        {
+            OccludedRange range = { static_cast<GLint>(begin),
+                static_cast<GLsizei>(end - begin), min, max };
+            occluded->push_back(range);
+            continue;
+        }
+
+        // Parts of a visible node may still be hidden.
+        if ((overlap == FrustumCrossing || facing == FacingMixed
+            || occlusion) && entry.span > 1)
+        {
+            std::size_t half = entry.span / 2;
+            stack[depth++] = Entry{ 2 * entry.node + 1, entry.chunk + half,
+                half };
+            stack[depth++] = Entry{ 2 * entry.node, entry.chunk, half };
+            continue;
+        }
+
+        if (!first.empty() && begin == end_of_last)
+        {
+            count.back() += static_cast<GLsizei>(end - begin);
+        }
+        else
+        {
+            first.push_back(static_cast<GLint>(begin));
+            count.push_back(static_cast<GLsizei>(end - begin));
+        }
+
+        end_of_last = end;
+        num_visible += end - begin;
+    }
+
+    return num_visible;
+}
+
+std::size_t
+SurfelHierarchy::size() const
+{
+    return m_size;
+}
+
+std::size_t
+SurfelHierarchy::chunk_size() const
+{
+    return m_chunk_size;
+}
+
+std::size_t
+SurfelHierarchy::num_chunks() const
+{
+    return m_num_chunks;
+}
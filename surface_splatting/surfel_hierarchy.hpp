@@ -0,0 +1,118 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef SURFEL_HIERARCHY_HPP
+#define SURFEL_HIERARCHY_HPP
+
+#include "surfel.hpp"
+#include "surfel_buffer.hpp"
+#include "depth_pyramid.hpp"
+
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+// Bounding volume hierarchy over chunks of consecutive surfels, used to cull
+// whole ranges of a vertex buffer on the CPU. Every node covers a
+// contiguous run of chunks and its children split the run in halves, so
+// the tree follows buffer order: geometry sorted along a space filling
+// curve, see reorder_surfels(), gets tight boxes, unsorted geometry is
+// still culled correctly but rarely skipped.
+//
+// A node stores the bounds of the surfel centers and the largest extent of
+// an ellipse along each axis, which keeps the boxes conservative for any
+// radius scale applied at draw time. It also stores a cone around the
+// normals u x v of its surfels, which allows dropping nodes facing away
+// from the eye as a whole.
+class SurfelHierarchy
+{
+
+public:
+    // Surfels of a node hidden behind a DepthPyramid and the box it was
+    // tested with.
+    struct OccludedRange
+    {
+        GLint first;
+        GLsizei count;
+        Eigen::Vector3f min, max;
+    };
+
+    explicit SurfelHierarchy(std::size_t chunk_size = 512);
+
+    // Bounds the chunks in parallel and builds the tree bottom up.
+    void build(void const* data, std::size_t count,
+        SurfelLayout const& layout = SurfelLayout());
+    void build(SurfelBuffer const& buffer);
+
+    // Rebounds the chunks overlapping [first, first + count) and their
+    // ancestors after the surfels in there have changed.
+    void refit(void const* data, SurfelLayout const& layout,
+        std::size_t first, std::size_t count);
+    void refit(SurfelBuffer const& buffer, std::size_t first,
+        std::size_t count);
+
+    void clear();
+
+    // Collects the surfel ranges of the chunks intersecting the frustum of
+    // clip, the projection times the modelview matrix, in ascending order
+    // with adjacent ranges merged. Returns the number of surfels in them.
+    // Given the eye position in the coordinates of the surfels, chunks in
+    // which no surfel center sees the eye in front of the splat are left
+    // out as well, the same test as backface culling in the shaders.
+    // Given a depth pyramid, nodes behind it go to occluded instead, in no
+    // particular order.
+    std::size_t cull(Eigen::Matrix4f const& clip, float radius_scale,
+        std::vector<GLint>& first, std::vector<GLsizei>& count,
+        Eigen::Vector3f const* eye = nullptr,
+        DepthPyramid const* pyramid = nullptr,
+        std::vector<OccludedRange>* occluded = nullptr) const;
+
+    std::size_t size() const;
+    std::size_t chunk_size() const;
+    std::size_t num_chunks() const;
+
+private:
+    struct Node
+    {
+        Eigen::Vector3f min, max, extent;
+
+        // Unit axis and half angle of the normal cone.
+        Eigen::Vector3f axis;
+        float cone_cos, cone_sin;
+    };
+
+    template <typename Surfels>
+    void build_from(Surfels const& surfels, std::size_t count);
+    template <typename Surfels>
+    void refit_from(Surfels const& surfels, std::size_t first,
+        std::size_t count);
+    template <typename Surfels>
+    void bound_chunk(Surfels const& surfels, std::size_t chunk);
+
+    void merge_children(std::size_t node);
+
+private:
+    std::size_t m_chunk_size, m_size, m_num_chunks, m_num_leaves;
+
+    // Complete binary tree, node 1 is the root, node i has the children
+    // 2i and 2i + 1 and chunk j is the leaf m_num_leaves + j.
+    std::vector<Node> m_nodes;
+};
+
+#endif // SURFEL_HIERARCHY_HPP
@@ -0,0 +1,425 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "surfel_lod.hpp"
+#include "surfel_simplification.hpp"
+#include "surfel_order.hpp"
+#include "frustum.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace Eigen;
+
+namespace
+{
+
+// Subtrees handed to every worker thread by select().
+const std::size_t subtrees_per_thread = 16;
+
+const unsigned int bits_per_axis = 21;
+
+float
+surfel_radius(Surfel const& s)
+{
+    return std::max(s.u.norm(), s.v.norm());
+}
+
+std::uint64_t
+spread_bits(std::uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+
+    return x;
+}
+
+struct LevelEntry
+{
+    std::uint64_t key;
+    unsigned int node;
+
+    bool operator<(LevelEntry const& other) const
+    {
+        return key < other.key || (key == other.key && node < other.node);
+    }
+};
+
+}
+
+struct SurfelLod::View
+{
+    Vector4f planes[6];
+    Vector4f w;
+    float radius_scale, pixels_per_unit, threshold;
+};
+
+SurfelLod::SurfelLod()
+    : m_num_leaves(0), m_root(0), m_error_threshold(2.0f),
+      m_selection_offset(1, 0)
+{
+}
+
+void
+SurfelLod::build(Surfel const* surfels, std::size_t count)
+{
+    clear();
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Morton codes of the centers within the bounding cube, the leaves are
+    // stored in code order.
+    Vector3f min, max;
+    surfel_bounds(surfels, count, min, max);
+
+    float extent = std::max((max - min).maxCoeff(), 1e-20f);
+    float scale = static_cast<float>((1u << bits_per_axis) - 1) / extent;
+
+    std::vector<LevelEntry> level(count);
+
+    parallel_for(0, count, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            Vector3f q = scale * (surfels[i].c - min);
+
+            level[i].key = spread_bits(static_cast<std::uint64_t>(q.x())) << 2
+                | spread_bits(static_cast<std::uint64_t>(q.y())) << 1
+                | spread_bits(static_cast<std::uint64_t>(q.z()));
+            level[i].node = static_cast<unsigned int>(i);
+        }
+    });
+
+    parallel_sort(level.begin(), level.end());
+
+    m_surfels.resize(count);
+    m_nodes.resize(count);
+    m_num_leaves = count;
+
+    parallel_for(0, count, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            m_surfels[i] = surfels[level[i].node];
+            m_nodes[i].radius = surfel_radius(m_surfels[i]);
+            m_nodes[i].first_child = 0;
+            m_nodes[i].num_children = 0;
+
+            level[i].node = static_cast<unsigned int>(i);
+        }
+    });
+
+    // Every step coarsens the cells by one octree level. Runs of nodes in
+    // the same cell are merged into a new node, nodes alone in their cell
+    // move up unchanged.
+    std::vector<std::size_t> groups;
+
+    for (unsigned int step(0); step < bits_per_axis && level.size() > 1;
+        ++step)
+    {
+        groups.clear();
+        for (std::size_t i(0); i < level.size(); ++i)
+        {
+            level[i].key >>= 3;
+
+            if (i == 0 || level[i].key != level[i - 1].key)
+            {
+                groups.push_back(i);
+            }
+        }
+        groups.push_back(level.size());
+
+        // Children of a new node are listed in m_children.
+        std::size_t first_node = m_nodes.size();
+        std::size_t num_new(0);
+
+        for (std::size_t g(0); g + 1 < groups.size(); ++g)
+        {
+            num_new += groups[g + 1] - groups[g] > 1;
+        }
+
+        m_surfels.resize(first_node + num_new);
+        m_nodes.resize(first_node + num_new);
+
+        std::vector<LevelEntry> next(groups.size() - 1);
+        std::size_t node = first_node;
+
+        for (std::size_t g(0); g + 1 < groups.size(); ++g)
+        {
+            next[g] = level[groups[g]];
+
+            if (groups[g + 1] - groups[g] > 1)
+            {
+                Node& n = m_nodes[node];
+                n.first_child = static_cast<unsigned int>(m_children.size());
+                n.num_children = static_cast<unsigned int>(groups[g + 1]
+                    - groups[g]);
+
+                for (std::size_t i(groups[g]); i < groups[g + 1]; ++i)
+                {
+                    m_children.push_back(level[i].node);
+                }
+
+                next[g].node = static_cast<unsigned int>(node++);
+            }
+        }
+
+        parallel_for(first_node, first_node + num_new,
+            [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<Surfel> children;
+
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                Node& n = m_nodes[i];
+
+                children.resize(n.num_children);
+                for (unsigned int j(0); j < n.num_children; ++j)
+                {
+                    children[j] = m_surfels[m_children[n.first_child + j]];
+                }
+
+                Surfel merged = merge_surfels(children.data(),
+                    children.size());
+
+                // The sphere holds the representative and all children.
+                float radius = surfel_radius(merged);
+                for (unsigned int j(0); j < n.num_children; ++j)
+                {
+                    unsigned int child = m_children[n.first_child + j];
+                    radius = std::max(radius, (m_surfels[child].c
+                        - merged.c).norm() + m_nodes[child].radius);
+                }
+
+                m_surfels[i] = merged;
+                n.radius = radius;
+            }
+        }, 64);
+
+        level.swap(next);
+    }
+
+    m_root = level.front().node;
+}
+
+void
+SurfelLod::clear()
+{
+    m_surfels.clear();
+    m_nodes.clear();
+    m_children.clear();
+    m_num_leaves = 0;
+    m_root = 0;
+
+    m_selection.clear();
+    m_selection_offset.assign(1, 0);
+}
+
+float
+SurfelLod::error_threshold() const
+{
+    return m_error_threshold;
+}
+
+void
+SurfelLod::set_error_threshold(float pixels)
+{
+    m_error_threshold = pixels;
+}
+
+SurfelLod::Decision
+SurfelLod::decide(View const& view, std::size_t node) const
+{
+    Vector4f c;
+    c << m_surfels[node].c, 1.0f;
+    float radius = view.radius_scale * m_nodes[node].radius;
+
+    for (unsigned int i(0); i < 6; ++i)
+    {
+        if (view.planes[i].dot(c) < -radius)
+        {
+            return Cull;
+        }
+    }
+
+    if (m_nodes[node].num_children == 0)
+    {
+        return Draw;
+    }
+
+    // Nodes reaching behind the eye are always refined.
+    float w = view.w.dot(c);
+
+    return w > radius && 2.0f * radius * view.pixels_per_unit
+        <= view.threshold * w ? Draw : Refine;
+}
+
+void
+SurfelLod::select_subtree(View const& view, std::size_t node,
+    std::vector<unsigned int>& selection) const
+{
+    switch (decide(view, node))
+    {
+    case Cull:
+        break;
+
+    case Draw:
+        selection.push_back(static_cast<unsigned int>(node));
+        break;
+
+    case Refine:
+        Node const& n = m_nodes[node];
+        for (unsigned int i(0); i < n.num_children; ++i)
+        {
+            select_subtree(view, m_children[n.first_child + i], selection);
+        }
+        break;
+    }
+}
+
+std::size_t
+SurfelLod::select(Matrix4f const& modelview, Matrix4f const& projection,
+    float viewport_height, float radius_scale)
+{
+    m_selection.clear();
+    m_selection_offset.assign(1, 0);
+
+    if (m_nodes.empty())
+    {
+        return 0;
+    }
+
+    Matrix4f clip = projection * modelview;
+
+    View view;
+    frustum_planes(clip, view.planes);
+
+    // Normalized for the sphere tests.
+    for (unsigned int i(0); i < 6; ++i)
+    {
+        view.planes[i] /= view.planes[i].head<3>().norm();
+    }
+
+    // Projected diameter in pixels is 2 r pixels_per_unit / w.
+    view.w = clip.row(3).transpose();
+    view.radius_scale = radius_scale;
+    view.pixels_per_unit = 0.5f * viewport_height
+        * std::abs(projection(1, 1));
+    view.threshold = m_error_threshold;
+
+    // Expands the top of the tree breadth first into enough subtrees. A
+    // node to be drawn stays in the list as a subtree of its own.
+    std::size_t target = subtrees_per_thread * num_worker_threads();
+    std::vector<unsigned int> subtrees(1, m_root), next;
+
+    for (bool expanded(true); expanded && subtrees.size() < target; )
+    {
+        expanded = false;
+        next.clear();
+
+        for (std::size_t i(0); i < subtrees.size(); ++i)
+        {
+            std::size_t node = subtrees[i];
+
+            switch (decide(view, node))
+            {
+            case Cull:
+                break;
+
+            case Draw:
+                next.push_back(subtrees[i]);
+                break;
+
+            case Refine:
+                Node const& n = m_nodes[node];
+                for (unsigned int j(0); j < n.num_children; ++j)
+                {
+                    next.push_back(m_children[n.first_child + j]);
+                }
+                expanded = true;
+                break;
+            }
+        }
+
+        subtrees.swap(next);
+    }
+
+    m_selection.resize(subtrees.size());
+
+    parallel_for(0, subtrees.size(), [&](std::size_t first,
+        std::size_t last)
+    {
+        for (std::size_t i(first); i < last; ++i)
+        {
+            select_subtree(view, subtrees[i], m_selection[i]);
+        }
+    }, 1);
+
+    m_selection_offset.resize(subtrees.size() + 1);
+    for (std::size_t i(0); i < subtrees.size(); ++i)
+    {
+        m_selection_offset[i + 1] = m_selection_offset[i]
+            + m_selection[i].size();
+    }
+
+    return m_selection_offset.back();
+}
+
+void
+SurfelLod::write(Surfel* output) const
+{
+    parallel_for(0, m_selection.size(), [&](std::size_t first,
+        std::size_t last)
+    {
+        for (std::size_t i(first); i < last; ++i)
+        {
+            std::vector<unsigned int> const& selection = m_selection[i];
+            Surfel* out = output + m_selection_offset[i];
+
+            for (std::size_t j(0); j < selection.size(); ++j)
+            {
+                out[j] = m_surfels[selection[j]];
+            }
+        }
+    }, 1);
+}
+
+std::size_t
+SurfelLod::size() const
+{
+    return m_num_leaves;
+}
+
+std::size_t
+SurfelLod::num_nodes() const
+{
+    return m_nodes.size();
+}
+
+std::size_t
+SurfelLod::num_selected() const
+{
+    return m_selection_offset.back();
+}
@@ -0,0 +1,101 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#ifndef SURFEL_LOD_HPP
+#define SURFEL_LOD_HPP
+
+#include "surfel.hpp"
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+// Level of detail hierarchy in the spirit of QSplat, Rusinkiewicz and Levoy
+// 2000. The leaves are the surfels, inner nodes are the cells of an octree
+// over their centers with more than one child. Every inner node holds a
+// representative surfel merged from its children with merge_surfels(),
+// which covers them, and a bounding sphere of everything below it.
+//
+// select() picks a cut through the tree for a view: nodes outside the
+// frustum are dropped, nodes whose sphere projects to at most
+// error_threshold() pixels are drawn in place of their subtree. The size of
+// the cut thus follows the screen resolution rather than the size of the
+// model. Splat axes are assumed to be perpendicular.
+class SurfelLod
+{
+
+public:
+    SurfelLod();
+
+    // Builds the tree over a copy of the surfels. The nodes of every
+    // octree level are merged in parallel.
+    void build(Surfel const* surfels, std::size_t count);
+    void clear();
+
+    // Largest projected diameter in pixels of a node drawn instead of its
+    // children.
+    float error_threshold() const;
+    void set_error_threshold(float pixels);
+
+    // Selects the cut for a camera and returns the number of its surfels.
+    // The modelview matrix has to be rigid, the splat axes are scaled by
+    // radius_scale. The top of the tree is expanded serially until there
+    // are enough subtrees to traverse them in parallel.
+    std::size_t select(Eigen::Matrix4f const& modelview,
+        Eigen::Matrix4f const& projection, float viewport_height,
+        float radius_scale = 1.0f);
+
+    // Copies the surfels of the last selection to output in parallel.
+    void write(Surfel* output) const;
+
+    std::size_t size() const;
+    std::size_t num_nodes() const;
+    std::size_t num_selected() const;
+
+private:
+    struct Node
+    {
+        float radius;
+        unsigned int first_child, num_children;
+    };
+
+    struct View;
+
+    enum Decision { Cull, Draw, Refine };
+
+    Decision decide(View const& view, std::size_t node) const;
+    void select_subtree(View const& view, std::size_t node,
+        std::vector<unsigned int>& selection) const;
+
+private:
+    // All nodes, leaves first in Morton order. The children of a node are
+    // listed in m_children from first_child on.
+    std::vector<Surfel> m_surfels;
+    std::vector<Node> m_nodes;
+    std::vector<unsigned int> m_children;
+    std::size_t m_num_leaves;
+    unsigned int m_root;
+
+    float m_error_threshold;
+
+    // Selected nodes per subtree of the last cut and where the surfels of
+    // each subtree start in the output.
+    std::vector<std::vector<unsigned int> > m_selection;
+    std::vector<std::size_t> m_selection_offset;
+};
+
+#endif // SURFEL_LOD_HPP
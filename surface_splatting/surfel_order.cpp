@@ -0,0 +1,223 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_order.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+using namespace Eigen;
+
+namespace
+{
+
+const unsigned int bits_per_axis = 21;
+
+struct CurveKey
+{
+    std::uint64_t key;
+    unsigned int index;
+
+    bool operator<(CurveKey const& other) const
+    {
+        return key < other.key || (key == other.key && index < other.index);
+    }
+};
+
+// Inserts two zero bits after each of the lower 21 bits of x.
+std::uint64_t
+spread_bits(std::uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+
+    return x;
+}
+
+std::uint64_t
+interleave_bits(std::uint32_t const* x)
+{
+    return spread_bits(x[0]) << 2 | spread_bits(x[1]) << 1
+        | spread_bits(x[2]);
+}
+
+// Transforms cell coordinates in place such that interleaving their bits
+// yields the Hilbert index, see J. Skilling, Programming the Hilbert Curve,
+// AIP Conference Proceedings 707, 2004.
+void
+hilbert_transpose(std::uint32_t* x)
+{
+    std::uint32_t const m = 1u << (bits_per_axis - 1);
+
+    // Inverse undo.
+    for (std::uint32_t q(m); q > 1; q >>= 1)
+    {
+        std::uint32_t p = q - 1;
+
+        for (unsigned int i(0); i < 3; ++i)
+        {
+            if (x[i] & q)
+            {
+                x[0] ^= p;
+            }
+            else
+            {
+                std::uint32_t t = (x[0] ^ x[i]) & p;
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
+    }
+
+    // Gray encode.
+    x[1] ^= x[0];
+    x[2] ^= x[1];
+
+    std::uint32_t t(0);
+    for (std::uint32_t q(m); q > 1; q >>= 1)
+    {
+        if (x[2] & q)
+        {
+            t ^= q - 1;
+        }
+    }
+
+    for (unsigned int i(0); i < 3; ++i)
+    {
+        x[i] ^= t;
+    }
+}
+
+}
+
+void
+surfel_bounds(Surfel const* surfels, std::size_t n, Vector3f& min,
+    Vector3f& max)
+{
+    std::size_t num_blocks = num_worker_threads();
+    std::size_t block_size = (n + num_blocks - 1) / num_blocks;
+
+    std::vector<Vector3f, aligned_allocator<Vector3f> > block_min(
+        num_blocks, Vector3f::Constant(std::numeric_limits<float>::max()));
+    std::vector<Vector3f, aligned_allocator<Vector3f> > block_max(
+        num_blocks, Vector3f::Constant(-std::numeric_limits<float>::max()));
+
+    parallel_for(0, num_blocks, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t j(first); j < last; ++j)
+        {
+            std::size_t begin = std::min(n, j * block_size);
+            std::size_t end = std::min(n, begin + block_size);
+
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                block_min[j] = block_min[j].cwiseMin(surfels[i].c);
+                block_max[j] = block_max[j].cwiseMax(surfels[i].c);
+            }
+        }
+    }, 1);
+
+    min = block_min[0];
+    max = block_max[0];
+    for (std::size_t i(1); i < num_blocks; ++i)
+    {
+        min = min.cwiseMin(block_min[i]);
+        max = max.cwiseMax(block_max[i]);
+    }
+}
+
+std::vector<unsigned int>
+spatial_order(Surfel const* surfels, std::size_t n, SpaceFillingCurve curve)
+{
+    std::vector<unsigned int> permutation(n);
+
+    if (n == 0)
+    {
+        return permutation;
+    }
+
+    Vector3f min, max;
+    surfel_bounds(surfels, n, min, max);
+
+    // A cube keeps the cells isotropic.
+    float extent = (max - min).maxCoeff();
+    float scale = extent > 0.0f ? static_cast<float>(
+        (1u << bits_per_axis) - 1) / extent : 0.0f;
+
+    std::vector<CurveKey> keys(n);
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            Vector3f q = scale * (surfels[i].c - min);
+
+            std::uint32_t x[3] = {
+                static_cast<std::uint32_t>(q.x()),
+                static_cast<std::uint32_t>(q.y()),
+                static_cast<std::uint32_t>(q.z())
+            };
+
+            if (curve == HilbertCurve)
+            {
+                hilbert_transpose(x);
+            }
+
+            keys[i].key = interleave_bits(x);
+            keys[i].index = static_cast<unsigned int>(i);
+        }
+    });
+
+    parallel_sort(keys.begin(), keys.end());
+
+    parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            permutation[i] = keys[i].index;
+        }
+    });
+
+    return permutation;
+}
+
+std::vector<unsigned int>
+reorder_surfels(std::vector<Surfel>& surfels, SpaceFillingCurve curve)
+{
+    std::vector<unsigned int> permutation = spatial_order(surfels.data(),
+        surfels.size(), curve);
+
+    std::vector<Surfel> reordered(surfels.size());
+
+    parallel_for(0, surfels.size(), [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            reordered[i] = surfels[permutation[i]];
+        }
+    });
+
+    surfels.swap(reordered);
+
+    return permutation;
+}
@@ -0,0 +1,50 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_ORDER_HPP
+#define SURFEL_ORDER_HPP
+
+#include "surfel.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Space filling curves through the bounding cube of the surfel centers.
+// Surfels close along either curve are close in space, the Hilbert curve
+// has no long jumps between consecutive cells but costs more to evaluate.
+enum SpaceFillingCurve
+{
+    MortonCurve,
+    HilbertCurve
+};
+
+// Bounding box of the surfel centers, computed on all cores. n must not be
+// zero.
+void surfel_bounds(Surfel const* surfels, std::size_t n, Eigen::Vector3f& min,
+    Eigen::Vector3f& max);
+
+// Returns the permutation that sorts the surfels along the curve, the i-th
+// surfel in curve order is surfels[permutation[i]]. Runs on all cores.
+std::vector<unsigned int> spatial_order(Surfel const* surfels, std::size_t n,
+    SpaceFillingCurve curve = MortonCurve);
+
+// Sorts surfels along the curve in place and returns the permutation as
+// above, which maps new to old indices.
+std::vector<unsigned int> reorder_surfels(std::vector<Surfel>& surfels,
+    SpaceFillingCurve curve = MortonCurve);
+
+#endif // SURFEL_ORDER_HPP
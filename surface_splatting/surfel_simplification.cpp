@@ -0,0 +1,417 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_simplification.hpp"
+#include "surfel_order.hpp"
+#include "parallel.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace Eigen;
+
+namespace
+{
+
+const unsigned int bits_per_axis = 21;
+
+struct VoxelKey
+{
+    std::uint64_t key;
+    unsigned int index;
+
+    bool operator<(VoxelKey const& other) const
+    {
+        return key < other.key || (key == other.key && index < other.index);
+    }
+};
+
+struct Cluster
+{
+    Vector3f normal;
+    std::vector<unsigned int> members;
+};
+
+Vector3f
+surfel_normal(Surfel const& s)
+{
+    Vector3f n = s.u.cross(s.v);
+    float length = n.norm();
+
+    return length > 0.0f ? Vector3f(n / length) : Vector3f::Zero();
+}
+
+// Splits the surfels of one voxel greedily into clusters of similar normal.
+void
+cluster_voxel(std::vector<Surfel> const& surfels, VoxelKey const* first,
+    VoxelKey const* last, float min_cosine, std::vector<Cluster>& clusters)
+{
+    clusters.clear();
+
+    for (VoxelKey const* k(first); k != last; ++k)
+    {
+        Surfel const& s = surfels[k->index];
+        Vector3f n = surfel_normal(s);
+
+        std::size_t j(0);
+        if (s.p.isZero())
+        {
+            for (; j < clusters.size(); ++j)
+            {
+                if (!clusters[j].normal.isZero()
+                    && clusters[j].normal.dot(n) >= min_cosine)
+                {
+                    break;
+                }
+            }
+        }
+        else
+        {
+            j = clusters.size();
+            n = Vector3f::Zero();
+        }
+
+        if (j == clusters.size())
+        {
+            clusters.push_back(Cluster());
+            clusters.back().normal = n;
+        }
+        else
+        {
+            Vector3f sum = clusters[j].normal
+                * static_cast<float>(clusters[j].members.size()) + n;
+            clusters[j].normal = sum.normalized();
+        }
+
+        clusters[j].members.push_back(k->index);
+    }
+}
+
+Surfel
+merge_cluster(std::vector<Surfel> const& surfels, Cluster const& cluster,
+    float coverage)
+{
+    std::vector<unsigned int> const& members = cluster.members;
+
+    if (members.size() == 1)
+    {
+        return surfels[members[0]];
+    }
+
+    std::vector<Surfel> gathered(members.size());
+    for (std::size_t i(0); i < members.size(); ++i)
+    {
+        gathered[i] = surfels[members[i]];
+    }
+
+    return merge_surfels(gathered.data(), gathered.size(), coverage);
+}
+
+class Clustering
+{
+
+public:
+    Clustering(std::vector<Surfel> const& surfels,
+        SurfelSimplification const& simplification)
+        : m_surfels(surfels), m_keys(surfels.size()),
+          m_min_cosine(std::cos(simplification.max_normal_angle
+            * std::acos(-1.0f) / 180.0f)),
+          m_coverage(simplification.coverage)
+    {
+        surfel_bounds(surfels.data(), surfels.size(), m_min, m_max);
+    }
+
+    float extent() const
+    {
+        return (m_max - m_min).maxCoeff();
+    }
+
+    // Groups the surfels by voxel and returns the number of clusters, if
+    // output is given the merged surfels are written to it.
+    std::size_t run(float voxel_size, std::vector<Surfel>* output)
+    {
+        std::size_t n = m_surfels.size();
+
+        // Keeps the voxel coordinates within 21 bits per axis.
+        voxel_size = std::max(voxel_size,
+            extent() / static_cast<float>((1u << bits_per_axis) - 1));
+        float scale = 1.0f / voxel_size;
+
+        parallel_for(0, n, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                Vector3f q = scale * (m_surfels[i].c - m_min);
+
+                m_keys[i].key = static_cast<std::uint64_t>(q.x()) << 42
+                    | static_cast<std::uint64_t>(q.y()) << 21
+                    | static_cast<std::uint64_t>(q.z());
+                m_keys[i].index = static_cast<unsigned int>(i);
+            }
+        });
+
+        parallel_sort(m_keys.begin(), m_keys.end());
+
+        // Splits the sorted keys into blocks at voxel boundaries.
+        std::size_t num_blocks = std::max<std::size_t>(1,
+            std::min<std::size_t>(4 * num_worker_threads(), n / 1024));
+        std::vector<std::size_t> bounds(num_blocks + 1, n);
+        bounds[0] = 0;
+
+        for (std::size_t j(1); j < num_blocks; ++j)
+        {
+            std::size_t i = std::max(bounds[j - 1], j * n / num_blocks);
+            while (i > 0 && i < n && m_keys[i].key == m_keys[i - 1].key)
+            {
+                ++i;
+            }
+            bounds[j] = i;
+        }
+
+        std::vector<std::vector<Surfel> > block_output(num_blocks);
+        std::vector<std::size_t> block_count(num_blocks, 0);
+
+        parallel_for(0, num_blocks, [&](std::size_t first, std::size_t last)
+        {
+            std::vector<Cluster> clusters;
+
+            for (std::size_t j(first); j < last; ++j)
+            {
+                VoxelKey const* k = m_keys.data() + bounds[j];
+                VoxelKey const* end = m_keys.data() + bounds[j + 1];
+
+                while (k != end)
+                {
+                    VoxelKey const* voxel_end = k + 1;
+                    while (voxel_end != end && voxel_end->key == k->key)
+                    {
+                        ++voxel_end;
+                    }
+
+                    cluster_voxel(m_surfels, k, voxel_end, m_min_cosine,
+                        clusters);
+                    block_count[j] += clusters.size();
+
+                    if (output)
+                    {
+                        for (std::size_t i(0); i < clusters.size(); ++i)
+                        {
+                            block_output[j].push_back(merge_cluster(
+                                m_surfels, clusters[i], m_coverage));
+                        }
+                    }
+
+                    k = voxel_end;
+                }
+            }
+        }, 1);
+
+        std::size_t count(0);
+        for (std::size_t j(0); j < num_blocks; ++j)
+        {
+            count += block_count[j];
+        }
+
+        if (output)
+        {
+            output->clear();
+            output->reserve(count);
+
+            for (std::size_t j(0); j < num_blocks; ++j)
+            {
+                output->insert(output->end(), block_output[j].begin(),
+                    block_output[j].end());
+            }
+        }
+
+        return count;
+    }
+
+private:
+    std::vector<Surfel> const& m_surfels;
+    std::vector<VoxelKey> m_keys;
+    Vector3f m_min, m_max;
+    float m_min_cosine, m_coverage;
+};
+
+}
+
+std::size_t
+simplify_surfels(std::vector<Surfel> const& surfels,
+    std::vector<Surfel>& simplified,
+    SurfelSimplification const& simplification)
+{
+    if (surfels.empty())
+    {
+        simplified.clear();
+        return 0;
+    }
+
+    Clustering clustering(surfels, simplification);
+    float voxel_size = simplification.voxel_size;
+
+    // The number of clusters on a surface falls with the square of the
+    // voxel size, a few secant steps from the mean splat size get within
+    // a few percent of the target.
+    if (voxel_size <= 0.0f)
+    {
+        std::size_t target = std::max<std::size_t>(1,
+            simplification.target_count);
+
+        double mean_size(0.0);
+        for (std::size_t i(0); i < surfels.size(); ++i)
+        {
+            mean_size += std::sqrt(surfels[i].u.norm() * surfels[i].v.norm());
+        }
+        mean_size /= static_cast<double>(surfels.size());
+
+        voxel_size = static_cast<float>(mean_size * std::sqrt(
+            static_cast<double>(surfels.size()) / target));
+        if (!(voxel_size > 0.0f))
+        {
+            voxel_size = clustering.extent() / 1024.0f;
+        }
+
+        for (unsigned int i(0); i < 8; ++i)
+        {
+            std::size_t count = clustering.run(voxel_size, nullptr);
+            double ratio = static_cast<double>(count) / target;
+
+            if (std::abs(ratio - 1.0) < 0.05)
+            {
+                break;
+            }
+
+            voxel_size *= static_cast<float>(std::sqrt(ratio));
+        }
+    }
+
+    return clustering.run(voxel_size, &simplified);
+}
+
+Surfel
+merge_surfels(Surfel const* surfels, std::size_t count, float coverage)
+{
+    if (count == 1)
+    {
+        return surfels[0];
+    }
+
+    float w_sum(0.0f);
+    Vector3f c = Vector3f::Zero(), n = Vector3f::Zero();
+    Vector4f rgba = Vector4f::Zero();
+
+    for (std::size_t i(0); i < count; ++i)
+    {
+        Surfel const& s = surfels[i];
+        float w = std::max(s.u.norm() * s.v.norm(), 1e-20f);
+
+        w_sum += w;
+        c += w * s.c;
+        n += w * surfel_normal(s);
+
+        for (unsigned int k(0); k < 4; ++k)
+        {
+            rgba(k) += w * static_cast<float>((s.rgba >> (8 * k)) & 0xff);
+        }
+    }
+
+    c /= w_sum;
+    rgba /= w_sum;
+
+    // Opposite normals cancel out, the first member decides then.
+    if (n.isZero())
+    {
+        n = surfel_normal(surfels[0]);
+    }
+    if (n.isZero())
+    {
+        n = Vector3f::UnitZ();
+    }
+    n.normalize();
+
+    // Second moments of the members, an ellipse with axes u and v covers
+    // the variance (u u^T + v v^T) / 4 like a uniformly filled disk.
+    Matrix3f covariance = Matrix3f::Zero();
+
+    for (std::size_t i(0); i < count; ++i)
+    {
+        Surfel const& s = surfels[i];
+        float w = std::max(s.u.norm() * s.v.norm(), 1e-20f);
+        Vector3f d = s.c - c;
+
+        covariance += w * (0.25f * (s.u * s.u.transpose()
+            + s.v * s.v.transpose()) + d * d.transpose());
+    }
+    covariance /= w_sum;
+
+    Vector3f t0 = n.unitOrthogonal();
+    Vector3f t1 = n.cross(t0);
+
+    Matrix<float, 3, 2> tangent;
+    tangent << t0, t1;
+
+    Matrix2f m = tangent.transpose() * covariance * tangent;
+    m += 1e-4f * m.trace() * Matrix2f::Identity();
+
+    SelfAdjointEigenSolver<Matrix2f> eigen;
+    eigen.computeDirect(m);
+
+    Vector2f axes = 2.0f * eigen.eigenvalues().cwiseMax(0.0f).cwiseSqrt();
+    Matrix2f basis = eigen.eigenvectors();
+
+    // Grows the ellipse until it reaches the scaled axis end points of
+    // every member.
+    float scale(1.0f);
+
+    if (coverage > 0.0f && axes(0) > 0.0f)
+    {
+        for (std::size_t i(0); i < count; ++i)
+        {
+            Surfel const& s = surfels[i];
+            Vector3f q[4] = { s.c + coverage * s.u, s.c - coverage * s.u,
+                s.c + coverage * s.v, s.c - coverage * s.v };
+
+            for (unsigned int j(0); j < 4; ++j)
+            {
+                Vector2f x = basis.transpose()
+                    * (tangent.transpose() * (q[j] - c));
+                scale = std::max(scale, x.cwiseQuotient(axes).norm());
+            }
+        }
+    }
+
+    Vector3f major = tangent * basis.col(1);
+
+    Surfel merged;
+    merged.c = c;
+    merged.u = scale * axes(1) * major;
+    merged.v = scale * axes(0) * n.cross(major);
+    merged.p = Vector3f::Zero();
+    merged.rgba = 0;
+
+    for (unsigned int k(0); k < 4; ++k)
+    {
+        merged.rgba |= static_cast<unsigned int>(std::min(255.0f,
+            rgba(k) + 0.5f)) << (8 * k);
+    }
+
+    return merged;
+}
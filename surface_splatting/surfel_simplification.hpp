@@ -0,0 +1,64 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_SIMPLIFICATION_HPP
+#define SURFEL_SIMPLIFICATION_HPP
+
+#include "surfel.hpp"
+
+#include <cstddef>
+#include <vector>
+
+struct SurfelSimplification
+{
+    SurfelSimplification()
+        : voxel_size(0.0f), target_count(0), max_normal_angle(30.0f),
+          coverage(1.0f)
+    {
+    }
+
+    // Edge length of the clustering grid, which bounds how far a surfel
+    // center moves. If zero the size is searched such that about
+    // target_count surfels remain.
+    float voxel_size;
+    std::size_t target_count;
+
+    // Surfels in one voxel only merge if their normals are closer than
+    // this angle in degrees, which keeps creases and thin sheets apart.
+    float max_normal_angle;
+
+    // The merged ellipse reaches this fraction of the axes of every member,
+    // 0 keeps the plain covariance fit. Below 1 small holes may open
+    // between neighbouring clusters.
+    float coverage;
+};
+
+// Merges surfels that share a voxel and roughly a normal into one surfel
+// each. The merged ellipse matches the area weighted covariance of its
+// members and is grown to satisfy the coverage parameter, the color is the
+// area weighted mean. Surfels with a clipping plane are kept as they are.
+// Runs on all cores and returns the number of surfels in simplified.
+std::size_t simplify_surfels(std::vector<Surfel> const& surfels,
+    std::vector<Surfel>& simplified,
+    SurfelSimplification const& simplification = SurfelSimplification());
+
+// Merges count surfels into one the way simplify_surfels() merges a
+// cluster, coverage as in SurfelSimplification.
+Surfel merge_surfels(Surfel const* surfels, std::size_t count,
+    float coverage = 1.0f);
+
+#endif // SURFEL_SIMPLIFICATION_HPP
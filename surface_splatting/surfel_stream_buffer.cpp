@@ -0,0 +1,214 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+//
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include "surfel_stream_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+SurfelStreamBuffer::SurfelStreamBuffer(GLsizeiptr element_size,
+    unsigned int num_slots)
+    : m_element_size(element_size), m_num_slots(num_slots), m_slot(0),
+      m_buffer(0), m_capacity(0), m_count(0),
+      m_persistent(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage),
+      m_persistent_ptr(nullptr),
+      m_fences(num_slots, nullptr)
+{
+}
+
+SurfelStreamBuffer::~SurfelStreamBuffer()
+{
+    release();
+}
+
+void
+SurfelStreamBuffer::set_element_size(GLsizeiptr element_size)
+{
+    if (m_element_size != element_size)
+    {
+        release();
+
+        m_element_size = element_size;
+        m_capacity = 0;
+    }
+}
+
+void*
+SurfelStreamBuffer::map(GLsizei count)
+{
+    reserve(count);
+
+    m_slot = (m_slot + 1) % m_num_slots;
+    m_count = count;
+
+    // Blocks only if the GPU is more than num_slots - 1 frames behind.
+    wait(m_slot);
+
+    GLintptr offset = static_cast<GLintptr>(m_slot) * m_capacity
+        * m_element_size;
+
+    if (m_persistent)
+    {
+        return m_persistent_ptr + offset;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, offset,
+        static_cast<GLsizeiptr>(count) * m_element_size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return ptr;
+}
+
+GLint
+SurfelStreamBuffer::unmap()
+{
+    if (!m_persistent)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    return first();
+}
+
+GLint
+SurfelStreamBuffer::upload(void const* data, GLsizei count)
+{
+    void* ptr = map(count);
+    std::memcpy(ptr, data, static_cast<std::size_t>(count) * m_element_size);
+
+    return unmap();
+}
+
+void
+SurfelStreamBuffer::fence()
+{
+    if (m_fences[m_slot])
+    {
+        glDeleteSync(m_fences[m_slot]);
+    }
+
+    m_fences[m_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint
+SurfelStreamBuffer::buffer() const
+{
+    return m_buffer;
+}
+
+GLint
+SurfelStreamBuffer::first() const
+{
+    return static_cast<GLint>(m_slot) * m_capacity;
+}
+
+GLsizei
+SurfelStreamBuffer::count() const
+{
+    return m_count;
+}
+
+bool
+SurfelStreamBuffer::persistent() const
+{
+    return m_persistent;
+}
+
+void
+SurfelStreamBuffer::reserve(GLsizei count)
+{
+    if (count <= m_capacity)
+    {
+        return;
+    }
+
+    release();
+
+    m_capacity = std::max(count, m_capacity + m_capacity / 2);
+    GLsizeiptr size = static_cast<GLsizeiptr>(m_capacity) * m_num_slots
+        * m_element_size;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    if (m_persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+            | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        m_persistent_ptr = static_cast<char*>(
+            glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void
+SurfelStreamBuffer::wait(unsigned int slot)
+{
+    GLsync& fence = m_fences[slot];
+
+    if (!fence)
+    {
+        return;
+    }
+
+    GLenum status;
+    do
+    {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+            1000000);
+    }
+    while (status == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void
+SurfelStreamBuffer::release()
+{
+    for (unsigned int i(0); i < m_num_slots; ++i)
+    {
+        wait(i);
+    }
+
+    if (m_buffer)
+    {
+        if (m_persistent_ptr)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            m_persistent_ptr = nullptr;
+        }
+
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+}
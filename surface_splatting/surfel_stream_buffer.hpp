@@ -0,0 +1,75 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+//
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFEL_STREAM_BUFFER_HPP
+#define SURFEL_STREAM_BUFFER_HPP
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Ring of vertex buffer regions for data that changes every frame. The CPU
+// writes into one slot while the GPU still draws from the previous ones. If
+// GL_ARB_buffer_storage is available the whole ring is mapped persistently,
+// otherwise each slot is mapped unsynchronized with glMapBufferRange. In both
+// cases a fence per slot guards against overwriting data in flight.
+class SurfelStreamBuffer
+{
+
+public:
+    SurfelStreamBuffer(GLsizeiptr element_size, unsigned int num_slots = 3);
+    ~SurfelStreamBuffer();
+
+    // Changing the element size releases the buffer.
+    void set_element_size(GLsizeiptr element_size);
+
+    // Returns a pointer to storage for count elements in the next slot.
+    void* map(GLsizei count);
+
+    // Finishes the write started by map() and returns the index of the
+    // first element of the written slot within buffer().
+    GLint unmap();
+
+    GLint upload(void const* data, GLsizei count);
+
+    // Must be called after the last draw call reading from the current slot.
+    void fence();
+
+    GLuint buffer() const;
+    GLint first() const;
+    GLsizei count() const;
+
+    bool persistent() const;
+
+private:
+    void reserve(GLsizei count);
+    void wait(unsigned int slot);
+    void release();
+
+private:
+    GLsizeiptr m_element_size;
+    unsigned int m_num_slots, m_slot;
+
+    GLuint m_buffer;
+    GLsizei m_capacity, m_count;
+    bool m_persistent;
+    char* m_persistent_ptr;
+
+    std::vector<GLsync> m_fences;
+};
+
+#endif // SURFEL_STREAM_BUFFER_HPP
@@ -0,0 +1,336 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include "xyz_reader.hpp"
+#include "number_parser.hpp"
+#include "parallel.hpp"
+
+#include <GLviz>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace Eigen;
+
+namespace
+{
+
+// Number of point lines sampled to detect the columns.
+const std::size_t num_sample_lines = 1000;
+
+const std::size_t max_columns = 32;
+const std::size_t malformed_line = ~std::size_t(0);
+
+struct XyzLayout
+{
+    std::size_t num_columns;
+    int intensity, normal, color;   // First column or -1.
+};
+
+void
+throw_error(std::string const& filename, std::string const& what)
+{
+    std::ostringstream error_message;
+    error_message << "Error: " << filename << ": " << what << "."
+        << std::endl;
+
+    throw std::runtime_error(error_message.str().c_str());
+}
+
+inline bool
+separator(char c)
+{
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+}
+
+inline char const*
+skip_separators(char const* p, char const* end)
+{
+    while (p != end && separator(*p))
+    {
+        ++p;
+    }
+
+    return p;
+}
+
+// Whether [p, end) holds at least two values, as opposed to a blank line,
+// a comment or the point count of a PTS file.
+bool
+point_line(char const* p, char const* end)
+{
+    p = skip_separators(p, end);
+
+    if (p == end || *p == '#' || *p == '/')
+    {
+        return false;
+    }
+
+    while (p != end && !separator(*p))
+    {
+        ++p;
+    }
+
+    return skip_separators(p, end) != end;
+}
+
+// Parses up to max values of the line [p, end) and returns their number, or
+// malformed_line if the line holds something other than numbers.
+std::size_t
+parse_line(char const* p, char const* end, double* values, std::size_t max)
+{
+    std::size_t n(0);
+
+    try
+    {
+        for (p = skip_separators(p, end); p != end && n < max;
+            p = skip_separators(p, end))
+        {
+            p = parse_number(p, end, values[n++]);
+
+            if (p != end && !separator(*p))
+            {
+                return malformed_line;
+            }
+        }
+    }
+    catch (std::runtime_error const&)
+    {
+        return malformed_line;
+    }
+
+    return n;
+}
+
+inline char const*
+line_end(char const* p, char const* end)
+{
+    char const* eol = static_cast<char const*>(std::memchr(p, '\n',
+        end - p));
+
+    return eol ? eol : end;
+}
+
+// Detects the columns from the first point lines of [p, end).
+XyzLayout
+detect_layout(std::string const& filename, char const* p, char const* end)
+{
+    std::vector<double> samples;
+    std::size_t num_columns(max_columns), num_lines(0);
+
+    while (p != end && num_lines < num_sample_lines)
+    {
+        char const* eol = line_end(p, end);
+
+        if (point_line(p, eol))
+        {
+            double values[max_columns];
+            std::size_t n = parse_line(p, eol, values, max_columns);
+
+            if (n == malformed_line)
+            {
+                throw_error(filename, "malformed point line");
+            }
+
+            num_columns = std::min(num_columns, n);
+            samples.insert(samples.end(), values, values + max_columns);
+            std::fill(samples.end() - (max_columns - n), samples.end(), 0.0);
+            ++num_lines;
+        }
+
+        p = eol == end ? end : eol + 1;
+    }
+
+    XyzLayout layout;
+    layout.num_columns = num_lines > 0 ? num_columns : 3;
+    layout.intensity = layout.normal = layout.color = -1;
+
+    if (layout.num_columns < 3)
+    {
+        throw_error(filename, "less than three columns");
+    }
+
+    std::size_t rest = layout.num_columns - 3;
+    std::size_t group = 3;
+
+    if (rest % 3 == 1)
+    {
+        layout.intensity = 3;
+        ++group;
+    }
+
+    for (; group + 3 <= layout.num_columns; group += 3)
+    {
+        bool normal(true), color(true);
+
+        for (std::size_t i(0); i < num_lines; ++i)
+        {
+            double const* v = samples.data() + i * max_columns + group;
+            double length = std::sqrt(v[0] * v[0] + v[1] * v[1]
+                + v[2] * v[2]);
+
+            normal = normal && std::abs(length - 1.0) < 1e-2;
+
+            for (std::size_t j(0); j < 3; ++j)
+            {
+                color = color && v[j] >= 0.0 && v[j] <= 255.0
+                    && v[j] == std::floor(v[j]);
+            }
+        }
+
+        if (normal && layout.normal < 0)
+        {
+            layout.normal = static_cast<int>(group);
+        }
+        else if (color && layout.color < 0)
+        {
+            layout.color = static_cast<int>(group);
+        }
+    }
+
+    return layout;
+}
+
+inline unsigned int
+color_channel(double value)
+{
+    return static_cast<unsigned int>(std::min(std::max(value, 0.0), 255.0));
+}
+
+}
+
+void
+read_xyz(std::string const& filename, XyzData& data)
+{
+    GLviz::MappedFile file(filename);
+
+    char const* text = file.data();
+    std::size_t size = file.size();
+
+    XyzLayout layout = detect_layout(filename, text, text + size);
+
+    std::size_t num_pieces = std::max<std::size_t>(1,
+        std::min<std::size_t>(4 * num_worker_threads(), size >> 16));
+
+    std::vector<std::size_t> piece_begin(num_pieces + 1, size);
+    piece_begin[0] = 0;
+    for (std::size_t k(1); k < num_pieces; ++k)
+    {
+        std::size_t b = std::max(piece_begin[k - 1], k * size / num_pieces);
+        while (b < size && b > 0 && text[b - 1] != '\n')
+        {
+            ++b;
+        }
+        piece_begin[k] = b;
+    }
+
+    // Counts the points per piece, then parses them straight to their final
+    // index.
+    std::vector<std::size_t> piece_points(num_pieces + 1, 0);
+
+    parallel_for(0, num_pieces, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t k(first); k < last; ++k)
+        {
+            char const* p = text + piece_begin[k];
+            char const* end = text + piece_begin[k + 1];
+
+            while (p != end)
+            {
+                char const* eol = line_end(p, end);
+                piece_points[k + 1] += point_line(p, eol);
+                p = eol == end ? end : eol + 1;
+            }
+        }
+    }, 1);
+
+    for (std::size_t k(0); k < num_pieces; ++k)
+    {
+        piece_points[k + 1] += piece_points[k];
+    }
+
+    std::size_t n = piece_points[num_pieces];
+
+    data.positions.resize(n);
+    data.normals.resize(layout.normal >= 0 ? n : 0);
+    data.intensities.resize(layout.intensity >= 0 ? n : 0);
+    data.colors.resize(layout.color >= 0 ? n : 0);
+
+    parallel_for(0, num_pieces, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t k(first); k < last; ++k)
+        {
+            char const* p = text + piece_begin[k];
+            char const* end = text + piece_begin[k + 1];
+            std::size_t i = piece_points[k];
+
+            while (p != end)
+            {
+                char const* eol = line_end(p, end);
+
+                // Parses first and sorts out the lines to skip afterwards,
+                // agreeing with point_line().
+                double v[max_columns];
+                std::size_t m = parse_line(p, eol, v, layout.num_columns);
+
+                if (m == malformed_line ? point_line(p, eol) : m >= 2)
+                {
+                    if (m == malformed_line)
+                    {
+                        throw_error(filename, "malformed point line");
+                    }
+                    if (m < layout.num_columns)
+                    {
+                        throw_error(filename, "missing columns");
+                    }
+
+                    data.positions[i] = Vector3f(static_cast<float>(v[0]),
+                        static_cast<float>(v[1]), static_cast<float>(v[2]));
+
+                    if (layout.intensity >= 0)
+                    {
+                        data.intensities[i] = static_cast<float>(
+                            v[layout.intensity]);
+                    }
+
+                    if (layout.normal >= 0)
+                    {
+                        double const* w = v + layout.normal;
+                        data.normals[i] = Vector3f(static_cast<float>(w[0]),
+                            static_cast<float>(w[1]),
+                            static_cast<float>(w[2]));
+                    }
+
+                    if (layout.color >= 0)
+                    {
+                        double const* w = v + layout.color;
+                        data.colors[i] = 0xff000000u
+                            | color_channel(w[2]) << 16
+                            | color_channel(w[1]) << 8
+                            | color_channel(w[0]);
+                    }
+
+                    ++i;
+                }
+
+                p = eol == end ? end : eol + 1;
+            }
+        }
+    }, 1);
+}
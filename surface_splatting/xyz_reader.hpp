@@ -0,0 +1,49 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef XYZ_READER_HPP
+#define XYZ_READER_HPP
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+
+// Points of an ASCII XYZ or PTS file. Arrays of columns missing in the file
+// stay empty.
+struct XyzData
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<float> intensities;
+    std::vector<unsigned int> colors;           // 0xAABBGGRR, opaque.
+};
+
+// Reads one point per line, values separated by spaces, tabs, commas or
+// semicolons. The columns are detected from the first lines: x y z, then an
+// intensity if one column is left over from groups of three, then groups of
+// three taken as normal if they have unit length and as color if they hold
+// integers from 0 to 255. Unrecognized columns are skipped. Lines with a
+// single value, the point counts of PTS files, blank lines and comments
+// starting with # or // are skipped as well.
+//
+// The file is mapped and split at line ends into pieces parsed on all
+// cores, straight into the arrays. Throws std::runtime_error on malformed
+// files.
+void read_xyz(std::string const& filename, XyzData& data);
+
+#endif // XYZ_READER_HPP
@@ -18,9 +18,19 @@
 #include <GLViz>
 
 #include <splat_renderer.hpp>
+#include <mesh_surfels.hpp>
+#include <point_cloud.hpp>
+#include <surfel_simplification.hpp>
+#include <surfel_coverage.hpp>
+#include <surfel_file.hpp>
+#include <surfel_chunk_cache.hpp>
+#include <ply_reader.hpp>
+#include <xyz_reader.hpp>
+#include <surfel_lod.hpp>
 
 //#include "../vendors/Eigen/Core"
 #include "Eigen/Core"
+#include "Eigen/Geometry"
 
 #include <iostream>
 #include <memory>
@@ -29,6 +39,9 @@
 #include <vector>
 #include <array>
 #include <exception>
+#include <chrono>
+#include <cstdlib>
+#include <random>
 
 using namespace Eigen;
 
@@ -42,19 +55,116 @@ std::vector<Eigen::Vector3f>               m_ref_normals;
 std::vector<Eigen::Vector3f>               m_vertices;
 std::vector<std::array<unsigned int, 3> >  m_faces;
 std::vector<Eigen::Vector3f>               m_normals;
+std::vector<unsigned int>                  m_point_colors;
 
 std::vector<Surfel>  m_surfels;
+SurfelBuffer         m_surfel_buffer;
+bool                 m_soa = false;
+bool                 m_external = false;
+unsigned int         m_grid = 0;
+unsigned int         m_random = 0;
+unsigned int         m_simplify = 0;
+bool                 m_coverage = false;
+SurfelFile           m_surfel_file;
+std::string          m_save_filename;
+bool                 m_compress = false;
+std::size_t          m_budget_mb = 0;
+std::unique_ptr<SurfelChunkCache> m_chunk_cache;
+bool                 m_ply_surfels = false;
+bool                 m_async = false;
+bool                 m_per_vertex = false;
+bool                 m_points = false;
+bool                 m_benchmark_normals = false;
+bool                 m_benchmark_raw = false;
+bool                 m_use_lod = false;
+SurfelLod            m_lod;
+bool                 m_benchmark = false;
+void*                m_upload_context = nullptr;
 
 void load_triangle_mesh(std::string const& filename);
 
+void
+print_frame_statistics()
+{
+    typedef std::chrono::high_resolution_clock clock;
+
+    static clock::time_point start = clock::now();
+    static unsigned int frames = 0;
+    static std::size_t bytes = 0;
+
+    // Bytes the renderer actually copied this frame, which need not match
+    // the size of m_surfels.
+    bytes += viz->uploaded_bytes();
+
+    if (++frames == 256)
+    {
+        std::chrono::duration<double> elapsed = clock::now() - start;
+
+        double frame_ms = 1e3 * elapsed.count() / frames;
+        double upload_mbs = static_cast<double>(bytes) / (1024.0 * 1024.0)
+            / elapsed.count();
+
+        if (m_chunk_cache)
+        {
+            std::cout << "[out-of-core] " << m_chunk_cache->num_resident()
+                << " of " << m_chunk_cache->num_slots()
+                << " slots resident, " << m_chunk_cache->draw_first().size()
+                << " of " << m_chunk_cache->num_visible()
+                << " visible chunks drawn" << std::endl;
+        }
+
+        if (m_use_lod)
+        {
+            std::cout << "[lod] " << m_lod.num_selected() << " of "
+                << m_lod.num_nodes() << " nodes selected" << std::endl;
+        }
+
+        if (viz->frustum_culling() || viz->backface_culling()
+            || viz->occlusion_culling())
+        {
+            std::cout << "[culling] " << viz->num_visible_surfels()
+                << " surfels submitted, " << viz->num_occluded_surfels()
+                << " held back for occlusion queries" << std::endl;
+        }
+
+        std::cout << (m_soa ? "[soa] " : (viz->streaming() ? "[stream] "
+                : "[orphan] "))
+            << (!m_soa && viz->packed_format() ? "[packed] " : "")
+            << frame_ms << " ms/frame, " << upload_mbs << " MB/s upload"
+            << std::endl;
+
+        start = clock::now();
+        frames = 0;
+        bytes = 0;
+    }
+}
+
 void
 displayFunc()
 {
-    viz->set_geometry(&m_surfels);
-    GLuint textureID = viz->render_frame(true, 0, 0, 0, 0);
+    // Plain surfel files are drawn straight from the mapping.
+    if (m_chunk_cache)
+        viz->set_geometry(m_chunk_cache.get());
+    else if (m_use_lod)
+        viz->set_geometry(&m_lod);
+    else if (m_surfel_file.surfels())
+        viz->set_geometry(m_surfel_file.surfels(),
+            m_surfel_file.num_surfels());
+    else if (m_soa)
+        viz->set_geometry(&m_surfel_buffer);
+    else if (m_external)
+        viz->set_geometry(m_surfels.data(), m_surfels.size());
+    else if (m_grid == 0 && !m_async)
+        viz->set_geometry(&m_surfels);
+
+    // The asynchronous upload is started once in main().
+    GLuint textureID = viz->render_frame(!m_async, 0, 0, 0, 0);
 #ifndef NDEBUG
 	std::cout << "Texture ID: " << textureID << std::endl;
 #endif
+
+    if (m_benchmark)
+        print_frame_statistics();
 }
 
 void
@@ -73,6 +183,12 @@ void
 closeFunc()
 {
     viz = nullptr;
+    m_chunk_cache = nullptr;
+
+    if (m_upload_context)
+    {
+        GLviz::delete_shared_context(m_upload_context);
+    }
 }
 
 void
@@ -81,9 +197,67 @@ load_triangle_mesh(std::string const& filename)
     std::cout << "\nRead " << filename << "." << std::endl;
     std::ifstream input(filename);
 
-    if (input.good()) {
+    bool ply = filename.size() > 4
+        && filename.compare(filename.size() - 4, 4, ".ply") == 0;
+    bool xyz = filename.size() > 4
+        && (filename.compare(filename.size() - 4, 4, ".xyz") == 0
+        || filename.compare(filename.size() - 4, 4, ".pts") == 0);
+
+    if (input.good() && xyz) {
         input.close();
-        GLviz::load_raw(filename, m_vertices, m_faces);
+
+        // Scans are always fitted, with their colors if they have any.
+        XyzData data;
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        read_xyz(filename, data);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::cout << "  parsed in " << 1e3 * elapsed.count() << " ms"
+            << std::endl;
+
+        m_vertices.swap(data.positions);
+        m_point_colors.swap(data.colors);
+        m_points = true;
+    } else if (input.good() && ply) {
+        input.close();
+
+        // Oriented points with radii are surfels already, points without
+        // faces are fitted.
+        PlyData data;
+        read_ply(filename, data);
+
+        if (ply_to_surfels(data, m_surfels)) {
+            std::cout << "  #surfels  " << m_surfels.size() << std::endl;
+            m_ply_surfels = true;
+            return;
+        }
+
+        m_vertices.swap(data.positions);
+        m_faces.swap(data.faces);
+        m_points = m_points || m_faces.empty();
+    } else if (input.good()) {
+        input.close();
+
+        if (m_benchmark_raw) {
+            typedef std::chrono::steady_clock clock;
+
+            clock::time_point start = clock::now();
+            GLviz::load_raw_stream(filename, m_vertices, m_faces);
+            std::chrono::duration<double> stream = clock::now() - start;
+
+            start = clock::now();
+            GLviz::load_raw(filename, m_vertices, m_faces);
+            std::chrono::duration<double> mapped = clock::now() - start;
+
+            std::cout << "  raw load  " << 1e3 * stream.count()
+                << " ms stream, " << 1e3 * mapped.count() << " ms mapped"
+                << std::endl;
+        } else {
+            GLviz::load_raw(filename, m_vertices, m_faces);
+        }
     } else {
         throw std::runtime_error(std::string("Could not open mesh file! path = ") + filename);
     }
@@ -91,8 +265,28 @@ load_triangle_mesh(std::string const& filename)
     std::cout << "  #vertices " << m_vertices.size() << std::endl;
     std::cout << "  #faces    " << m_faces.size() << std::endl;
 
-    GLviz::set_vertex_normals_from_triangle_mesh(
-        m_vertices, m_faces, m_normals);
+    if (m_benchmark_normals)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        clock::time_point start = clock::now();
+        GLviz::set_vertex_normals_from_triangle_mesh(
+            m_vertices, m_faces, m_normals);
+        std::chrono::duration<double> serial = clock::now() - start;
+
+        start = clock::now();
+        GLviz::set_vertex_normals_from_triangle_mesh_parallel(
+            m_vertices, m_faces, m_normals);
+        std::chrono::duration<double> parallel = clock::now() - start;
+
+        std::cout << "  normals   " << 1e3 * serial.count() << " ms serial, "
+            << 1e3 * parallel.count() << " ms parallel" << std::endl;
+    }
+    else
+    {
+        GLviz::set_vertex_normals_from_triangle_mesh_parallel(
+            m_vertices, m_faces, m_normals);
+    }
 
     m_ref_vertices = m_vertices;
     m_ref_normals = m_normals;
@@ -329,60 +523,112 @@ hsv2rgb(float h, float s, float v, float& r, float& g, float& b)
     }
 }
 
+unsigned int
+hue_color(Surfel const& surfel)
+{
+#undef min // min version already included by windows.h ..
+    float h = std::min((std::abs(surfel.c.x()) / 0.45f) * 360.0f, 360.0f);
+    float r, g, b;
+    hsv2rgb(h, 1.0f, 1.0f, r, g, b);
+    return static_cast<unsigned int>(r * 255.0f)
+        | (static_cast<unsigned int>(g * 255.0f) << 8)
+        | (static_cast<unsigned int>(b * 255.0f) << 16);
+}
+
 void
 load_dragon()
 {
-    m_surfels.resize(m_faces.size());
+    mesh_to_surfels(m_vertices, m_faces, m_normals, m_surfels,
+        m_per_vertex ? PerVertexSurfels : PerFaceSurfels, hue_color);
+}
 
-    for (unsigned int i(0); i < static_cast<unsigned int>(
-        m_faces.size()); ++i)
+
+// Sum of the splat areas, proportional to the fragments rasterized for a
+// fixed view.
+float
+splat_area(std::vector<Surfel> const& surfels)
+{
+    float area(0.0f);
+    for (std::size_t i(0); i < surfels.size(); ++i)
     {
-        std::array<unsigned int, 3> face = m_faces[i];
-        Vector3f v[3] = {
-            m_vertices[face[0]],
-            m_vertices[face[1]],
-            m_vertices[face[2]]
-        };
-
-        Vector3f p0, t1, t2;
-#ifndef NDEBUG
-		Vector3f &dbg = t2;
-		dbg[0] = 0; dbg[1] = 0; dbg[2] = 0;
-		std::cout << dbg[0] << " " << dbg[1] << " " << dbg[2] << std::endl;
-#endif
-        viz->computerPrincipalDirections(
-            v[0].data(), v[1].data(), v[2].data(),
-            p0.data(), t1.data(), t2.data()
-            );
+        area += surfels[i].u.norm() * surfels[i].v.norm();
+    }
 
-#ifndef NDEBUG
-		std::cout << dbg[0] << " " << dbg[1] << " " << dbg[2] << std::endl << std::endl;
-#endif
+    return 3.14159265f * area;
+}
+
+void
+simplify(std::size_t target_count)
+{
+    SurfelSimplification simplification;
+    simplification.target_count = target_count;
+
+    std::vector<Surfel> simplified;
+    simplify_surfels(m_surfels, simplified, simplification);
+
+    std::cout << "Simplified " << m_surfels.size() << " to "
+        << simplified.size() << " surfels, splat area " << splat_area(m_surfels)
+        << " to " << splat_area(simplified) << "." << std::endl;
+
+    m_surfels.swap(simplified);
+}
+
+// Treats the mesh vertices as an unoriented scan and fits surfels to them.
+void
+load_points()
+{
+    PointCloud cloud;
+    cloud.positions = m_vertices;
+    cloud.colors = m_point_colors;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    fit_surfels(cloud, m_surfels);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
 
-        Vector3f n_s = t1.cross(t2);
-        Vector3f n_t = (v[1] - v[0]).cross(v[2] - v[0]);
+    std::cout << "Fitted " << m_surfels.size() << " surfels in "
+        << 1e3 * elapsed.count() << " ms." << std::endl;
 
-        if (n_t.dot(n_s) < 0.0f)
+    if (m_point_colors.empty())
+    {
+        for (std::size_t i(0); i < m_surfels.size(); ++i)
         {
-            t1.swap(t2);
+            m_surfels[i].rgba = hue_color(m_surfels[i]);
         }
+    }
+}
 
-        m_surfels[i].c = p0;
-        m_surfels[i].u = t1;
-        m_surfels[i].v = t2;
-        m_surfels[i].p = Vector3f::Zero();
+// Samples n surfels on the unit sphere in random order, the way unsorted
+// scanner output arrives.
+void
+load_random_sphere(unsigned int n)
+{
+    std::mt19937 generator(0);
+    std::normal_distribution<float> normal;
 
-#undef min // min version already included by windows.h ..
-        float h = std::min((std::abs(p0.x()) / 0.45f) * 360.0f, 360.0f);
-        float r, g, b;
-        hsv2rgb(h, 1.0f, 1.0f, r, g, b);
-        m_surfels[i].rgba = static_cast<unsigned int>(r * 255.0f)
-                         | (static_cast<unsigned int>(g * 255.0f) << 8)
-                         | (static_cast<unsigned int>(b * 255.0f) << 16);
+    // Radius of a disk covering the sphere area per surfel, with overlap.
+    const float radius = 2.0f * std::sqrt(4.0f / static_cast<float>(n));
+
+    m_surfels.resize(n);
+    for (unsigned int i(0); i < n; ++i)
+    {
+        Vector3f c(normal(generator), normal(generator), normal(generator));
+        c.normalize();
+
+        Vector3f u = c.unitOrthogonal();
+        Vector3f v = c.cross(u);
+
+        m_surfels[i].c = c;
+        m_surfels[i].u = radius * u;
+        m_surfels[i].v = radius * v;
+        m_surfels[i].p = Vector3f::Zero();
+        m_surfels[i].rgba = static_cast<unsigned int>(127.5f * (c.x() + 1.0f))
+            | static_cast<unsigned int>(127.5f * (c.y() + 1.0f)) << 8
+            | static_cast<unsigned int>(127.5f * (c.z() + 1.0f)) << 16;
     }
 }
 
-
 int
 main(int argc, char* argv[])
 {
@@ -399,11 +645,70 @@ main(int argc, char* argv[])
 
 	///*
     std::string filename = "stanford_dragon_v40k_f80k.raw";
-    if (argc > 1)
-        filename = argv[1];
+    for (int i(1); i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+
+        if (arg == "--stream")
+            viz->set_streaming();
+        else if (arg == "--packed")
+            viz->set_packed_format();
+        else if (arg == "--soa")
+            m_soa = true;
+        else if (arg == "--external")
+            m_external = true;
+        else if (arg == "--instances" && i + 1 < argc)
+            m_grid = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--random" && i + 1 < argc)
+            m_random = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--simplify" && i + 1 < argc)
+            m_simplify = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--coverage")
+            m_coverage = true;
+        else if (arg == "--save" && i + 1 < argc)
+            m_save_filename = argv[++i];
+        else if (arg == "--compress")
+            m_compress = true;
+        else if (arg == "--out-of-core" && i + 1 < argc)
+            m_budget_mb = static_cast<std::size_t>(std::atoi(argv[++i]));
+        else if (arg == "--async")
+            m_async = true;
+        else if (arg == "--benchmark-normals")
+            m_benchmark_normals = true;
+        else if (arg == "--benchmark-raw")
+            m_benchmark_raw = true;
+        else if (arg == "--points")
+            m_points = true;
+        else if (arg == "--vertices")
+            m_per_vertex = true;
+        else if (arg == "--morton")
+            viz->set_spatial_reordering(true, MortonCurve);
+        else if (arg == "--hilbert")
+            viz->set_spatial_reordering(true, HilbertCurve);
+        else if (arg == "--cull")
+            viz->set_frustum_culling(true);
+        else if (arg == "--backface")
+            viz->set_backface_culling(true);
+        else if (arg == "--occlusion")
+            viz->set_occlusion_culling(true);
+        else if (arg == "--feedback")
+            viz->set_transform_feedback(true);
+        else if (arg == "--lod")
+            m_use_lod = true;
+        else if (arg == "--benchmark")
+            m_benchmark = true;
+        else
+            filename = arg;
+    }
+
+    bool surfel_file = filename.size() > 8
+        && filename.compare(filename.size() - 8, 8, ".surfels") == 0;
 
     try {
-        load_triangle_mesh(filename);
+        if (surfel_file)
+            m_surfel_file.open(filename);
+        else
+            load_triangle_mesh(filename);
     } catch(std::runtime_error const& e) {
         std::cerr << e.what() << std::endl;
         std::exit(EXIT_FAILURE);
@@ -412,7 +717,124 @@ main(int argc, char* argv[])
 
     //load_plane(200);
     //load_cube();
-	load_dragon();
+    if (surfel_file)
+        std::cout << "\nMapped " << m_surfel_file.num_surfels()
+            << " surfels in " << m_surfel_file.num_chunks() << " chunks."
+            << std::endl;
+    else if (m_points)
+        load_points();
+    else if (!m_ply_surfels)
+        load_dragon();
+
+    // Streams the chunks of a surfel file into a vertex buffer of
+    // m_budget_mb megabytes.
+    if (surfel_file && m_budget_mb > 0)
+    {
+        m_chunk_cache.reset(new SurfelChunkCache(m_surfel_file,
+            m_budget_mb << 20, viz->packed_format()));
+    }
+
+    // Compressed surfel files are decoded once and drawn from m_surfels.
+    else if (m_surfel_file.compressed())
+    {
+        typedef std::chrono::high_resolution_clock clock;
+        clock::time_point start = clock::now();
+
+        m_surfels.resize(m_surfel_file.num_surfels());
+
+        try {
+            m_surfel_file.decode(m_surfels.data());
+        } catch(std::runtime_error const& e) {
+            std::cerr << e.what() << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::chrono::duration<double, std::milli> elapsed =
+            clock::now() - start;
+        std::cout << "Decoded in " << elapsed.count() << " ms." << std::endl;
+    }
+
+    if (m_random > 0)
+    {
+        load_random_sphere(m_random);
+    }
+
+    if (m_simplify > 0)
+    {
+        simplify(m_simplify);
+    }
+
+    if (m_coverage)
+    {
+        float area = splat_area(m_surfels);
+        scale_to_coverage(m_surfels);
+
+        std::cout << "Scaled to coverage, splat area " << area << " to "
+            << splat_area(m_surfels) << "." << std::endl;
+    }
+
+    if (!m_save_filename.empty())
+    {
+        write_surfel_file(m_save_filename, m_surfels.data(),
+            m_surfels.size(), 65536,
+            m_compress ? CompressedSurfels : PlainSurfels);
+    }
+
+    // Draws the model m_grid x m_grid times as instances of one batch.
+    if (m_grid > 0)
+    {
+        std::vector<Matrix4f, aligned_allocator<Matrix4f> > instances;
+        float scale = 1.0f / static_cast<float>(m_grid);
+
+        for (unsigned int i(0); i < m_grid; ++i)
+        {
+            for (unsigned int j(0); j < m_grid; ++j)
+            {
+                Affine3f transform = Translation3f(
+                    scale * (2.0f * i + 1.0f) - 1.0f,
+                    scale * (2.0f * j + 1.0f) - 1.0f, 0.0f)
+                    * Scaling(scale);
+                instances.push_back(transform.matrix());
+            }
+        }
+
+        unsigned int batch = viz->add_batch(m_surfels.data(),
+            m_surfels.size());
+        viz->set_batch_instances(batch, instances.data(), instances.size());
+    }
+
+    if (m_async)
+    {
+        m_upload_context = GLviz::create_shared_context();
+        if (m_upload_context)
+        {
+            viz->enable_async_upload([](bool current)
+            {
+                GLviz::make_context_current(
+                    current ? m_upload_context : nullptr);
+            });
+        }
+
+        viz->set_geometry_async(&m_surfels);
+    }
+
+    if (m_use_lod)
+    {
+        typedef std::chrono::high_resolution_clock clock;
+        clock::time_point start = clock::now();
+
+        m_lod.build(m_surfels.data(), m_surfels.size());
+
+        std::chrono::duration<double, std::milli> elapsed =
+            clock::now() - start;
+        std::cout << "Built " << m_lod.num_nodes() << " level of detail "
+            << "nodes in " << elapsed.count() << " ms." << std::endl;
+    }
+
+    if (m_soa)
+    {
+        m_surfel_buffer.assign(m_surfels.data(), m_surfels.size());
+    }
 
     GLviz::display_callback(displayFunc);
     GLviz::reshape_callback(reshapeFunc);
@@ -0,0 +1,121 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+#include <parallel.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+typedef std::vector<std::pair<std::size_t, std::size_t> > BlockList;
+
+// Returns whether the blocks passed to f cover [begin, end) exactly once.
+bool
+covers(std::size_t begin, std::size_t end, std::size_t grain_size)
+{
+    BlockList blocks;
+    std::mutex mutex;
+
+    parallel_for(begin, end, [&](std::size_t first, std::size_t last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(std::make_pair(first, last));
+    }, grain_size);
+
+    std::sort(blocks.begin(), blocks.end());
+
+    std::size_t next = begin;
+    for (std::size_t i(0); i < blocks.size(); ++i)
+    {
+        if (blocks[i].first != next || blocks[i].second <= blocks[i].first)
+        {
+            return false;
+        }
+
+        next = blocks[i].second;
+    }
+
+    return next == end && (begin < end || blocks.empty());
+}
+
+}
+
+int
+main()
+{
+    unsigned int num_threads = num_worker_threads();
+    int num_failures = 0;
+
+    // Sizes just above the thread count with grain 1 used to produce
+    // blocks starting past end.
+    std::size_t max_n = 4 * static_cast<std::size_t>(num_threads)
+        * num_threads + 64;
+
+    std::size_t const grain_sizes[] = { 1, 3, 4096 };
+    std::size_t const offsets[] = { 0, 17 };
+
+    for (std::size_t g(0); g < 3; ++g)
+    {
+        for (std::size_t o(0); o < 2; ++o)
+        {
+            for (std::size_t n(0); n <= max_n; ++n)
+            {
+                if (!covers(offsets[o], offsets[o] + n, grain_sizes[g]))
+                {
+                    std::cerr << "parallel_for: n = " << n << ", grain "
+                        << grain_sizes[g] << ", offset " << offsets[o]
+                        << " does not cover the range" << std::endl;
+                    ++num_failures;
+                }
+            }
+        }
+    }
+
+    bool rethrown = false;
+    try
+    {
+        parallel_for(0, 1000, [](std::size_t first, std::size_t)
+        {
+            if (first == 0)
+            {
+                throw std::runtime_error("first block");
+            }
+        }, 1);
+    }
+    catch (std::runtime_error const&)
+    {
+        rethrown = true;
+    }
+
+    if (!rethrown)
+    {
+        std::cerr << "parallel_for: exception not rethrown" << std::endl;
+        ++num_failures;
+    }
+
+    std::cout << "parallel_test: " << num_threads << " threads, "
+        << num_failures << " failures" << std::endl;
+
+    return num_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+// This file is part of Surface Splatting.
+//
+// Copyright (C) 2010, 2015 by Sebastian Lipponer.
+// 
+// Surface Splatting is free software: you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Surface Splatting is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Surface Splatting. If not, see <http://www.gnu.org/licenses/>.
+
+#include <surfel_coverage.hpp>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace Eigen;
+
+namespace
+{
+
+// Jittered grid of n x n surfels with unit spacing in the plane z = 0,
+// starting at the origin. Disks of the given radius leave holes between the
+// grid points.
+std::vector<Surfel>
+grid(unsigned int n, float radius)
+{
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> jitter(-0.1f, 0.1f);
+
+    std::vector<Surfel> surfels(n * n);
+    for (unsigned int i(0); i < n * n; ++i)
+    {
+        Surfel& s = surfels[i];
+        s.c = Vector3f(static_cast<float>(i % n) + jitter(generator),
+            static_cast<float>(i / n) + jitter(generator), 0.0f);
+        s.u = radius * Vector3f::UnitX();
+        s.v = radius * Vector3f::UnitY();
+        s.p = Vector3f::Zero();
+        s.rgba = 0;
+    }
+
+    return surfels;
+}
+
+// Splats are at most 4 x 0.4 wide, only the grid points around x can
+// reach it.
+bool
+covered(std::vector<Surfel> const& surfels, unsigned int n,
+    Vector3f const& x)
+{
+    int x0 = static_cast<int>(x(0)), y0 = static_cast<int>(x(1));
+    int size = static_cast<int>(n);
+
+    for (int y(std::max(0, y0 - 3)); y < std::min(size, y0 + 4); ++y)
+    {
+        for (int i(std::max(0, x0 - 3)); i < std::min(size, x0 + 4); ++i)
+        {
+            Surfel const& s = surfels[y * n + i];
+            Vector3f d = x - s.c;
+
+            float a = d.dot(s.u) / s.u.squaredNorm();
+            float b = d.dot(s.v) / s.v.squaredNorm();
+
+            if (a * a + b * b <= 1.0f)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Counts the points of [x0, x1] x [y0, y1] covered by none of the splats.
+unsigned int
+holes(std::vector<Surfel> const& surfels, unsigned int n, float x0, float x1,
+    float y0, float y1, unsigned int samples)
+{
+    std::mt19937 generator(2);
+    std::uniform_real_distribution<float> x(x0, x1), y(y0, y1);
+
+    unsigned int num_holes(0);
+    for (unsigned int i(0); i < samples; ++i)
+    {
+        num_holes += !covered(surfels, n, Vector3f(x(generator),
+            y(generator), 0.0f));
+    }
+
+    return num_holes;
+}
+
+float
+area(std::vector<Surfel> const& surfels)
+{
+    float a(0.0f);
+    for (std::size_t i(0); i < surfels.size(); ++i)
+    {
+        a += surfels[i].u.cross(surfels[i].v).norm();
+    }
+
+    return 3.14159265f * a;
+}
+
+}
+
+int
+main()
+{
+    const unsigned int n = 40;
+    const unsigned int samples = 4000;
+    int num_failures = 0;
+
+    // Disks of radius 0.4 leave the corners between grid points open.
+    std::vector<Surfel> surfels = grid(n, 0.4f);
+    unsigned int holes_before = holes(surfels, n, 1.0f, n - 2.0f,
+        1.0f, n - 2.0f, samples);
+
+    float area_before = area(surfels);
+    scale_to_coverage(surfels);
+    float area_after = area(surfels);
+
+    unsigned int holes_after = holes(surfels, n, 1.0f, n - 2.0f, 1.0f,
+        n - 2.0f, samples);
+
+    std::cout << "surfel_coverage_test: grid, " << holes_before << " to "
+        << holes_after << " holes of " << samples << ", area "
+        << area_before << " to " << area_after << std::endl;
+
+    if (holes_before == 0 || holes_after != 0)
+    {
+        std::cerr << "surfel_coverage_test: grid holes not closed"
+            << std::endl;
+        ++num_failures;
+    }
+
+    // Border case, the grid ends at x = 0 like a half-plane. The cells of
+    // the surfels there are open towards negative x, they have to close
+    // the holes on their right without growing towards the empty side.
+    std::vector<float> scales;
+    coverage_scales(grid(n, 0.4f).data(), n * n, scales);
+
+    float max_scale(0.0f), max_border_scale(0.0f);
+    for (unsigned int y(1); y + 1 < n; ++y)
+    {
+        for (unsigned int x(1); x + 1 < n; ++x)
+        {
+            max_scale = std::max(max_scale, scales[y * n + x]);
+        }
+
+        max_border_scale = std::max(max_border_scale, scales[y * n]);
+    }
+
+    unsigned int border_holes = holes(surfels, n, 0.0f, 3.0f, 1.0f,
+        n - 2.0f, samples);
+
+    std::cout << "surfel_coverage_test: border, " << border_holes
+        << " holes of " << samples << ", largest scale "
+        << max_border_scale << " against " << max_scale << " inside"
+        << std::endl;
+
+    if (border_holes != 0)
+    {
+        std::cerr << "surfel_coverage_test: holes along the border"
+            << std::endl;
+        ++num_failures;
+    }
+
+    if (max_border_scale > 1.1f * max_scale)
+    {
+        std::cerr << "surfel_coverage_test: border surfels grow towards the "
+            << "empty side" << std::endl;
+        ++num_failures;
+    }
+
+    return num_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}